@@ -30,13 +30,24 @@ namespace cv
             struct Tile
             {
                 std::vector<int> blockIndices;
+                cv::Rect rect;
             };
             typedef std::vector<Tile> Tiles;
+            struct TileGrid
+            {
+                cv::Rect rect;
+                cv::Size cellSize;
+                int cols{};
+                int rows{};
+                std::vector<std::vector<int>> cells;
+            };
             struct ZoomLevel
             {
                 double zoom;
-                CZISubBlocks blocks;
+                // indices of the level sub-blocks in the block table of the slide
+                std::vector<int> blocks;
                 Tiles tiles;
+                TileGrid grid;
             };
             struct ComponentInfo
             {
@@ -52,15 +63,19 @@ namespace cv
                 int32_t numComponents;
                 DataType componentType;
             };
+        public:
+            // user data of the Tiler methods
             struct TilerData
             {
                 int zoomLevelIndex;
                 int zSliceIndex;
                 int tFrameIndex;
                 double relativeZoom;
+                // tiles of the plane decoded ahead by a 4D read, not cached
+                const std::map<int, cv::Mat>* stagedTiles{nullptr};
             };
-        public:
             CZIScene();
+            ~CZIScene() override;
             std::string getFilePath() const override;
             cv::Rect getRect() const override;
             int getNumChannels() const override;
@@ -74,13 +89,34 @@ namespace cv
             double getMagnification() const override;
             void readResampledBlockChannels(const cv::Rect& blockRect, const cv::Size& blockSize,
                 const std::vector<int>& componentIndices, cv::OutputArray output) override;
+            void readComposedBlockChannels(const cv::Rect& blockRect, const cv::Size& blockSize,
+                const std::vector<int>& componentIndices, ComposeMode mode, cv::OutputArray output) override;
+            void readBlocks(const std::vector<cv::Rect>& blockRects, const cv::Size& blockSize,
+                const std::vector<int>& componentIndices, std::vector<cv::Mat>& outputs) override;
+            // reads a range of z-slices and time frames. Empty ranges select the plane at
+            // their start. The output of several planes is a 4D matrix with dimensions
+            // (time frames, z-slices, rows, columns), a single plane is read as a 2D matrix.
+            void readResampled4DBlockChannels(const cv::Rect& blockRect, const cv::Size& blockSize,
+                const std::vector<int>& componentIndices, const cv::Range& zSliceRange,
+                const cv::Range& timeFrameRange, cv::OutputArray output) override;
+            int alignBandEnd(int level, int levelRow) const override;
+            int getNumLevels() const override;
+            LevelInfo getLevelInfo(int level) const override;
+            void readLevelBlock(int level, const cv::Rect& blockRect, const std::vector<int>& componentIndices,
+                cv::OutputArray output) override;
+            int getLevelTileCount(int level) const override;
+            cv::Rect getLevelTileRect(int level, int tileIndex) const override;
+            bool readEncodedTile(int level, int tileIndex, EncodedTile& tile) override;
             std::string getName() const override;
-            void init(uint64_t sceneId, SceneParams& sceneParams, const std::string& filePath, const CZISubBlocks& blocks, CZISlide* slide);
+            void init(uint64_t sceneId, SceneParams& sceneParams, const std::string& filePath, const std::vector<int>& blockIndices, CZISlide* slide);
             // interface Tiler implementaton
             int getTileCount(void* userData) override;
             bool getTileRect(int tileIndex, cv::Rect& tileRect, void* userData) override;
             bool readTile(int tileIndex, const std::vector<int>& componentIndices, cv::OutputArray tileRaster,
                           void* userData) override;
+            void getTilesInRect(const cv::Rect& rect, std::vector<int>& tileIndices, void* userData) override;
+            std::string getCacheScope(void* userData) override;
+            bool supportsConcurrentReads(void* userData) override;
         private:
             void setupComponents(const std::map<int, int>& channelPixelType);
             void generateSceneName();
@@ -88,12 +124,27 @@ namespace cv
             void computeSceneTiles();
             void compute4DParameters();
             const ZoomLevel& getBaseZoomLevel() const;
-            int findBlockIndex(const Tile& tile, const CZISubBlocks& blocks, int channelIndex, int zSliceIndex, int tFrameIndex) const ;
+            // top-left corner of the scene in the mosaic coordinates of the level.
+            // Level coordinates of the Scene interface are relative to it.
+            cv::Point getLevelOrigin(int level) const;
+            // selects the zoom level for the block and computes
+            // the block rectangle in the zoom level coordinates
+            void prepareBlockRead(const cv::Rect& blockRect, const cv::Size& blockSize, TilerData& userData,
+                cv::Rect& zoomLevelRect) const;
+            int findBlockIndex(const Tile& tile, int channelIndex, int zSliceIndex, int tFrameIndex) const ;
             const Tile& getTile(const TilerData* tilerData, int tileIndex) const;
-            const CZISubBlocks& getBlocks(const TilerData* tilerData) const;
+            const CZISubBlockTable& getBlockTable() const;
             bool blockHasData(const CZISubBlock& block, const std::vector<int>& componentIndices, const TilerData* tilerData);
-            static std::vector<uint8_t> decodeData(const CZISubBlock& block, const std::vector<unsigned char>& encodedData);
-            void unpackChannels(const CZISubBlock& block, const std::vector<int>& orgComponentIndices, const std::vector<unsigned char>& blockData, const TilerData* tilerData, std::vector<Mat>& componentRasters);
+            // decodes the tiles of all planes of the z-slice and time frame ranges.
+            // Sub-blocks are read in the order of their file positions, a sub-block
+            // holding several planes is read and decoded once.
+            void stagePlaneTiles(const std::vector<int>& tileIndices, const std::vector<int>& componentIndices,
+                const cv::Range& zSliceRange, const cv::Range& timeFrameRange, const TilerData& tilerData,
+                std::vector<std::map<int, cv::Mat>>& planeTiles);
+            static void decodeData(const CZISubBlock& block, const uint8_t* encodedData, size_t encodedSize, std::vector<uint8_t>& decodedData);
+            // shareData: component rasters may reference blockData instead of copying it
+            void unpackChannels(const CZISubBlock& block, const std::vector<int>& orgComponentIndices, const uint8_t* blockData,
+                bool shareData, const TilerData* tilerData, std::vector<Mat>& componentRasters);
         public:
             // static members
             static uint64_t sceneIdFromDims(int s, int i, int v, int h, int r, int b);
@@ -104,7 +155,8 @@ namespace cv
             static void dimsFromSceneId(uint64_t sceneId, SceneParams& params);
             static void channelComponentInfo(CZIDataType channelType, DataType& componentType, int& numComponents, int& pixelSize);
         private:
-            static void combineBlockInTiles(ZoomLevel& zoomLevel);
+            static void combineBlockInTiles(ZoomLevel& zoomLevel, const CZISubBlockTable& blockTable);
+            static void buildTileGrid(ZoomLevel& zoomLevel);
             // data members
         private:
             std::vector<ZoomLevel> m_zoomLevels;
@@ -119,6 +171,8 @@ namespace cv
             SceneParams m_sceneParams{};
             int m_numZSlices;
             int m_numTFrames;
+            // scope of the scene tiles in the tile cache
+            std::string m_cacheScope;
         };
     }
 }
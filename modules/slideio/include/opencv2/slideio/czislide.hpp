@@ -4,9 +4,10 @@
 #ifndef OPENCV_slideio_czislide_HPP
 #define OPENCV_slideio_czislide_HPP
 #include "slide.hpp"
-#include <fstream>
 #include "cziscene.hpp"
 #include "czistructs.hpp"
+#include "czisubblock.hpp"
+#include "randomaccessfile.hpp"
 
 namespace tinyxml2
 {
@@ -32,12 +33,38 @@ namespace cv
             double getTFrameResolution() const {return m_resT;}
             const CZIChannelInfos& getChannelInfo() const { return m_channels; }
             const std::string& getTitle() const { return m_title; }
-            void readBlock(uint64_t pos, uint64_t size, std::vector<unsigned char>& data);;
+            const CZISubBlockTable& getBlockTable() const { return m_blocks; }
+            // positional read, safe to call concurrently from several threads
+            void readBlock(uint64_t pos, uint64_t size, std::vector<unsigned char>& data) const;
+            // returns a pointer to the block in the memory mapped file
+            // or nullptr if the file is not mapped
+            const uint8_t* getMappedBlock(uint64_t pos, uint64_t size) const;
+            // enables memory mapping of slides opened afterwards.
+            // Uncompressed sub-blocks are then read without intermediate copies.
+            static void setMemoryMapping(bool enable);
+            static bool getMemoryMapping();
+            // enables the directory index cache. The parsed directory and the scene partitioning
+            // are stored in a sidecar file next to the slide (empty directory) or in the cache directory.
+            // The index is reused while size, modification time and header of the slide are unchanged.
+            static void setIndexCache(bool enable, const std::string& directory = std::string());
         private:
+            struct IndexSignature
+            {
+                uint32_t version{1};
+                uint64_t fileSize{};
+                int64_t modificationTime{};
+                uint64_t headerHash{};
+            };
             void init();
             void readMetadata();
             void readFileHeader();
-            void readDirectory();
+            void readDirectory(std::vector<uint64_t>& sceneIds, std::vector<std::vector<int>>& sceneBlocks);
+            void createScenes(const std::vector<uint64_t>& sceneIds, const std::vector<std::vector<int>>& sceneBlocks);
+            std::string getIndexFilePath() const;
+            void computeIndexSignature(IndexSignature& signature) const;
+            bool readIndex(const std::string& indexPath, std::vector<uint64_t>& sceneIds, std::vector<std::vector<int>>& sceneBlocks);
+            void writeIndex(const std::string& indexPath, const std::vector<uint64_t>& sceneIds,
+                const std::vector<std::vector<int>>& sceneBlocks) const;
             void parseMagnification(tinyxml2::XMLNode* root);
             void parseMetadataXmL(const char* xml, size_t dataSize);
             void parseResolutions(tinyxml2::XMLNode* root);
@@ -46,7 +73,8 @@ namespace cv
         private:
             std::vector<cv::Ptr<CZIScene>> m_scenes;
             std::string m_filePath;
-            std::ifstream m_fileStream;
+            cv::Ptr<RandomAccessFile> m_file;
+            CZISubBlockTable m_blocks;
             uint64_t m_directoryPosition{};
             uint64_t m_metadataPosition{};
             // image parameters
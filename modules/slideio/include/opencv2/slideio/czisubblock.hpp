@@ -5,6 +5,8 @@
 #define OPENCV_slideio_czisubblock_HPP
 #include "opencv2/core.hpp"
 #include <cstdint>
+#include <istream>
+#include <ostream>
 #include <vector>
 #include "czistructs.hpp"
 #include "structs.hpp"
@@ -13,6 +15,8 @@ namespace cv
 {
     namespace slideio
     {
+        class CZISubBlockTable;
+        // Lightweight view of a sub-block stored in a CZISubBlockTable
         class CV_EXPORTS CZISubBlock
         {
         public:
@@ -23,75 +27,97 @@ namespace cv
                 LZW = 2,
                 JpegXR = 4
             };
-            CZISubBlock();
-            int firstChannel() const { return firstDimensionIndex(m_channelIndex);}
-            int lastChannel() const  { return lastDimensionIndex(m_channelIndex); }
-            int firstZSlice() const { return firstDimensionIndex(m_zSliceIndex); }
-            int lastZSlice() const { return lastDimensionIndex(m_zSliceIndex); }
-            int firstTFrame() const { return firstDimensionIndex(m_tFrameIndex); }
-            int lastTFrame() const { return lastDimensionIndex(m_tFrameIndex); }
-            int firstScene() const { return firstDimensionIndex(m_sceneIndex); }
-            int lastScene() const { return lastDimensionIndex(m_sceneIndex); }
-            int firstIllumination() const { return firstDimensionIndex(m_illuminationIndex); }
-            int lastIllumination() const { return lastDimensionIndex(m_illuminationIndex); }
-            int firstRotation() const { return firstDimensionIndex(m_rotationIndex); }
-            int lastRotation() const { return lastDimensionIndex(m_rotationIndex); }
-            int firstBAccusition() const { return firstDimensionIndex(m_bAccusitionIndex); }
-            int lastBAccusition() const { return lastDimensionIndex(m_bAccusitionIndex); }
-            int firstHPhase() const { return firstDimensionIndex(m_hPhaseIndex); }
-            int lastHPhase() const { return lastDimensionIndex(m_hPhaseIndex); }
-            int firstView() const { return firstDimensionIndex(m_viewIndex); }
-            int lastView() const { return lastDimensionIndex(m_viewIndex); }
-            double zoom() const { return m_zoom; }
-            const cv::Rect& rect() const { return m_rect; }
-            int cziPixelType() const { return m_cziPixelType; }
+            // non-spatial dimensions kept for each sub-block
+            enum DimensionIndex
+            {
+                DimC = 0,
+                DimZ,
+                DimT,
+                DimR,
+                DimS,
+                DimI,
+                DimB,
+                DimH,
+                DimV,
+                DimCount
+            };
+            CZISubBlock(const CZISubBlockTable& table, int index) : m_table(&table), m_index(index) {}
+            int index() const { return m_index; }
+            int firstChannel() const { return firstDimensionIndex(DimC);}
+            int lastChannel() const  { return lastDimensionIndex(DimC); }
+            int firstZSlice() const { return firstDimensionIndex(DimZ); }
+            int lastZSlice() const { return lastDimensionIndex(DimZ); }
+            int firstTFrame() const { return firstDimensionIndex(DimT); }
+            int lastTFrame() const { return lastDimensionIndex(DimT); }
+            int firstScene() const { return firstDimensionIndex(DimS); }
+            int lastScene() const { return lastDimensionIndex(DimS); }
+            int firstIllumination() const { return firstDimensionIndex(DimI); }
+            int lastIllumination() const { return lastDimensionIndex(DimI); }
+            int firstRotation() const { return firstDimensionIndex(DimR); }
+            int lastRotation() const { return lastDimensionIndex(DimR); }
+            int firstBAccusition() const { return firstDimensionIndex(DimB); }
+            int lastBAccusition() const { return lastDimensionIndex(DimB); }
+            int firstHPhase() const { return firstDimensionIndex(DimH); }
+            int lastHPhase() const { return lastDimensionIndex(DimH); }
+            int firstView() const { return firstDimensionIndex(DimV); }
+            int lastView() const { return lastDimensionIndex(DimV); }
+            double zoom() const;
+            const cv::Rect& rect() const;
+            int cziPixelType() const;
             int64_t computeDataOffset(int channel, int z, int t, int r, int s, int i, int b, int h, int v) const;
-            void setupBlock(const SubBlockHeader& subblockHeader, std::vector<DimensionEntryDV>& dimensions);
             bool isInBlock(int channel, int z, int t, int r, int s, int i, int b, int h, int v) const;
-            int pixelSize() const { return m_pixelSize; }
-            slideio::DataType dataType() const {return m_dataType;};
-            int planeSize() const {return m_planeSize;}
-            uint64_t dataPosition() const {return m_dataPosition;}
-            uint64_t dataSize() const {return m_dataSize;}
-            Compression compression() const {return static_cast<Compression>(m_compression);}
-            const std::vector<Dimension>& dimensions() const {return m_dimensions;}
+            int pixelSize() const;
+            slideio::DataType dataType() const;
+            int planeSize() const { return pixelSize() * rect().width * rect().height; }
+            uint64_t dataPosition() const;
+            uint64_t dataSize() const;
+            Compression compression() const;
         private:
-            int firstDimensionIndex(int dimension) const
-            {
-                if(dimension>=0 && dimension<static_cast<int>(m_dimensions.size()))
-                    return m_dimensions[dimension].start;
-                return 0;
-            }
-            int lastDimensionIndex(int dimension) const
-            {
-                if (dimension >= 0 && dimension < static_cast<int>(m_dimensions.size()))
-                    return  (m_dimensions[dimension].start + m_dimensions[dimension].size - 1);
-                return 0;
-            }
+            int firstDimensionIndex(int dimension) const;
+            int lastDimensionIndex(int dimension) const;
         private:
-            slideio::DataType m_dataType;
-            cv::Rect m_rect;
-            int32_t m_cziPixelType;
-            int32_t m_pixelSize;
-            int32_t m_planeSize;
-            int64_t m_filePosition;
-            int64_t m_dataPosition;
-            int64_t m_dataSize;
-            int32_t m_filePart;
-            int32_t m_compression;
-            int m_channelIndex;
-            int m_zSliceIndex;
-            int m_tFrameIndex;
-            int m_illuminationIndex;
-            int m_bAccusitionIndex;
-            int m_rotationIndex;
-            int m_sceneIndex;
-            int m_hPhaseIndex;
-            int m_viewIndex;
-            double m_zoom;
-            std::vector<Dimension> m_dimensions;
+            const CZISubBlockTable* m_table;
+            int m_index;
+        };
+
+        // Structure of arrays holding the parsed directory of a CZI file.
+        // Scenes and zoom levels reference sub-blocks by their index in the table.
+        class CV_EXPORTS CZISubBlockTable
+        {
+        public:
+            // appends the sub-block described by the header and its dimension entries
+            // and returns its index
+            int addBlock(const SubBlockHeader& subblockHeader, const std::vector<DimensionEntryDV>& dimensions);
+            int size() const { return static_cast<int>(m_rects.size()); }
+            CZISubBlock block(int index) const { return CZISubBlock(*this, index); }
+            void reserve(size_t count);
+            void shrinkToFit();
+            // binary serialization used by the directory index cache.
+            // read returns false if the stream does not contain a valid table.
+            void write(std::ostream& stream) const;
+            bool read(std::istream& stream);
+        private:
+            friend class CZISubBlock;
+            struct DimensionRange
+            {
+                int32_t start;
+                int32_t size;
+            };
+            // codes of dimensions in the storage order of a sub-block, 4 bits per dimension
+            static const int DimensionCodeBits = 4;
+            static const uint64_t DimensionCodeEnd = 0xF;
+            static const uint64_t DimensionCodeM = 0xE;
+            static const uint64_t DimensionCodeUnknown = 0xD;
+            std::vector<cv::Rect> m_rects;
+            std::vector<double> m_zooms;
+            std::vector<int64_t> m_dataPositions;
+            std::vector<int64_t> m_dataSizes;
+            std::vector<int32_t> m_pixelTypes;
+            std::vector<int32_t> m_compressions;
+            std::vector<uint64_t> m_dimensionOrders;
+            // CZISubBlock::DimCount ranges per sub-block
+            std::vector<DimensionRange> m_dimensions;
         };
-        typedef std::vector<CZISubBlock> CZISubBlocks;
     }
 }
-#endif
\ No newline at end of file
+#endif
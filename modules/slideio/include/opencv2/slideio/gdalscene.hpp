@@ -6,6 +6,7 @@
 
 #include "opencv2/slideio/scene.hpp"
 #include "opencv2/core.hpp"
+#include <mutex>
 #pragma warning( push )
 #pragma warning(disable:4005)
 #include <gdal/gdal.h>
@@ -35,6 +36,8 @@ namespace cv
         private:
             GDALDatasetH m_hFile;
             std::string m_filePath;
+            // GDAL datasets may not be read concurrently
+            std::mutex m_readMutex;
         };
     }
 }
@@ -17,15 +17,45 @@ namespace cv
     {
         class CV_EXPORTS ImageTools
         {
+        public:
+            // numThreads: number of OpenJPEG decoding threads (1 - decode in the calling thread),
+            // fusedConversion: convert, color-transform and interleave components in a single pass
+            struct Jp2KDecoderOptions
+            {
+                int numThreads{1};
+                bool fusedConversion{false};
+            };
         public:
             static int dataTypeSize(slideio::DataType dt);
             static void readGDALImage(const std::string& path, cv::OutputArray output);
             static void readJxrImage(const std::string& path, cv::OutputArray output);
+            // decodes JPEG XR stream in its native pixel format (Gray8/16, Bgr24/48, ...)
+            // straight into the output. Color images are returned in the BGR(A) order
+            // whatever the order of the stream. Memory of the output is reused if it has
+            // the size and type of the decoded image.
+            static void decodeJxrStream(const uint8_t* data, size_t size, cv::OutputArray output);
+            static void decodeJxrStream(const std::vector<uint8_t>& data, cv::OutputArray output)
+            {
+                decodeJxrStream(data.data(), data.size(), output);
+            }
             // jpeg 2000 related methods
             static void readJp2KFile(const std::string& path, cv::OutputArray output);
+            static void setJp2KDecoderOptions(const Jp2KDecoderOptions& options);
+            static Jp2KDecoderOptions getJp2KDecoderOptions();
+            // reduceFactor: number of discarded resolution levels (output is 2^reduceFactor times smaller),
+            // area: region of the full resolution image to decode (empty rectangle - whole image)
             static void decodeJp2KStream(const std::vector<uint8_t>& data, cv::OutputArray output,
                 const std::vector<int>& channelIndices = std::vector<int>(),
-                bool forceYUV = false);
+                bool forceYUV = false, int reduceFactor = 0, const cv::Rect& area = cv::Rect());
+            // jpeg related methods
+            static void decodeJpegStream(const std::vector<uint8_t>& data, cv::OutputArray output,
+                const std::vector<uint8_t>& tables = std::vector<uint8_t>(),
+                bool colorConversion = true, int scaleDenom = 1);
+            // encodes 8-bit gray or RGB raster. Large rasters are encoded in bands in parallel,
+            // each band makes a restart interval of the stream.
+            static void encodeJpegStream(const cv::Mat& raster, std::vector<uint8_t>& data, int quality = 95);
+            // encodes 8 or 16-bit raster with up to 4 channels with the GDAL PNG driver
+            static void encodePngStream(const cv::Mat& raster, std::vector<uint8_t>& data);
             static void scaleRect(const cv::Rect& srcRect, const cv::Size& newSize, cv::Rect& trgRect);
             static void scaleRect(const cv::Rect& srcRect, double scaleX, double scaleY, cv::Rect& trgRect);
         };
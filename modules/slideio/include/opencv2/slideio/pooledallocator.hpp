@@ -0,0 +1,66 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+#ifndef OPENCV_slideio_pooledallocator_HPP
+#define OPENCV_slideio_pooledallocator_HPP
+
+#include "opencv2/core.hpp"
+#include <cstdint>
+
+namespace cv
+{
+    namespace slideio
+    {
+        // Allocator of raster buffers used by the decoding and composition of tiles.
+        // Buffers are rounded up to power of two size classes and released buffers
+        // are kept in free lists of the releasing thread up to the thread capacity
+        // and the capacity of the process, which bounds the memory retained by idle threads.
+        // Buffers larger than the largest class are allocated directly.
+        class CV_EXPORTS PooledMatAllocator : public cv::MatAllocator
+        {
+        public:
+            struct Statistics
+            {
+                // requests for buffers of pooled size classes
+                uint64_t allocations{};
+                // requests served from free lists
+                uint64_t reuses{};
+                // released buffers freed because free lists were full
+                uint64_t discards{};
+                // memory kept in free lists of all threads
+                size_t cachedMemory{};
+                double reuseRate() const
+                {
+                    return allocations>0 ? static_cast<double>(reuses) / static_cast<double>(allocations) : 0.;
+                }
+            };
+        public:
+            static PooledMatAllocator& instance();
+            // returns the pool if it is enabled, nullptr (default allocator) otherwise.
+            // Assign the result to cv::Mat::allocator before creation of the matrix.
+            static cv::MatAllocator* getAllocator();
+            static void setEnabled(bool enabled);
+            static bool isEnabled();
+            // memory kept in free lists of a thread
+            void setThreadCapacity(size_t capacity);
+            size_t getThreadCapacity() const;
+            // memory kept in free lists of all threads
+            void setCapacity(size_t capacity);
+            size_t getCapacity() const;
+            Statistics getStatistics() const;
+            void resetStatistics();
+            // MatAllocator interface
+            cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+            bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+            void deallocate(cv::UMatData* data) const override;
+            static const size_t DefaultThreadCapacity = 16*1024*1024;
+            static const size_t DefaultCapacity = 64*1024*1024;
+        private:
+            PooledMatAllocator() = default;
+            PooledMatAllocator(const PooledMatAllocator&) = delete;
+            PooledMatAllocator& operator=(const PooledMatAllocator&) = delete;
+        };
+    }
+}
+#endif
@@ -0,0 +1,52 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+#ifndef OPENCV_slideio_randomaccessfile_HPP
+#define OPENCV_slideio_randomaccessfile_HPP
+
+#include "opencv2/core.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cv
+{
+    namespace slideio
+    {
+        // Read-only file with positional reads. The file has no
+        // current position, so one object can serve concurrent readers.
+        class CV_EXPORTS RandomAccessFile
+        {
+        public:
+            explicit RandomAccessFile(const std::string& filePath);
+            ~RandomAccessFile();
+            RandomAccessFile(const RandomAccessFile&) = delete;
+            RandomAccessFile& operator=(const RandomAccessFile&) = delete;
+            // reads exactly size bytes starting from the position;
+            // throws if the file is shorter
+            void read(uint64_t position, size_t size, void* buffer) const;
+            void read(uint64_t position, size_t size, std::vector<uint8_t>& data) const;
+            uint64_t getSize() const { return m_size; }
+            const std::string& getFilePath() const { return m_filePath; }
+            // maps the whole file into memory. Returns false if the file
+            // cannot be mapped (empty file, 32 bit address space).
+            // Must be called before the file is shared between threads.
+            bool map();
+            // start of the mapped file or nullptr if the file is not mapped
+            const uint8_t* getMappedData() const { return m_mappedData; }
+        private:
+            void unmap();
+        private:
+            std::string m_filePath;
+            uint64_t m_size;
+            uint8_t* m_mappedData;
+#if defined(WIN32)
+            void* m_handle;
+            void* m_mapping;
+#else
+            int m_handle;
+#endif
+        };
+    }
+}
+#endif
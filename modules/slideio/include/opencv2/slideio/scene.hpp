@@ -8,15 +8,37 @@
 #include "opencv2/core.hpp"
 #include <vector>
 #include <string>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
 
 namespace cv
 {
     namespace slideio
     {
+        // cancellation flag shared by the submitter and asynchronous reads
+        class CV_EXPORTS ReadCancellation
+        {
+        public:
+            void cancel() { m_cancelled = true; }
+            bool isCancelled() const { return m_cancelled; }
+        private:
+            std::atomic<bool> m_cancelled{false};
+        };
+
         class CV_EXPORTS_W Scene
         {
         public:
+            // receives a patch and its rectangle in the coordinates of the zoomed scene.
+            // The patch references the internal band buffer and has to be cloned
+            // to be kept after the call. Returning false stops the iteration.
+            typedef std::function<bool(const cv::Rect& patchRect, const cv::Mat& patch)> PatchVisitor;
             virtual ~Scene() = default;
+            // receives the raster of an asynchronous read or the exception thrown by the read.
+            // It is called on a worker thread and must not throw.
+            typedef std::function<void(const cv::Mat& raster, std::exception_ptr error)> ReadCallback;
             CV_WRAP virtual std::string getFilePath() const = 0;
             CV_WRAP virtual std::string getName() const = 0;
             CV_WRAP virtual cv::Rect getRect() const = 0;
@@ -29,10 +51,62 @@ namespace cv
             CV_WRAP virtual double getZSliceResolution() const {return 0;}
             CV_WRAP virtual double getTFrameResolution() const {return 0;}
             CV_WRAP virtual double getMagnification() const = 0;
+            // levels of the image pyramid starting from the scene resolution (level 0)
+            CV_WRAP virtual int getNumLevels() const { return 1; }
+            CV_WRAP virtual LevelInfo getLevelInfo(int level) const;
+            // reads a block of a pyramid level without resampling.
+            // The rectangle is in the pixel coordinates of the level, relative to the
+            // top-left corner of the scene (LevelInfo::size gives the extent).
+            CV_WRAP virtual void readLevelBlock(int level, const cv::Rect& blockRect, const std::vector<int>& channelIndices, cv::OutputArray output);
+            // native tiles of a pyramid level in the (scene-relative) pixel coordinates of the level
+            virtual int getLevelTileCount(int level) const { return 0; }
+            virtual cv::Rect getLevelTileRect(int level, int tileIndex) const;
+            // reads encoded data of a native tile (plane z=0, t=0) without decoding. Returns false
+            // if the tile cannot be passed through, e.g. uncompressed data or channels stored in separate tiles.
+            virtual bool readEncodedTile(int level, int tileIndex, EncodedTile& tile) { return false; }
             CV_WRAP virtual void readBlock(const cv::Rect& blockRect, cv::OutputArray output);
             CV_WRAP virtual void readBlockChannels(const cv::Rect& blockRect, const std::vector<int>& channelIndices, cv::OutputArray output);
             CV_WRAP virtual void readResampledBlock(const cv::Rect& blockRect, const cv::Size& blockSize, cv::OutputArray output);
             CV_WRAP virtual void readResampledBlockChannels(const cv::Rect& blockRect, const cv::Size& blockSize, const std::vector<int>& channelIndices, cv::OutputArray output) = 0;
+            // reads the resampled block composing tiles in the mode chosen for this call.
+            // Drivers without tiles resample the block at once and ignore the mode.
+            virtual void readComposedBlockChannels(const cv::Rect& blockRect, const cv::Size& blockSize,
+                const std::vector<int>& channelIndices, ComposeMode mode, cv::OutputArray output);
+            // reads a batch of blocks resampled to the same size. Empty blockSize keeps the size
+            // of each rectangle. Tiled drivers decode tiles shared by the blocks once.
+            CV_WRAP virtual void readBlocks(const std::vector<cv::Rect>& blockRects, const cv::Size& blockSize, const std::vector<int>& channelIndices, CV_OUT std::vector<cv::Mat>& outputs);
+            // reads the block into memory owned by the caller, e.g. a view of a batch buffer
+            // with an arbitrary row step. The output must have the size of the block (empty
+            // blockSize keeps the size of the rectangle) and the type of the selected channels;
+            // it is never reallocated.
+            void readBlockInto(const cv::Rect& blockRect, const cv::Size& blockSize,
+                const std::vector<int>& channelIndices, cv::Mat& output);
+            // reads the block and encodes it to Jpeg (quality 1-100) or Png (quality is ignored).
+            // Empty blockSize keeps the size of the rectangle.
+            virtual void readBlockEncoded(const cv::Rect& blockRect, const cv::Size& blockSize,
+                const std::vector<int>& channelIndices, Codec format, int quality, std::vector<uint8_t>& data);
+            // read the block of the scene on the slideio worker pool. Empty blockSize keeps
+            // the size of the rectangle. Pending reads hold the scene pointer and keep it alive.
+            // Reads cancelled before they are started, or not started before the pool
+            // is shut down, are skipped and report an exception.
+            static std::future<cv::Mat> readBlockAsync(const cv::Ptr<Scene>& scene,
+                const cv::Rect& blockRect, const cv::Size& blockSize, const std::vector<int>& channelIndices,
+                const cv::Ptr<ReadCancellation>& cancellation = cv::Ptr<ReadCancellation>());
+            static void readBlockAsync(const cv::Ptr<Scene>& scene, const cv::Rect& blockRect, const cv::Size& blockSize,
+                const std::vector<int>& channelIndices, const ReadCallback& callback,
+                const cv::Ptr<ReadCancellation>& cancellation = cv::Ptr<ReadCancellation>());
+            // walks the scene zoomed by the zoom factor row by row and passes patches
+            // of the size placed with the stride to the visitor. Only patches lying
+            // completely inside the scene are visited. The scene is read in bands of
+            // native pixels of the pyramid level selected by the zoom, aligned to rows
+            // of tiles; patches are resampled from the band. Only rows overlapped
+            // by the current row of patches are kept in memory.
+            void visitPatches(const cv::Size& patchSize, const cv::Size& stride, double zoom,
+                const std::vector<int>& channelIndices, const PatchVisitor& visitor);
+            // returns the row of the pyramid level (not less than levelRow) where a band
+            // of the level ending at levelRow may end without cutting tiles crossing levelRow.
+            // Scenes without tiles return levelRow.
+            virtual int alignBandEnd(int level, int levelRow) const { return levelRow; }
             CV_WRAP virtual void read4DBlock(const cv::Rect& blockRect, const cv::Range& zSliceRange, const cv::Range& timeFrameRange, cv::OutputArray output);
             CV_WRAP virtual void read4DBlockChannels(const cv::Rect& blockRect, const std::vector<int>& channelIndices, const cv::Range& zSliceRange, const cv::Range& timeFrameRange, cv::OutputArray output);
             CV_WRAP virtual void readResampled4DBlock(const cv::Rect& blockRect, const cv::Size& blockSize, const cv::Range& zSliceRange, const cv::Range& timeFrameRange, cv::OutputArray output);
@@ -5,6 +5,8 @@
 #define OPENCV_slideio_structs_HPP
 
 #include <opencv2/core.hpp>
+#include <cstdint>
+#include <vector>
 
 namespace cv
 {
@@ -25,6 +27,48 @@ namespace cv
             DT_None = 2048
         };
         typedef Point2d Resolution;
+        // description of a level of the image pyramid of a scene
+        struct CV_EXPORTS_W_SIMPLE LevelInfo
+        {
+            CV_PROP_RW int level{};
+            // size of the level in pixels
+            CV_PROP_RW cv::Size size;
+            // ratio of the scene size to the level size
+            CV_PROP_RW double downsample{1.};
+            // size of native tiles. Empty for levels without tiles
+            CV_PROP_RW cv::Size tileSize;
+        };
+        // composition of resampled blocks from tiles.
+        // PerTile: each tile is resampled into its part of the output.
+        // SinglePass: the region is assembled at the resolution of the tiles
+        // and resampled once, identically to a resize of the whole image.
+        enum class ComposeMode
+        {
+            PerTile,
+            SinglePass
+        };
+        // compression of encoded rasters
+        enum class Codec
+        {
+            Unknown,
+            Jpeg,
+            Jpeg2000,
+            JpegXR,
+            Png
+        };
+        // encoded data of a native tile
+        struct EncodedTile
+        {
+            Codec codec{Codec::Unknown};
+            // size of the decoded tile in pixels
+            cv::Size size;
+            int numChannels{};
+            DataType dataType{DataType::DT_Unknown};
+            // decoded components are YCbCr and need conversion to RGB
+            bool ycbcr{false};
+            // complete stream accepted by a standard decoder of the codec
+            std::vector<uint8_t> data;
+        };
     }
 }
 #endif
\ No newline at end of file
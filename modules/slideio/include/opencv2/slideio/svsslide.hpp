@@ -24,7 +24,6 @@ namespace cv
             std::string getFilePath() const override;
             cv::Ptr<slideio::Scene> getScene(int index) const override;
             static cv::Ptr<SVSSlide> openFile(const std::string& path);
-            static void closeFile(TIFF* hfile);
         private:
             std::vector<cv::Ptr<slideio::Scene>> m_Scenes;
             std::string m_filePath;
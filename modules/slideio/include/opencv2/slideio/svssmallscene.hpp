@@ -6,6 +6,7 @@
 
 #include "opencv2/slideio/svsscene.hpp"
 #include "opencv2/slideio/tifftools.hpp"
+#include "opencv2/slideio/tiffhandlepool.hpp"
 
 namespace cv
 {
@@ -18,7 +19,7 @@ namespace cv
                 const std::string& filePath,
                 const std::string& name,
                 const slideio::TiffDirectory& dir,
-                TIFF* hfile);
+                cv::Ptr<TiffHandlePool> filePool);
             cv::Rect getRect() const override;
             int getNumChannels() const override;
             slideio::DataType getChannelDataType(int channel) const override;
@@ -30,7 +31,7 @@ namespace cv
             slideio::TiffDirectory m_directory;
             slideio::DataType m_dataType;
             double m_magnification;
-            TIFF* m_hFile;
+            cv::Ptr<TiffHandlePool> m_filePool;
         };
     }
 }
@@ -6,6 +6,8 @@
 
 #include "opencv2/slideio/svsscene.hpp"
 #include "opencv2/slideio/tifftools.hpp"
+#include "opencv2/slideio/tiffhandlepool.hpp"
+#include "opencv2/slideio/randomaccessfile.hpp"
 #include "opencv2/slideio/tilecomposer.hpp"
 
 namespace cv
@@ -18,7 +20,9 @@ namespace cv
             SVSTiledScene(const std::string& filePath,
                 const std::string& name,
                 std::vector<slideio::TiffDirectory> dirs,
-                TIFF* tiff);
+                cv::Ptr<TiffHandlePool> filePool,
+                cv::Ptr<RandomAccessFile> file = cv::Ptr<RandomAccessFile>());
+            ~SVSTiledScene() override;
             int getNumChannels() const override;
             slideio::DataType getChannelDataType(int channel) const override;
             slideio::Resolution getResolution() const override;
@@ -26,17 +30,47 @@ namespace cv
             cv::Rect getRect() const override;
             void readResampledBlockChannels(const cv::Rect& blockRect, const cv::Size& blockSize, const std::vector<int>& channelIndices,
                 cv::OutputArray output) override;
+            void readComposedBlockChannels(const cv::Rect& blockRect, const cv::Size& blockSize,
+                const std::vector<int>& channelIndices, slideio::ComposeMode mode, cv::OutputArray output) override;
+            void readBlocks(const std::vector<cv::Rect>& blockRects, const cv::Size& blockSize,
+                const std::vector<int>& channelIndices, std::vector<cv::Mat>& outputs) override;
+            int alignBandEnd(int level, int levelRow) const override;
+            int getNumLevels() const override;
+            slideio::LevelInfo getLevelInfo(int level) const override;
+            void readLevelBlock(int level, const cv::Rect& blockRect, const std::vector<int>& channelIndices,
+                cv::OutputArray output) override;
             const slideio::TiffDirectory& findZoomDirectory(double zoom) const;
             // Tiler methods
             int getTileCount(void* userData) override;
             bool getTileRect(int tileIndex, cv::Rect& tileRect, void* userData) override;
             bool readTile(int tileIndex, const std::vector<int>& channelIndices, cv::OutputArray tileRaster,
                 void* userData) override;
+            bool supportsConcurrentReads(void* userData) override;
+            std::string getCacheScope(void* userData) override;
+            bool hasDisjointTiles(void* userData) override;
+            void getTilesInRect(const cv::Rect& rect, std::vector<int>& tileIndices, void* userData) override;
+            // user data of the Tiler methods
+            struct TilerData
+            {
+                const slideio::TiffDirectory* dir;
+                // tiles are decoded at 1/scaleDenom of their size
+                int scaleDenom;
+            };
+        private:
+            // selects the directory and the scale of tiles for the block
+            // and computes the block rectangle in the directory coordinates
+            void prepareBlockRead(const cv::Rect& blockRect, const cv::Size& blockSize, slideio::ComposeMode mode,
+                TilerData& tilerData, cv::Rect& resizedBlock) const;
+            const slideio::TiffDirectory& getLevelDirectory(int level) const;
+            int computeScaleDenom(const slideio::TiffDirectory& dir, double relativeZoom, slideio::ComposeMode mode) const;
         private:
             std::vector<slideio::TiffDirectory> m_directories;
             slideio::DataType m_dataType;
             double m_magnification;
-            TIFF* m_hFile;
+            cv::Ptr<TiffHandlePool> m_filePool;
+            cv::Ptr<RandomAccessFile> m_file;
+            // scope of the scene tiles in the tile cache
+            std::string m_cacheScope;
         };
     }
 }
@@ -0,0 +1,64 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+#ifndef OPENCV_slideio_tiffhandlepool_HPP
+#define OPENCV_slideio_tiffhandlepool_HPP
+
+#include "opencv2/core.hpp"
+#include <string>
+#include <vector>
+#include <mutex>
+
+struct tiff;
+typedef tiff TIFF;
+
+namespace cv
+{
+    namespace slideio
+    {
+        // Pool of libtiff handles opened for the same file.
+        // A libtiff handle keeps the current directory as its state,
+        // so it cannot be shared between threads. Each read operation leases
+        // a handle for its duration; the handle returns to the pool
+        // when the lease is destroyed. Switching of directories reloads
+        // their tags, so handles positioned on the requested directory are preferred.
+        class CV_EXPORTS TiffHandlePool
+        {
+        public:
+            class CV_EXPORTS Lease
+            {
+            public:
+                Lease(TiffHandlePool* pool, TIFF* handle) : m_pool(pool), m_handle(handle) {}
+                Lease(Lease&& other) noexcept : m_pool(other.m_pool), m_handle(other.m_handle) {
+                    other.m_handle = nullptr;
+                }
+                Lease(const Lease&) = delete;
+                Lease& operator=(const Lease&) = delete;
+                ~Lease();
+                TIFF* handle() const { return m_handle; }
+                operator TIFF*() const { return m_handle; }
+            private:
+                TiffHandlePool* m_pool;
+                TIFF* m_handle;
+            };
+        public:
+            // the pool takes ownership of the already opened handle.
+            // maxIdleHandles: number of handles kept open between reads,
+            // 0 for the number of CPUs. Handles released above it are closed.
+            TiffHandlePool(const std::string& filePath, TIFF* handle = nullptr, int maxIdleHandles = 0);
+            ~TiffHandlePool();
+            // ifdOffset: file offset of the directory the handle is used for, 0 for any
+            Lease lease(int64 ifdOffset = 0);
+            const std::string& getFilePath() const { return m_filePath; }
+            int getIdleHandleCount() const;
+        private:
+            void release(TIFF* handle);
+        private:
+            std::string m_filePath;
+            mutable std::mutex m_mutex;
+            std::vector<TIFF*> m_idleHandles;
+            size_t m_maxIdleHandles;
+        };
+    }
+}
+#endif
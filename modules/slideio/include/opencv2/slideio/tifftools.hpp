@@ -6,6 +6,7 @@
 
 #include "opencv2/slideio/structs.hpp"
 #include "opencv2/core.hpp"
+#include "opencv2/slideio/randomaccessfile.hpp"
 
 #include <string>
 #include <vector>
@@ -27,8 +28,12 @@ namespace cv
             int channels;
             int bitsPerSample;
             uint32_t compression;
+            int photometric;
             int dirIndex;
+            // offset of a sub-directory, 0 for directories of the main chain
             int64 offset;
+            // file offset of the directory, used to switch to it without walking the chain
+            int64 ifdOffset{0};
             std::string description;
             std::vector<TiffDirectory> subdirectories;
             Resolution res;
@@ -37,6 +42,11 @@ namespace cv
             int rowsPerStrip;
             DataType dataType;
             int stripSize;
+            // tile layout captured by scanning, used for reading
+            // of tiles without libtiff
+            std::vector<uint64_t> tileOffsets;
+            std::vector<uint64_t> tileByteCounts;
+            std::vector<uint8_t> jpegTables;
         };
         class CV_EXPORTS  TiffTools
         {
@@ -55,6 +65,19 @@ namespace cv
                 const std::vector<int>& channelIndices, cv::OutputArray output);
             static void readRegularTile(TIFF* hFile, const slideio::TiffDirectory& dir, int tile,
                 const std::vector<int>& channelIndices, cv::OutputArray output);
+            // positional reading of tiles, independent of libtiff directory state
+            static bool canReadTileDirectly(const slideio::TiffDirectory& dir);
+            static void readRawTile(const RandomAccessFile& file, const slideio::TiffDirectory& dir, int tile,
+                std::vector<uint8_t>& data);
+            // scaleDenom (1, 2, 4 or 8) reduces the size of the decoded tile
+            static void readTile(const RandomAccessFile& file, const slideio::TiffDirectory& dir, int tile,
+                const std::vector<int>& channelIndices, cv::OutputArray output, int scaleDenom = 1);
+            static bool canDecodeTileScaled(const slideio::TiffDirectory& dir);
+            // reads the tile as a stream decodable without the tiff directory.
+            // Abbreviated JPEG tiles are completed with the tables of the directory.
+            // Returns false if the tile cannot be read directly.
+            static bool readEncodedTile(const RandomAccessFile& file, const slideio::TiffDirectory& dir, int tile,
+                EncodedTile& encodedTile);
         };
     }
 }
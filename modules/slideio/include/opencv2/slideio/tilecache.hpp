@@ -0,0 +1,68 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+#ifndef OPENCV_slideio_tilecache_HPP
+#define OPENCV_slideio_tilecache_HPP
+
+#include "opencv2/core.hpp"
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cv
+{
+    namespace slideio
+    {
+        // Process-wide cache of decoded tiles shared by all scenes.
+        // Tiles are evicted in least recently used order when the total
+        // size of cached rasters exceeds the memory budget.
+        // Cached rasters are shared with the callers and must not be modified.
+        class CV_EXPORTS TileCache
+        {
+        public:
+            struct Statistics
+            {
+                uint64_t hits{};
+                uint64_t misses{};
+                uint64_t evictions{};
+                size_t tileCount{};
+                size_t memoryUsage{};
+            };
+        public:
+            static TileCache& instance();
+            // memory budget in bytes. Zero disables caching.
+            void setCapacity(size_t capacity);
+            size_t getCapacity() const;
+            bool get(const std::string& key, cv::Mat& tile);
+            void put(const std::string& key, const cv::Mat& tile);
+            void clear();
+            // removes the tiles of the scope and of all scopes extending it
+            void removeScope(const std::string& scope);
+            Statistics getStatistics() const;
+            void resetStatistics();
+            // returns a scope unique for each opened file. Tiles of a file reopened
+            // after it has been rewritten at the same path are never mixed up.
+            static std::string makeScope(const std::string& filePath);
+            static std::string makeKey(const std::string& scope, int tileIndex, const std::vector<int>& channelIndices);
+            static const size_t DefaultCapacity = 128*1024*1024;
+        private:
+            TileCache();
+            TileCache(const TileCache&) = delete;
+            TileCache& operator=(const TileCache&) = delete;
+            void evict(size_t capacity);
+        private:
+            typedef std::pair<std::string, cv::Mat> Entry;
+            typedef std::list<Entry> Entries;
+            mutable std::mutex m_mutex;
+            // most recently used tiles are at the front
+            Entries m_entries;
+            std::unordered_map<std::string, Entries::iterator> m_index;
+            size_t m_capacity;
+            Statistics m_statistics;
+        };
+    }
+}
+#endif
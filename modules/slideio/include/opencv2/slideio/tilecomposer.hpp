@@ -5,6 +5,9 @@
 #define OPENCV_slideio_tilecomposer_HPP
 
 #include <opencv2/core.hpp>
+#include "opencv2/slideio/structs.hpp"
+#include <string>
+#include <vector>
 
 namespace cv
 {
@@ -16,12 +19,45 @@ namespace cv
             virtual int getTileCount(void* userData) = 0;
             virtual bool getTileRect(int tileIndex, cv::Rect& tileRect, void* userData) = 0;
             virtual bool readTile(int tileIndex, const std::vector<int>& channelIndices, cv::OutputArray tileRaster, void* userData) = 0;
+            // returns true if readTile may be called concurrently from several threads
+            virtual bool supportsConcurrentReads(void* userData) { return false; }
+            // returns a string identifying the tile set (file, level, plane)
+            // in the process-wide tile cache. Empty string disables caching.
+            virtual std::string getCacheScope(void* userData) { return std::string(); }
+            // returns true if tiles never overlap, e.g. tiles of a regular grid.
+            // Parts of the output covered by such tiles are not checked for overlaps.
+            virtual bool hasDisjointTiles(void* userData) { return false; }
+            // returns indices of tiles intersecting the rectangle in ascending order.
+            // Default implementation scans all tiles, tilers with
+            // a spatial layout should override it.
+            virtual void getTilesInRect(const cv::Rect& rect, std::vector<int>& tileIndices, void* userData)
+            {
+                tileIndices.clear();
+                const int tileCount = getTileCount(userData);
+                for(int tileIndex = 0; tileIndex < tileCount; tileIndex++)
+                {
+                    cv::Rect tileRect;
+                    if(getTileRect(tileIndex, tileRect, userData) && (tileRect & rect).area() > 0)
+                    {
+                        tileIndices.push_back(tileIndex);
+                    }
+                }
+            }
         };
         class CV_EXPORTS TileComposer
         {
         public:
+            typedef slideio::ComposeMode ComposeMode;
             static void composeRect(Tiler* tiler, const std::vector<int>& channelIndices,
-                const cv::Rect& blockRect, const cv::Size& blockSize, cv::OutputArray output, void* userData = nullptr);
+                const cv::Rect& blockRect, const cv::Size& blockSize, cv::OutputArray output, void* userData = nullptr,
+                ComposeMode mode = ComposeMode::PerTile);
+            // composes a batch of blocks of the same tile set. Each tile intersecting
+            // any of the rectangles is read once and placed into all blocks covering it.
+            // Blocks are composed in the spatial order, a tile is kept only until
+            // the last block covering it is composed.
+            static void composeRects(Tiler* tiler, const std::vector<int>& channelIndices,
+                const std::vector<cv::Rect>& blockRects, const std::vector<cv::Size>& blockSizes,
+                std::vector<cv::Mat>& outputs, void* userData = nullptr, ComposeMode mode = ComposeMode::PerTile);
         };
     }
 }
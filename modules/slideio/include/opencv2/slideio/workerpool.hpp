@@ -0,0 +1,62 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+#ifndef OPENCV_slideio_workerpool_HPP
+#define OPENCV_slideio_workerpool_HPP
+
+#include "opencv2/core.hpp"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cv
+{
+    namespace slideio
+    {
+        // Process-wide pool of threads executing asynchronous requests.
+        // Tasks are started in the order of submission and may complete in any order.
+        // Threads are created by the first submission. Tasks not started
+        // before the pool is shut down are aborted with an exception.
+        class CV_EXPORTS WorkerPool
+        {
+        public:
+            typedef std::function<void()> Task;
+            // receives the reason why the task is never executed
+            typedef std::function<void(std::exception_ptr error)> AbortHandler;
+        public:
+            static WorkerPool& instance();
+            // number of threads. Zero selects the number of hardware threads.
+            // Running tasks are completed, queued tasks are kept for the new threads.
+            // Throws if called from a task of the pool.
+            void setNumThreads(int numThreads);
+            int getNumThreads() const;
+            void submit(Task task, AbortHandler onAbort = AbortHandler());
+            // number of tasks waiting for a thread
+            size_t getQueueSize() const;
+        private:
+            WorkerPool();
+            ~WorkerPool();
+            WorkerPool(const WorkerPool&) = delete;
+            WorkerPool& operator=(const WorkerPool&) = delete;
+            void start();
+            void stop();
+            void run();
+            static void abort(const AbortHandler& onAbort);
+        private:
+            typedef std::pair<Task, AbortHandler> Entry;
+            mutable std::mutex m_mutex;
+            std::condition_variable m_condition;
+            std::deque<Entry> m_tasks;
+            std::vector<std::thread> m_threads;
+            int m_numThreads;
+            bool m_stopping;
+            // set by the destruction of the pool
+            bool m_shutdown;
+        };
+    }
+}
+#endif
@@ -8,7 +8,12 @@
 #include "opencv2/slideio/tilecomposer.hpp"
 #include "opencv2/slideio/tools.hpp"
 #include "opencv2/slideio/imagetools.hpp"
+#include "opencv2/slideio/pooledallocator.hpp"
+#include "opencv2/slideio/tilecache.hpp"
+#include "opencv2/core/utility.hpp"
 #include <set>
+#include <unordered_map>
+#include <algorithm>
 
 using namespace cv::slideio;
 const double DOUBLE_EPSILON = 1.e-4;
@@ -27,6 +32,15 @@ CZIScene::CZIScene() : m_slide(nullptr), m_numZSlices(1), m_numTFrames(1)
 {
 }
 
+CZIScene::~CZIScene()
+{
+    // cached tiles of the scene cannot be requested anymore
+    if(!m_cacheScope.empty())
+    {
+        TileCache::instance().removeScope(m_cacheScope);
+    }
+}
+
 std::string CZIScene::getFilePath() const
 {
     return m_filePath;
@@ -95,21 +109,278 @@ double CZIScene::getMagnification() const
 void CZIScene::readResampledBlockChannels(const cv::Rect& blockRect, const cv::Size& blockSize,
     const std::vector<int>& componentIndices, cv::OutputArray output)
 {
+    readComposedBlockChannels(blockRect, blockSize, componentIndices, ComposeMode::PerTile, output);
+}
+
+void CZIScene::readComposedBlockChannels(const cv::Rect& blockRect, const cv::Size& blockSize,
+    const std::vector<int>& componentIndices, ComposeMode mode, cv::OutputArray output)
+{
+    TilerData userData;
+    cv::Rect zoomLevelRect;
+    prepareBlockRead(blockRect, blockSize, userData, zoomLevelRect);
+    TileComposer::composeRect(this, componentIndices, zoomLevelRect, blockSize, output, &userData, mode);
+}
+
+void CZIScene::readBlocks(const std::vector<cv::Rect>& blockRects, const cv::Size& blockSize,
+    const std::vector<int>& componentIndices, std::vector<cv::Mat>& outputs)
+{
+    // blocks read from the same zoom level share tiles
+    struct Batch
+    {
+        TilerData tilerData;
+        std::vector<int> blocks;
+        std::vector<cv::Rect> rects;
+        std::vector<cv::Size> sizes;
+    };
+    std::map<int, Batch> batches;
+    for(int block = 0; block < static_cast<int>(blockRects.size()); ++block)
+    {
+        const cv::Rect& blockRect = blockRects[block];
+        const cv::Size size = blockSize.area()>0 ? blockSize : blockRect.size();
+        TilerData userData;
+        cv::Rect zoomLevelRect;
+        prepareBlockRead(blockRect, size, userData, zoomLevelRect);
+        Batch& batch = batches[userData.zoomLevelIndex];
+        batch.tilerData = userData;
+        batch.blocks.push_back(block);
+        batch.rects.push_back(zoomLevelRect);
+        batch.sizes.push_back(size);
+    }
+    outputs.resize(blockRects.size());
+    std::vector<cv::Mat> batchOutputs;
+    for(auto& item : batches)
+    {
+        Batch& batch = item.second;
+        TileComposer::composeRects(this, componentIndices, batch.rects, batch.sizes, batchOutputs, &batch.tilerData);
+        for(size_t index = 0; index < batch.blocks.size(); ++index)
+        {
+            outputs[batch.blocks[index]] = batchOutputs[index];
+        }
+    }
+}
+
+void CZIScene::readResampled4DBlockChannels(const cv::Rect& blockRect, const cv::Size& blockSize,
+    const std::vector<int>& componentIndices, const cv::Range& zSliceRange, const cv::Range& timeFrameRange,
+    cv::OutputArray output)
+{
+    const cv::Range zRange = zSliceRange.empty() ? cv::Range(zSliceRange.start, zSliceRange.start + 1) : zSliceRange;
+    const cv::Range tRange = timeFrameRange.empty() ? cv::Range(timeFrameRange.start, timeFrameRange.start + 1) : timeFrameRange;
+    if(zRange.start<0 || zRange.end>m_numZSlices || tRange.start<0 || tRange.end>m_numTFrames)
+    {
+        throw std::runtime_error(
+            (boost::format("CZIImageDriver: Invalid 4D range Z:(%1%-%2%) Time:(%3%-%4%) of scene %5%")
+                % zRange.start % zRange.end % tRange.start % tRange.end % m_name).str());
+    }
+    const std::vector<int> components = Tools::completeChannelList(componentIndices, getNumChannels());
+    TilerData tilerData;
+    cv::Rect zoomLevelRect;
+    prepareBlockRead(blockRect, blockSize, tilerData, zoomLevelRect);
+    const int numZSlices = zRange.size();
+    const int numTFrames = tRange.size();
+    TilerData planeData = tilerData;
+    if(numZSlices * numTFrames == 1)
+    {
+        // a single plane shares no sub-blocks with other planes:
+        // its tiles are read one by one through the tile cache
+        planeData.zSliceIndex = zRange.start;
+        planeData.tFrameIndex = tRange.start;
+        TileComposer::composeRect(this, components, zoomLevelRect, blockSize, output, &planeData);
+        return;
+    }
+    std::vector<int> tileIndices;
+    getTilesInRect(zoomLevelRect, tileIndices, &tilerData);
+    std::vector<std::map<int, cv::Mat>> planeTiles(numZSlices * numTFrames);
+    stagePlaneTiles(tileIndices, components, zRange, tRange, tilerData, planeTiles);
+    const int type = CV_MAKETYPE(static_cast<int>(getChannelDataType(components[0])), static_cast<int>(components.size()));
+    const int sizes[] = { numTFrames, numZSlices, blockSize.height, blockSize.width };
+    output.create(4, sizes, type);
+    cv::Mat raster = output.getMat();
+    for(int tFrame = 0; tFrame < numTFrames; ++tFrame)
+    {
+        for(int zSlice = 0; zSlice < numZSlices; ++zSlice)
+        {
+            // planes are composed in place
+            const int plane = tFrame * numZSlices + zSlice;
+            planeData.zSliceIndex = zRange.start + zSlice;
+            planeData.tFrameIndex = tRange.start + tFrame;
+            planeData.stagedTiles = &planeTiles[plane];
+            cv::Mat planeRaster(blockSize, type, raster.ptr(tFrame, zSlice));
+            TileComposer::composeRect(this, components, zoomLevelRect, blockSize, planeRaster, &planeData);
+        }
+    }
+}
+
+int CZIScene::alignBandEnd(int level, int levelRow) const
+{
+    if(level<0 || level>=getNumLevels())
+    {
+        throw std::runtime_error(
+            (boost::format("CZIImageDriver: Invalid level index: %1%") % level).str());
+    }
+    const ZoomLevel& zoomLevel = m_zoomLevels[level];
+    const TileGrid& grid = zoomLevel.grid;
+    const int originY = getLevelOrigin(level).y;
+    const int levelEnd = levelRow + originY;
+    if(grid.cells.empty() || levelEnd <= grid.rect.y || levelEnd >= grid.rect.y + grid.rect.height)
+        return levelRow;
+    // sub-blocks of mosaics are not aligned: extend the band to the bottom of the tiles
+    // crossing its end, by one tile height at most. Tiles crossing the extended end
+    // overlap the next band and are not chased, the band keeps its height bounded.
+    const int limit = levelEnd + grid.cellSize.height;
+    const int row = (levelEnd - grid.rect.y) / grid.cellSize.height;
+    int tileBottom = levelEnd;
+    for(int col = 0; col < grid.cols; ++col)
+    {
+        for(const int tileIndex : grid.cells[row * grid.cols + col])
+        {
+            const cv::Rect& tileRect = zoomLevel.tiles[tileIndex].rect;
+            if(tileRect.y < levelEnd && tileRect.y + tileRect.height > levelEnd)
+            {
+                tileBottom = std::max(tileBottom, std::min(tileRect.y + tileRect.height, limit));
+            }
+        }
+    }
+    return tileBottom - originY;
+}
+
+int CZIScene::getNumLevels() const
+{
+    return static_cast<int>(m_zoomLevels.size());
+}
+
+LevelInfo CZIScene::getLevelInfo(int level) const
+{
+    if(level<0 || level>=getNumLevels())
+    {
+        throw std::runtime_error(
+            (boost::format("CZIImageDriver: Invalid level index: %1%") % level).str());
+    }
+    const ZoomLevel& zoomLevel = m_zoomLevels[level];
+    cv::Rect levelRect;
+    ImageTools::scaleRect(m_sceneRect, zoomLevel.zoom, zoomLevel.zoom, levelRect);
+    LevelInfo info;
+    info.level = level;
+    info.size = levelRect.size();
+    info.downsample = 1. / zoomLevel.zoom;
+    // sub-blocks of mosaics may differ in size: report the largest one
+    info.tileSize = zoomLevel.grid.cellSize;
+    return info;
+}
+
+void CZIScene::readLevelBlock(int level, const cv::Rect& blockRect, const std::vector<int>& componentIndices,
+    cv::OutputArray output)
+{
+    if(level<0 || level>=getNumLevels())
+    {
+        throw std::runtime_error(
+            (boost::format("CZIImageDriver: Invalid level index: %1%") % level).str());
+    }
     TilerData userData;
+    userData.zoomLevelIndex = level;
+    userData.relativeZoom = 1.;
+    userData.zSliceIndex = 0;
+    userData.tFrameIndex = 0;
+    // tiles are placed in the mosaic coordinates of the level
+    const cv::Rect mosaicRect = blockRect + getLevelOrigin(level);
+    TileComposer::composeRect(this, componentIndices, mosaicRect, blockRect.size(), output, &userData);
+}
+
+int CZIScene::getLevelTileCount(int level) const
+{
+    if(level<0 || level>=getNumLevels())
+    {
+        throw std::runtime_error(
+            (boost::format("CZIImageDriver: Invalid level index: %1%") % level).str());
+    }
+    return static_cast<int>(m_zoomLevels[level].tiles.size());
+}
+
+cv::Rect CZIScene::getLevelTileRect(int level, int tileIndex) const
+{
+    if(tileIndex<0 || tileIndex>=getLevelTileCount(level))
+    {
+        throw std::runtime_error(
+            (boost::format("CZIImageDriver: Invalid tile index %1% of level %2%") % tileIndex % level).str());
+    }
+    return m_zoomLevels[level].tiles[tileIndex].rect - getLevelOrigin(level);
+}
+
+cv::Point CZIScene::getLevelOrigin(int level) const
+{
+    const double zoom = m_zoomLevels[level].zoom;
+    cv::Rect levelRect;
+    ImageTools::scaleRect(m_sceneRect, zoom, zoom, levelRect);
+    return levelRect.tl();
+}
+
+bool CZIScene::readEncodedTile(int level, int tileIndex, EncodedTile& encodedTile)
+{
+    const cv::Rect tileRect = getLevelTileRect(level, tileIndex);
+    // a tile is passed through if a single compressed sub-block keeps all components
+    if(m_channelInfos.size()!=1)
+        return false;
+    TilerData tilerData;
+    tilerData.zoomLevelIndex = level;
+    tilerData.zSliceIndex = 0;
+    tilerData.tFrameIndex = 0;
+    tilerData.relativeZoom = 1.;
+    const std::vector<int> componentIndices = Tools::completeChannelList(std::vector<int>(), getNumChannels());
+    const CZISubBlockTable& blockTable = getBlockTable();
+    int blockIndex = -1;
+    for(const int index : m_zoomLevels[level].tiles[tileIndex].blockIndices)
+    {
+        if(blockHasData(blockTable.block(index), componentIndices, &tilerData))
+        {
+            if(blockIndex>=0)
+                return false;
+            blockIndex = index;
+        }
+    }
+    if(blockIndex<0)
+        return false;
+    const CZISubBlock block = blockTable.block(blockIndex);
+    switch(block.compression())
+    {
+    case CZISubBlock::Jpeg:
+        encodedTile.codec = Codec::Jpeg;
+        break;
+    case CZISubBlock::JpegXR:
+        encodedTile.codec = Codec::JpegXR;
+        break;
+    default:
+        return false;
+    }
+    encodedTile.size = tileRect.size();
+    encodedTile.numChannels = getNumChannels();
+    encodedTile.dataType = getChannelDataType(0);
+    encodedTile.ycbcr = false;
+    const uint8_t* blockData = m_slide->getMappedBlock(block.dataPosition(), block.dataSize());
+    if(blockData!=nullptr)
+    {
+        encodedTile.data.assign(blockData, blockData + block.dataSize());
+    }
+    else
+    {
+        m_slide->readBlock(block.dataPosition(), block.dataSize(), encodedTile.data);
+    }
+    return true;
+}
+
+void CZIScene::prepareBlockRead(const cv::Rect& blockRect, const cv::Size& blockSize, TilerData& userData,
+    cv::Rect& zoomLevelRect) const
+{
     const double zoomX = static_cast<double>(blockSize.width) / static_cast<double>(blockRect.width);
-    const double zoomY = static_cast<double>(blockSize.height) / static_cast<double>(blockRect.width);
+    const double zoomY = static_cast<double>(blockSize.height) / static_cast<double>(blockRect.height);
     const double zoom = std::max(zoomX, zoomY);
     const std::vector<ZoomLevel>& zoomLevels = m_zoomLevels;
     userData.zoomLevelIndex = Tools::findZoomLevel(zoom, static_cast<int>(m_zoomLevels.size()), [&zoomLevels](int index){
         return zoomLevels[index].zoom;
     });
     const double levelZoom = zoomLevels[userData.zoomLevelIndex].zoom;
-    cv::Rect zoomLevelRect;
     ImageTools::scaleRect(blockRect, levelZoom, levelZoom, zoomLevelRect);
     userData.relativeZoom = levelZoom / zoom;
     userData.zSliceIndex = 0;
     userData.tFrameIndex = 0;
-    TileComposer::composeRect(this, componentIndices, zoomLevelRect, blockSize, output, &userData);
 }
 
 std::string CZIScene::getName() const
@@ -135,11 +406,11 @@ void CZIScene::computeSceneRect()
     const CZIScene::ZoomLevel& zoomLevelMax = CZIScene::getBaseZoomLevel();
     m_sceneRect = { 0,0,0,0 };
     const Tiles& tiles = zoomLevelMax.tiles;
-    const CZISubBlocks& tileBlocks = zoomLevelMax.blocks;
+    const CZISubBlockTable& blockTable = getBlockTable();
     for(size_t index = 0; index<tiles.size(); index++)
     {
         int blockIndex = tiles[index].blockIndices[0];
-        const CZISubBlock& block = tileBlocks[blockIndex];
+        const CZISubBlock block = blockTable.block(blockIndex);
         const cv::Rect& tileRect = block.rect();
         m_sceneRect |= tileRect;
     }
@@ -150,18 +421,20 @@ void CZIScene::computeSceneTiles()
     // combine zoom level blocks in tiles
     for(auto& zoomLevel: m_zoomLevels)
     {
-        combineBlockInTiles(zoomLevel);
+        combineBlockInTiles(zoomLevel, getBlockTable());
+        buildTileGrid(zoomLevel);
     }
 }
 
 void CZIScene::compute4DParameters()
 {
     const CZIScene::ZoomLevel& zoomLevelMax = CZIScene::getBaseZoomLevel();
-    auto blocks = zoomLevelMax.blocks;
+    const std::vector<int>& blocks = zoomLevelMax.blocks;
+    const CZISubBlockTable& blockTable = getBlockTable();
     int firstZSlice(0), lastZSlice(0), firstTFrame(0), lastTFrame(0);
     for(size_t blockIndex=0; blockIndex<blocks.size(); ++blockIndex)
     {
-        const slideio::CZISubBlock& block = blocks[blockIndex];
+        const slideio::CZISubBlock block = blockTable.block(blocks[blockIndex]);
         if(blockIndex==0)
         {
             firstTFrame = block.firstTFrame();
@@ -200,17 +473,20 @@ const CZIScene::ZoomLevel& CZIScene::getBaseZoomLevel() const
 }
 
 
-void CZIScene::init(uint64_t sceneId, SceneParams& sceneParams, const std::string& filePath, const CZISubBlocks& blocks, CZISlide* slide)
+void CZIScene::init(uint64_t sceneId, SceneParams& sceneParams, const std::string& filePath, const std::vector<int>& blockIndices, CZISlide* slide)
 {
     m_sceneParams = sceneParams;
     m_slide = slide;
     m_id = sceneId;
     // separate blocks by zoom levels and detect count of channels and channel data type
     m_filePath = filePath;
+    m_cacheScope = TileCache::makeScope(filePath) + "|" + std::to_string(m_id);
     std::map<double, int, double_less> zoomLevelIndices;
     std::map<int, int> channelPixelType;
-    for(const auto& block : blocks)
+    const CZISubBlockTable& blockTable = getBlockTable();
+    for(const int blockIndex : blockIndices)
     {
+        const CZISubBlock block = blockTable.block(blockIndex);
         double zoom = block.zoom();
         int zoomLevelIndex = 0;
         auto itIndex = zoomLevelIndices.find(zoom);
@@ -221,11 +497,15 @@ void CZIScene::init(uint64_t sceneId, SceneParams& sceneParams, const std::strin
             m_zoomLevels.emplace_back();
             m_zoomLevels.back().zoom = zoom;
         }
+        else
+        {
+            zoomLevelIndex = itIndex->second;
+        }
         for(int channelIndex=block.firstChannel(); channelIndex<=block.lastChannel(); channelIndex++)
         {
             channelPixelType[channelIndex] = block.cziPixelType();
         }
-        m_zoomLevels[zoomLevelIndex].blocks.push_back(block);
+        m_zoomLevels[zoomLevelIndex].blocks.push_back(blockIndex);
     }
     setupComponents(channelPixelType);
     // sort zoom levels in ascending order
@@ -252,27 +532,70 @@ bool CZIScene::getTileRect(int tileIndex, cv::Rect& tileRect, void* userData)
     auto tilerData = reinterpret_cast<TilerData*>(userData);
     const int zoomLevelIndex = tilerData->zoomLevelIndex;
     const ZoomLevel& zoomLevel = m_zoomLevels[zoomLevelIndex];
-    const Tiles& tiles = zoomLevel.tiles;
-    const int firstBlockIndex = tiles[tileIndex].blockIndices[0];
-    const CZISubBlock& firstBlock = zoomLevel.blocks[firstBlockIndex];
-    tileRect = firstBlock.rect();
-    tileRect.x = static_cast<int>(std::ceil(static_cast<double>(tileRect.x)* zoomLevel.zoom));
-    tileRect.y = static_cast<int>(std::ceil(static_cast<double>(tileRect.y)* zoomLevel.zoom));
+    tileRect = zoomLevel.tiles[tileIndex].rect;
     return true;
 }
 
+void CZIScene::getTilesInRect(const cv::Rect& rect, std::vector<int>& tileIndices, void* userData)
+{
+    auto tilerData = reinterpret_cast<TilerData*>(userData);
+    const ZoomLevel& zoomLevel = m_zoomLevels[tilerData->zoomLevelIndex];
+    const TileGrid& grid = zoomLevel.grid;
+    tileIndices.clear();
+    const cv::Rect coveredRect = rect & grid.rect;
+    if(coveredRect.area() <= 0)
+        return;
+    const int firstCol = (coveredRect.x - grid.rect.x) / grid.cellSize.width;
+    const int firstRow = (coveredRect.y - grid.rect.y) / grid.cellSize.height;
+    const int lastCol = (coveredRect.x + coveredRect.width - 1 - grid.rect.x) / grid.cellSize.width;
+    const int lastRow = (coveredRect.y + coveredRect.height - 1 - grid.rect.y) / grid.cellSize.height;
+    for(int row = firstRow; row <= lastRow; ++row)
+    {
+        for(int col = firstCol; col <= lastCol; ++col)
+        {
+            for(const int tileIndex : grid.cells[row * grid.cols + col])
+            {
+                if((zoomLevel.tiles[tileIndex].rect & rect).area() > 0)
+                {
+                    tileIndices.push_back(tileIndex);
+                }
+            }
+        }
+    }
+    // a tile may be registered in several grid cells
+    std::sort(tileIndices.begin(), tileIndices.end());
+    tileIndices.erase(std::unique(tileIndices.begin(), tileIndices.end()), tileIndices.end());
+}
+
+std::string CZIScene::getCacheScope(void* userData)
+{
+    const TilerData* tilerData = reinterpret_cast<TilerData*>(userData);
+    if(tilerData->stagedTiles!=nullptr)
+        return std::string();
+    return m_cacheScope
+        + "|" + std::to_string(tilerData->zoomLevelIndex)
+        + "|" + std::to_string(tilerData->zSliceIndex)
+        + "|" + std::to_string(tilerData->tFrameIndex);
+}
+
+bool CZIScene::supportsConcurrentReads(void*)
+{
+    // sub-blocks are fetched by positional reads of the slide file
+    return true;
+}
 
-int CZIScene::findBlockIndex(const Tile& tile, const CZISubBlocks& blocks, int channelIndex, int zSliceIndex, int tFrameIndex) const
+int CZIScene::findBlockIndex(const Tile& tile, int channelIndex, int zSliceIndex, int tFrameIndex) const
 {
+    const CZISubBlockTable& blockTable = getBlockTable();
     for(const auto& blockIndex : tile.blockIndices)
     {
-        const CZISubBlock& block = blocks[blockIndex];
+        const CZISubBlock block = blockTable.block(blockIndex);
         if( channelIndex >= block.firstChannel() &&
             channelIndex <= block.lastChannel() && 
             zSliceIndex >= block.firstZSlice() &&
             zSliceIndex <= block.lastZSlice() &&
-            tFrameIndex <= block.firstTFrame() &&
-            tFrameIndex >= block.lastTFrame())
+            tFrameIndex >= block.firstTFrame() &&
+            tFrameIndex <= block.lastTFrame())
         {
             // block found
             return blockIndex;
@@ -296,11 +619,9 @@ const CZIScene::Tile& CZIScene::getTile(const TilerData* tilerData, int tileInde
     return tile;
 }
 
-const CZISubBlocks& CZIScene::getBlocks(const TilerData* tilerData) const
+const CZISubBlockTable& CZIScene::getBlockTable() const
 {
-    const int zoomLevelIndex = tilerData->zoomLevelIndex;
-    const ZoomLevel& zoomLevel = m_zoomLevels[zoomLevelIndex];
-    return zoomLevel.blocks;
+    return m_slide->getBlockTable();
 }
 
 
@@ -308,7 +629,7 @@ bool CZIScene::blockHasData(const CZISubBlock& block, const std::vector<int>& co
 {
     for(int component : componentIndices)
     {
-        const int channel = m_componentToChannelIndex[component].first;
+        const int channel = m_componentToChannelIndex.at(component).first;
         if(block.isInBlock(channel,
             tilerData->zSliceIndex,
             tilerData->tFrameIndex,
@@ -325,25 +646,44 @@ bool CZIScene::blockHasData(const CZISubBlock& block, const std::vector<int>& co
     return false;
 }
 
-std::vector<uint8_t> CZIScene::decodeData(const CZISubBlock& block, const std::vector<unsigned char>& encodedData)
+void CZIScene::decodeData(const CZISubBlock& block, const uint8_t* encodedData, size_t encodedSize,
+    std::vector<uint8_t>& decodedData)
 {
-    if(block.compression()==CZISubBlock::Uncompressed)
+    if(block.compression()==CZISubBlock::JpegXR)
     {
-        return encodedData;
+        // decode straight into the plane buffer
+        int numComponents(0), pixelSize(0);
+        DataType componentType;
+        channelComponentInfo(static_cast<CZIDataType>(block.cziPixelType()), componentType, numComponents, pixelSize);
+        decodedData.resize(block.planeSize());
+        cv::Mat plane(block.rect().size(), CV_MAKETYPE(static_cast<int>(componentType), numComponents), decodedData.data());
+        cv::Mat decoded = plane;
+        ImageTools::decodeJxrStream(encodedData, encodedSize, decoded);
+        if(decoded.data!=plane.data)
+        {
+            if(decoded.size()!=plane.size() || decoded.type()!=plane.type())
+            {
+                throw std::runtime_error(
+                    (boost::format("CZIImageDriver: unexpected JpegXR sub-block raster %1%x%2% type %3%")
+                        % decoded.cols % decoded.rows % decoded.type()).str());
+            }
+            decoded.copyTo(plane);
+        }
+        return;
     }
     throw std::runtime_error(
         (boost::format("CZIImageDriver: Unsupported compression %1%") % static_cast<int>(block.compression())).str()
     );
 }
 
-void CZIScene::unpackChannels(const CZISubBlock& block, const std::vector<int>& componentIndices, 
-    const std::vector<unsigned char>& blockData, const TilerData* tilerData, 
+void CZIScene::unpackChannels(const CZISubBlock& block, const std::vector<int>& componentIndices,
+    const uint8_t* blockData, bool shareData, const TilerData* tilerData,
     std::vector<cv::Mat>& componentRasters)
 {
     for(int index=0; index<componentIndices.size(); ++index)
     {
         const int componentIndex = componentIndices[index];
-        const std::pair<int,int> componentChannelInfo = m_componentToChannelIndex[componentIndex];
+        const std::pair<int,int> componentChannelInfo = m_componentToChannelIndex.at(componentIndex);
         const int channelIndex = componentChannelInfo.first;
         const int channelComponent = componentChannelInfo.second;
         const int64_t channelOffset = block.computeDataOffset(channelIndex,
@@ -359,56 +699,104 @@ void CZIScene::unpackChannels(const CZISubBlock& block, const std::vector<int>&
         if(channelOffset<0)
             continue;
 
-        const uint8_t* channelData = blockData.data() + channelOffset;
-        const SceneChannelInfo& channelInfo = m_channelInfos[componentIndex];
-        const int channelSize = block.planeSize();
+        const uint8_t* channelData = blockData + channelOffset;
+        const SceneChannelInfo& channelInfo = m_channelInfos[channelIndex];
         const int cvPixelType = static_cast<int>(block.dataType());
         const cv::Size rasterSize = block.rect().size();
+        // header of the channel plane, no data is copied
+        const cv::Mat channelRaster(rasterSize, CV_MAKETYPE(cvPixelType, channelInfo.numComponents),
+            const_cast<uint8_t*>(channelData));
 
         if(channelInfo.numComponents==1)
         {
-            componentRasters[index].create(rasterSize, CV_MAKETYPE(cvPixelType, 1));
-            uint8_t* trg = componentRasters[index].data;
-            std::memcpy(trg, channelData, channelSize);
+            if(shareData)
+                componentRasters[index] = channelRaster;
+            else
+                channelRaster.copyTo(componentRasters[index]);
         }
         else
         {
-            cv::Mat channelRaster(rasterSize, CV_MAKETYPE(cvPixelType, channelInfo.numComponents));
             extractChannel(channelRaster, componentRasters[index], channelComponent);
         }
     }
 }
 
+// releases a buffer reused by the reads of a thread once it grows beyond the thread
+// capacity of the raster pool: a single large sub-block is not retained by an idle thread.
+static void trimThreadBuffer(std::vector<uint8_t>& buffer)
+{
+    if(buffer.capacity() > PooledMatAllocator::instance().getThreadCapacity())
+    {
+        std::vector<uint8_t>().swap(buffer);
+    }
+}
+
 bool CZIScene::readTile(int tileIndex, const std::vector<int>& orgComponentIndices, cv::OutputArray tileRaster,
                         void* userData)
 {
     const TilerData* tilerData = reinterpret_cast<TilerData*>(userData);
+    if(tilerData->stagedTiles!=nullptr)
+    {
+        const auto itTile = tilerData->stagedTiles->find(tileIndex);
+        if(itTile==tilerData->stagedTiles->end() || itTile->second.empty())
+            return false;
+        tileRaster.assign(itTile->second);
+        return true;
+    }
     const Tile& tile = getTile(tilerData, tileIndex);
-    const CZISubBlocks& blocks = getBlocks(tilerData);
-    std::vector<uint8_t> data;
+    const CZISubBlockTable& blockTable = getBlockTable();
+    // buffers of encoded and decoded sub-block data are reused by tiles read in the thread.
+    // Component rasters never reference them.
+    static thread_local std::vector<uint8_t> data;
+    static thread_local std::vector<uint8_t> rasterData;
     const int numChannels = getNumChannels();
     const std::vector<int> componentIndices = Tools::completeChannelList(orgComponentIndices, numChannels);
-    const int firstComponent = componentIndices[0];
-    const int cvDataType = static_cast<int>(getChannelDataType(firstComponent));
     cv::Rect tileRect;
     getTileRect(tileIndex, tileRect, userData);
-    tileRaster.create(tileRect.size(), CV_MAKETYPE(cvDataType, numChannels));
     std::vector<cv::Mat> channelRasters(componentIndices.size());
+    for(cv::Mat& channelRaster : channelRasters)
+    {
+        channelRaster.allocator = PooledMatAllocator::getAllocator();
+    }
     for(int index: tile.blockIndices)
     {
-        const CZISubBlock& block = blocks[index];
+        const CZISubBlock block = blockTable.block(index);
         if(blockHasData(block, componentIndices, tilerData))
         {
-            uint64_t pos = block.dataPosition();
-            uint64_t size = block.dataSize();
-            m_slide->readBlock(pos, size, data);
-            std::vector<uint8_t> rasterData = decodeData(block, data);
-            unpackChannels(block, componentIndices, rasterData, tilerData, channelRasters);
+            const uint64_t pos = block.dataPosition();
+            const uint64_t size = block.dataSize();
+            // planes of mapped files are referenced in place
+            const uint8_t* blockData = m_slide->getMappedBlock(pos, size);
+            bool shareData = blockData!=nullptr;
+            if(!shareData)
+            {
+                m_slide->readBlock(pos, size, data);
+                blockData = data.data();
+            }
+            if(block.compression()!=CZISubBlock::Uncompressed)
+            {
+                decodeData(block, blockData, static_cast<size_t>(size), rasterData);
+                blockData = rasterData.data();
+                shareData = false;
+            }
+            unpackChannels(block, componentIndices, blockData, shareData, tilerData, channelRasters);
         }
     }
+    trimThreadBuffer(data);
+    trimThreadBuffer(rasterData);
     if(channelRasters.size()==1)
     {
-        channelRasters[0].copyTo(tileRaster);
+        const cv::Mat& channelRaster = channelRasters[0];
+        if(channelRaster.u==nullptr && channelRaster.size()==tileRect.size())
+        {
+            // the plane of a mapped file is the tile: it is returned without
+            // copying and stays valid while the slide is open
+            tileRaster.assign(channelRaster);
+        }
+        else
+        {
+            channelRaster.copyTo(tileRaster);
+        }
     }
     else
     {
@@ -417,16 +805,151 @@ bool CZIScene::readTile(int tileIndex, const std::vector<int>& orgComponentIndic
     return true;
 }
 
+void CZIScene::stagePlaneTiles(const std::vector<int>& tileIndices, const std::vector<int>& componentIndices,
+    const cv::Range& zSliceRange, const cv::Range& timeFrameRange, const TilerData& tilerData,
+    std::vector<std::map<int, cv::Mat>>& planeTiles)
+{
+    const CZISubBlockTable& blockTable = getBlockTable();
+    const int numZSlices = zSliceRange.size();
+    const int numPlanes = numZSlices * timeFrameRange.size();
+    const int numComponents = static_cast<int>(componentIndices.size());
+    const int cvDataType = static_cast<int>(getChannelDataType(componentIndices[0]));
+    // sub-blocks of the tiles overlapping the ranges
+    struct TileBlocks
+    {
+        int tileIndex;
+        std::vector<int> blocks;
+    };
+    auto blockPosition = [&blockTable](int blockIndex)
+    {
+        return blockTable.block(blockIndex).dataPosition();
+    };
+    std::vector<TileBlocks> tiles;
+    tiles.reserve(tileIndices.size());
+    for(const int tileIndex : tileIndices)
+    {
+        TileBlocks tileBlocks;
+        tileBlocks.tileIndex = tileIndex;
+        for(const int blockIndex : getTile(&tilerData, tileIndex).blockIndices)
+        {
+            const CZISubBlock block = blockTable.block(blockIndex);
+            if(block.firstZSlice() < zSliceRange.end && block.lastZSlice() >= zSliceRange.start &&
+                block.firstTFrame() < timeFrameRange.end && block.lastTFrame() >= timeFrameRange.start)
+            {
+                tileBlocks.blocks.push_back(blockIndex);
+            }
+        }
+        if(tileBlocks.blocks.empty())
+            continue;
+        std::sort(tileBlocks.blocks.begin(), tileBlocks.blocks.end(), [&](int left, int right)
+        {
+            return blockPosition(left) < blockPosition(right);
+        });
+        tiles.push_back(std::move(tileBlocks));
+    }
+    std::sort(tiles.begin(), tiles.end(), [&](const TileBlocks& left, const TileBlocks& right)
+    {
+        return blockPosition(left.blocks.front()) < blockPosition(right.blocks.front());
+    });
+    // entries are created ahead, the tiles are filled concurrently
+    for(std::map<int, cv::Mat>& tileRasters : planeTiles)
+    {
+        for(const TileBlocks& tileBlocks : tiles)
+        {
+            tileRasters[tileBlocks.tileIndex] = cv::Mat();
+        }
+    }
+    cv::parallel_for_(cv::Range(0, static_cast<int>(tiles.size())), [&](const cv::Range& range)
+    {
+        std::vector<uint8_t> data;
+        std::vector<uint8_t> rasterData;
+        std::vector<std::vector<cv::Mat>> componentRasters(numPlanes);
+        TilerData planeData = tilerData;
+        for(int index = range.start; index < range.end; ++index)
+        {
+            const TileBlocks& tileBlocks = tiles[index];
+            for(std::vector<cv::Mat>& rasters : componentRasters)
+            {
+                rasters.assign(numComponents, cv::Mat());
+            }
+            for(const int blockIndex : tileBlocks.blocks)
+            {
+                const CZISubBlock block = blockTable.block(blockIndex);
+                const uint8_t* blockData = nullptr;
+                bool shareData = false;
+                const int firstTFrame = std::max(timeFrameRange.start, block.firstTFrame());
+                const int lastTFrame = std::min(timeFrameRange.end - 1, block.lastTFrame());
+                const int firstZSlice = std::max(zSliceRange.start, block.firstZSlice());
+                const int lastZSlice = std::min(zSliceRange.end - 1, block.lastZSlice());
+                for(int tFrame = firstTFrame; tFrame <= lastTFrame; ++tFrame)
+                {
+                    for(int zSlice = firstZSlice; zSlice <= lastZSlice; ++zSlice)
+                    {
+                        planeData.zSliceIndex = zSlice;
+                        planeData.tFrameIndex = tFrame;
+                        if(!blockHasData(block, componentIndices, &planeData))
+                            continue;
+                        if(blockData==nullptr)
+                        {
+                            // the sub-block is fetched and decoded once for all its planes
+                            const uint64_t pos = block.dataPosition();
+                            const uint64_t size = block.dataSize();
+                            blockData = m_slide->getMappedBlock(pos, size);
+                            shareData = blockData!=nullptr;
+                            if(!shareData)
+                            {
+                                m_slide->readBlock(pos, size, data);
+                                blockData = data.data();
+                            }
+                            if(block.compression()!=CZISubBlock::Uncompressed)
+                            {
+                                decodeData(block, blockData, static_cast<size_t>(size), rasterData);
+                                blockData = rasterData.data();
+                                shareData = false;
+                            }
+                        }
+                        const int plane = (tFrame - timeFrameRange.start) * numZSlices + (zSlice - zSliceRange.start);
+                        unpackChannels(block, componentIndices, blockData, shareData, &planeData, componentRasters[plane]);
+                    }
+                }
+            }
+            const cv::Size tileSize = getTile(&tilerData, tileBlocks.tileIndex).rect.size();
+            for(int plane = 0; plane < numPlanes; ++plane)
+            {
+                std::vector<cv::Mat>& rasters = componentRasters[plane];
+                if(std::all_of(rasters.begin(), rasters.end(), [](const cv::Mat& raster) { return raster.empty(); }))
+                    continue;
+                for(cv::Mat& raster : rasters)
+                {
+                    if(raster.empty())
+                    {
+                        raster = cv::Mat::zeros(tileSize, CV_MAKETYPE(cvDataType, 1));
+                    }
+                }
+                cv::Mat& tileRaster = planeTiles[plane].find(tileBlocks.tileIndex)->second;
+                if(numComponents==1)
+                {
+                    tileRaster = rasters[0];
+                }
+                else
+                {
+                    cv::merge(rasters, tileRaster);
+                }
+            }
+        }
+    });
+}
 
-void CZIScene::combineBlockInTiles(ZoomLevel& zoomLevel)
+void CZIScene::combineBlockInTiles(ZoomLevel& zoomLevel, const CZISubBlockTable& blockTable)
 {
-    std::map<uint64_t, int> coordsToIndex;
+    std::unordered_map<uint64_t, int> coordsToIndex;
+    coordsToIndex.reserve(zoomLevel.blocks.size());
     Tiles& tiles = zoomLevel.tiles;
-    for(int blockIndex=0; blockIndex < static_cast<int>(zoomLevel.blocks.size()); blockIndex++)
+    for(const int blockIndex : zoomLevel.blocks)
     {
-        const CZISubBlock& block = zoomLevel.blocks[blockIndex];
+        const CZISubBlock block = blockTable.block(blockIndex);
         const cv::Rect& rectBlock = block.rect();
-        uint64_t key = (static_cast<uint64_t>(rectBlock.x) << 32) | rectBlock.y;
+        uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(rectBlock.x)) << 32) | static_cast<uint32_t>(rectBlock.y);
         auto tileIt = coordsToIndex.find(key);
         int index;
         if (tileIt == coordsToIndex.end())
@@ -434,6 +957,10 @@ void CZIScene::combineBlockInTiles(ZoomLevel& zoomLevel)
             index = (int)tiles.size();
             coordsToIndex[key] = index;
             tiles.emplace_back();
+            cv::Rect& tileRect = tiles.back().rect;
+            tileRect = rectBlock;
+            tileRect.x = static_cast<int>(std::ceil(static_cast<double>(tileRect.x)* zoomLevel.zoom));
+            tileRect.y = static_cast<int>(std::ceil(static_cast<double>(tileRect.y)* zoomLevel.zoom));
         }
         else
         {
@@ -443,6 +970,45 @@ void CZIScene::combineBlockInTiles(ZoomLevel& zoomLevel)
     }
 }
 
+void CZIScene::buildTileGrid(ZoomLevel& zoomLevel)
+{
+    // regular grid of cells covering the zoom level. Each cell keeps
+    // indices of tiles intersecting it. The cell size is the size
+    // of the largest tile, so a tile is registered in at most 4 cells.
+    TileGrid& grid = zoomLevel.grid;
+    const Tiles& tiles = zoomLevel.tiles;
+    grid = TileGrid();
+    grid.cellSize = cv::Size(1, 1);
+    for(const auto& tile : tiles)
+    {
+        grid.rect |= tile.rect;
+        grid.cellSize.width = std::max(grid.cellSize.width, tile.rect.width);
+        grid.cellSize.height = std::max(grid.cellSize.height, tile.rect.height);
+    }
+    if(grid.rect.area() <= 0)
+        return;
+    grid.cols = (grid.rect.width - 1) / grid.cellSize.width + 1;
+    grid.rows = (grid.rect.height - 1) / grid.cellSize.height + 1;
+    grid.cells.resize(grid.cols * grid.rows);
+    for(int tileIndex = 0; tileIndex < static_cast<int>(tiles.size()); ++tileIndex)
+    {
+        const cv::Rect tileRect = tiles[tileIndex].rect & grid.rect;
+        if(tileRect.area() <= 0)
+            continue;
+        const int firstCol = (tileRect.x - grid.rect.x) / grid.cellSize.width;
+        const int firstRow = (tileRect.y - grid.rect.y) / grid.cellSize.height;
+        const int lastCol = (tileRect.x + tileRect.width - 1 - grid.rect.x) / grid.cellSize.width;
+        const int lastRow = (tileRect.y + tileRect.height - 1 - grid.rect.y) / grid.cellSize.height;
+        for(int row = firstRow; row <= lastRow; ++row)
+        {
+            for(int col = firstCol; col <= lastCol; ++col)
+            {
+                grid.cells[row * grid.cols + col].push_back(tileIndex);
+            }
+        }
+    }
+}
+
 void CZIScene::channelComponentInfo(CZIDataType channelCZIDataType, DataType& componentType, int& numComponents,
     int& pixelSize)
 {
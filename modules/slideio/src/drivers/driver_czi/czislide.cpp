@@ -8,6 +8,12 @@
 #include <boost/format.hpp>
 #include <tinyxml2.h>
 #include "opencv2/slideio/czistructs.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
 #include <set>
 
 using namespace cv::slideio;
@@ -17,9 +23,44 @@ static char SID_FILES[] = "ZISRAWFILE";
 static char SID_METADATA[] = "ZISRAWMETADATA";
 static char SID_DIRECTORY[] = "ZISRAWDIRECTORY";
 
+static std::atomic<bool> memoryMapping(false);
+
+// directory index cache
+static std::mutex indexCacheMutex;
+static bool indexCacheEnabled = false;
+static std::string indexCacheDirectory;
+static const char INDEX_MAGIC[16] = "SLIDEIO_CZI_IDX";
+static const char INDEX_EXTENSION[] = ".slideio-idx";
+// size of the file beginning included in the index signature
+static const uint64_t INDEX_HEADER_HASH_SIZE = 512;
+static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+
+static uint64_t fnv1aHash(const uint8_t* data, size_t size, uint64_t hash)
+{
+    for(size_t index = 0; index < size; ++index)
+    {
+        hash ^= data[index];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 //-------------------------------------------------------
 // Static helper functions for parsing of the metadata
 // ------------------------------------------------------
+// index values are stored field by field, independent of structure padding
+template <typename T>
+static void writeIndexValue(std::ostream& stream, const T& value)
+{
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool readIndexValue(std::istream& stream, T& value)
+{
+    return static_cast<bool>(stream.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
 static int xmlChildNodeTextToInt(const XMLNode* xmlParent, const char* childName, int defaultValue = -1)
 {
     if (xmlParent == nullptr)
@@ -76,21 +117,52 @@ cv::Ptr<Scene> CZISlide::getScene(int index) const
 }
 
 
-void CZISlide::readBlock(uint64_t pos, uint64_t size, std::vector<unsigned char>& data)
+void CZISlide::readBlock(uint64_t pos, uint64_t size, std::vector<unsigned char>& data) const
+{
+    m_file->read(pos, static_cast<size_t>(size), data);
+}
+
+const uint8_t* CZISlide::getMappedBlock(uint64_t pos, uint64_t size) const
+{
+    const uint8_t* data = m_file->getMappedData();
+    if(data==nullptr || pos > m_file->getSize() || size > m_file->getSize() - pos)
+        return nullptr;
+    return data + pos;
+}
+
+void CZISlide::setMemoryMapping(bool enable)
 {
-    data.resize(size);
-    m_fileStream.seekg(pos);
-    m_fileStream.read((char*)data.data(), size);
+    memoryMapping = enable;
+}
+
+bool CZISlide::getMemoryMapping()
+{
+    return memoryMapping.load();
 }
 
 void CZISlide::init()
 {
+    m_file.reset(new RandomAccessFile(m_filePath));
+    if(memoryMapping.load())
+    {
+        // positional reads are used if the file cannot be mapped
+        m_file->map();
+    }
     // read file header
-    m_fileStream.exceptions(std::ios::failbit | std::ios::badbit);
-    m_fileStream.open(m_filePath.c_str(), std::ifstream::in | std::ifstream::binary);
     readFileHeader();
     readMetadata();
-    readDirectory();
+    std::vector<uint64_t> sceneIds;
+    std::vector<std::vector<int>> sceneBlocks;
+    const std::string indexPath = getIndexFilePath();
+    if(indexPath.empty() || !readIndex(indexPath, sceneIds, sceneBlocks))
+    {
+        readDirectory(sceneIds, sceneBlocks);
+        if(!indexPath.empty())
+        {
+            writeIndex(indexPath, sceneIds, sceneBlocks);
+        }
+    }
+    createScenes(sceneIds, sceneBlocks);
 }
 
 void CZISlide::parseMagnification(XMLNode* root)
@@ -190,11 +262,11 @@ void CZISlide::parseChannels(XMLNode* root)
 
 void CZISlide::readMetadata()
 {
-    // position stream pointer to metadata segment
-    m_fileStream.seekg(m_metadataPosition, std::ios_base::beg);
+    uint64_t filePos = m_metadataPosition;
     // read segment header
     SegmentHeader header{};
-    m_fileStream.read((char*)&header, sizeof(header));
+    m_file->read(filePos, sizeof(header), &header);
+    filePos += sizeof(header);
     if (strncmp(header.SID, SID_METADATA, sizeof(SID_METADATA)) != 0)
     {
         throw std::runtime_error(
@@ -202,11 +274,12 @@ void CZISlide::readMetadata()
     }
     // read metadata header
     MetadataHeader metadataHeader{};
-    m_fileStream.read((char*)&metadataHeader, sizeof(metadataHeader));
-    const uint32_t xmlSize = metadataHeader.xmlSize;;
+    m_file->read(filePos, sizeof(metadataHeader), &metadataHeader);
+    filePos += sizeof(metadataHeader);
+    const uint32_t xmlSize = metadataHeader.xmlSize;
     std::vector<char> xmlString(xmlSize);
     // read metadata xml
-    m_fileStream.read(xmlString.data(), xmlSize);
+    m_file->read(filePos, xmlSize, xmlString.data());
     parseMetadataXmL(xmlString.data(), xmlSize);
 }
 
@@ -214,57 +287,88 @@ void CZISlide::readFileHeader()
 {
     FileHeader fileHeader{};
     SegmentHeader header{};
-    m_fileStream.read(reinterpret_cast<char*>(&header), sizeof(header));
+    m_file->read(0, sizeof(header), &header);
     if (strncmp(header.SID, SID_FILES, sizeof(SID_FILES)) != 0)
     {
         throw std::runtime_error(
             (boost::format("CZIImageDriver: file %1% is not a CZI file.") % m_filePath).str());
     }
-    m_fileStream.read(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader));
+    m_file->read(sizeof(header), sizeof(fileHeader), &fileHeader);
     m_directoryPosition = fileHeader.directoryPosition;
     m_metadataPosition = fileHeader.metadataPosition;
 }
 
-void CZISlide::readDirectory()
+void CZISlide::readDirectory(std::vector<uint64_t>& sceneIds, std::vector<std::vector<int>>& sceneBlocks)
 {
-    // position stream pointer to the directory segment
-    m_fileStream.seekg(m_directoryPosition, std::ios_base::beg);
+    uint64_t filePos = m_directoryPosition;
     // read segment header
     SegmentHeader header{};
-    m_fileStream.read(reinterpret_cast<char*>(&header), sizeof(header));
+    m_file->read(filePos, sizeof(header), &header);
+    filePos += sizeof(header);
     if (strncmp(header.SID, SID_DIRECTORY, sizeof(SID_DIRECTORY)) != 0)
     {
         throw std::runtime_error(
             (boost::format("CZIImageDriver: invalid directory segment of file %1%.") % m_filePath).str());
     }
     DirectoryHeader directoryHeader{};
-    m_fileStream.read(reinterpret_cast<char*>(&directoryHeader), sizeof(directoryHeader));
-    std::vector<CZISubBlocks> sceneBlocks;
-    std::vector<uint64_t> sceneIds;
+    m_file->read(filePos, sizeof(directoryHeader), &directoryHeader);
+    filePos += sizeof(directoryHeader);
+    // directory entries have variable size, read the whole segment at once
+    const uint64_t segmentSize = std::max(header.usedSize, header.allocatedSize);
+    if(segmentSize < sizeof(directoryHeader) || filePos > m_file->getSize())
+    {
+        throw std::runtime_error(
+            (boost::format("CZIImageDriver: invalid directory segment of file %1%.") % m_filePath).str());
+    }
+    const uint64_t entriesSize = std::min(segmentSize - sizeof(directoryHeader), m_file->getSize() - filePos);
+    std::vector<uint8_t> entries;
+    m_file->read(filePos, static_cast<size_t>(entriesSize), entries);
+    sceneBlocks.clear();
+    sceneIds.clear();
     std::map<uint64_t, int> sceneMap;
-    auto filePos = m_fileStream.tellg();
+    m_blocks = CZISubBlockTable();
+    m_blocks.reserve(directoryHeader.entryCount);
+    std::vector<DimensionEntryDV> dimensions;
+    std::vector<Dimension> sceneDimensions;
+    std::vector<uint64_t> blockSceneIds;
+    size_t entryPos = 0;
     for (unsigned int entry = 0; entry < directoryHeader.entryCount; ++entry)
     {
-        CZISubBlock block;
         DirectoryEntryDV entryHeader{};
-        m_fileStream.seekg(filePos);
-        m_fileStream.read(reinterpret_cast<char*>(&entryHeader), sizeof(entryHeader));
-        std::vector<DimensionEntryDV> dimensions(entryHeader.dimensionCount);
-        for (int dim = 0; dim < entryHeader.dimensionCount; ++dim)
+        if(entryPos + sizeof(entryHeader) > entries.size())
+        {
+            throw std::runtime_error(
+                (boost::format("CZIImageDriver: truncated directory segment of file %1%.") % m_filePath).str());
+        }
+        std::memcpy(&entryHeader, entries.data() + entryPos, sizeof(entryHeader));
+        entryPos += sizeof(entryHeader);
+        const size_t dimensionsSize = sizeof(DimensionEntryDV)*entryHeader.dimensionCount;
+        if(entryHeader.dimensionCount < 0 || entryPos + dimensionsSize > entries.size())
         {
-            DimensionEntryDV& dimEntry = dimensions[dim];
-            m_fileStream.read(reinterpret_cast<char*>(&dimEntry), sizeof(dimEntry));
+            throw std::runtime_error(
+                (boost::format("CZIImageDriver: truncated directory segment of file %1%.") % m_filePath).str());
         }
-        filePos = m_fileStream.tellg();
-        m_fileStream.seekg(entryHeader.filePosition);
-        SegmentHeader segmentHeader;
-        m_fileStream.read((char*)&segmentHeader, sizeof(segmentHeader));
+        dimensions.resize(entryHeader.dimensionCount);
+        std::memcpy(dimensions.data(), entries.data() + entryPos, dimensionsSize);
+        entryPos += dimensionsSize;
         SubBlockHeader subblockHeader;
-        m_fileStream.read((char*)&subblockHeader, sizeof(subblockHeader));
-        block.setupBlock(subblockHeader, dimensions);
-        const std::vector<Dimension>& blockDimensions = block.dimensions();
-        std::vector<uint64_t> blockSceneIds;
-        CZIScene::sceneIdsFromDims(blockDimensions, blockSceneIds);
+        m_file->read(entryHeader.filePosition + sizeof(SegmentHeader), sizeof(subblockHeader), &subblockHeader);
+        const int blockIndex = m_blocks.addBlock(subblockHeader, dimensions);
+        // only dimensions defining scenes take part in the scene ids
+        sceneDimensions.clear();
+        for(const auto& dimEntry : dimensions)
+        {
+            const char type = dimEntry.dimension[0];
+            if(type=='S' || type=='I' || type=='V' || type=='H' || type=='R' || type=='B')
+            {
+                sceneDimensions.push_back(Dimension{type, dimEntry.start, dimEntry.size});
+            }
+        }
+        blockSceneIds.clear();
+        if(sceneDimensions.empty())
+            blockSceneIds.push_back(CZIScene::sceneIdFromDims(sceneDimensions));
+        else
+            CZIScene::sceneIdsFromDims(sceneDimensions, blockSceneIds);
         for(const auto& sceneId : blockSceneIds)
         {
             auto sceneIt = sceneMap.find(sceneId);
@@ -280,20 +384,179 @@ void CZISlide::readDirectory()
             {
                 sceneIndex = sceneIt->second;
             }
-            sceneBlocks[sceneIndex].push_back(block);
+            sceneBlocks[sceneIndex].push_back(blockIndex);
         }
     }
+    m_blocks.shrinkToFit();
+}
+
+void CZISlide::createScenes(const std::vector<uint64_t>& sceneIds, const std::vector<std::vector<int>>& sceneBlocks)
+{
     for(size_t sceneIndex = 0; sceneIndex < sceneBlocks.size(); ++sceneIndex)
     {
         const uint64_t sceneId = sceneIds[sceneIndex];
-        const CZISubBlocks& blocks = sceneBlocks[sceneIndex];
+        const std::vector<int>& blockIndices = sceneBlocks[sceneIndex];
         CZIScene::SceneParams params{};
         cv::Ptr<CZIScene> scene(new CZIScene);
         CZIScene::dimsFromSceneId(sceneId, params);
-        scene->init(sceneId, params, m_filePath, blocks, this);
+        scene->init(sceneId, params, m_filePath, blockIndices, this);
         m_scenes.push_back(scene);
     }
+}
+
+void CZISlide::setIndexCache(bool enable, const std::string& directory)
+{
+    std::lock_guard<std::mutex> lock(indexCacheMutex);
+    indexCacheEnabled = enable;
+    indexCacheDirectory = directory;
+}
+
+std::string CZISlide::getIndexFilePath() const
+{
+    std::string directory;
+    {
+        std::lock_guard<std::mutex> lock(indexCacheMutex);
+        if(!indexCacheEnabled)
+            return std::string();
+        directory = indexCacheDirectory;
+    }
+    if(directory.empty())
+    {
+        return m_filePath + INDEX_EXTENSION;
+    }
+    // the hash of the full path separates files with equal names
+    const boost::filesystem::path filePath(m_filePath);
+    const uint64_t pathHash = fnv1aHash(reinterpret_cast<const uint8_t*>(m_filePath.data()), m_filePath.size(), FNV_OFFSET);
+    const std::string fileName = (boost::format("%1%-%2$016x%3%")
+        % filePath.filename().string() % pathHash % INDEX_EXTENSION).str();
+    return (boost::filesystem::path(directory) / fileName).string();
+}
+
+void CZISlide::computeIndexSignature(IndexSignature& signature) const
+{
+    signature.fileSize = m_file->getSize();
+    boost::system::error_code error;
+    signature.modificationTime = static_cast<int64_t>(boost::filesystem::last_write_time(m_filePath, error));
+    std::vector<uint8_t> header;
+    m_file->read(0, static_cast<size_t>(std::min<uint64_t>(INDEX_HEADER_HASH_SIZE, signature.fileSize)), header);
+    signature.headerHash = fnv1aHash(header.data(), header.size(), FNV_OFFSET);
+}
+
+bool CZISlide::readIndex(const std::string& indexPath, std::vector<uint64_t>& sceneIds,
+    std::vector<std::vector<int>>& sceneBlocks)
+{
+    boost::system::error_code error;
+    if(!boost::filesystem::exists(indexPath, error))
+        return false;
+    try
+    {
+        // the whole index is loaded with a single sequential read
+        std::ifstream indexFile(indexPath, std::ios::binary);
+        if(!indexFile)
+            return false;
+        std::stringstream stream(std::ios::in | std::ios::out | std::ios::binary);
+        stream << indexFile.rdbuf();
+        char magic[sizeof(INDEX_MAGIC)] = {0};
+        IndexSignature fileSignature{}, signature{};
+        if(!stream.read(magic, sizeof(magic)) || std::memcmp(magic, INDEX_MAGIC, sizeof(magic))!=0)
+            return false;
+        if(!readIndexValue(stream, fileSignature.version) ||
+            !readIndexValue(stream, fileSignature.fileSize) ||
+            !readIndexValue(stream, fileSignature.modificationTime) ||
+            !readIndexValue(stream, fileSignature.headerHash))
+            return false;
+        computeIndexSignature(signature);
+        if(fileSignature.version!=signature.version ||
+            fileSignature.fileSize!=signature.fileSize ||
+            fileSignature.modificationTime!=signature.modificationTime ||
+            fileSignature.headerHash!=signature.headerHash)
+            return false;
+        CZISubBlockTable blocks;
+        if(!blocks.read(stream))
+            return false;
+        uint64_t sceneCount = 0;
+        if(!stream.read(reinterpret_cast<char*>(&sceneCount), sizeof(sceneCount)))
+            return false;
+        std::vector<uint64_t> ids(static_cast<size_t>(sceneCount));
+        std::vector<std::vector<int>> indices(static_cast<size_t>(sceneCount));
+        for(uint64_t sceneIndex = 0; sceneIndex < sceneCount; ++sceneIndex)
+        {
+            uint64_t blockCount = 0;
+            if(!stream.read(reinterpret_cast<char*>(&ids[sceneIndex]), sizeof(uint64_t)) ||
+                !stream.read(reinterpret_cast<char*>(&blockCount), sizeof(blockCount)) ||
+                blockCount > static_cast<uint64_t>(blocks.size()))
+                return false;
+            std::vector<int>& sceneIndices = indices[sceneIndex];
+            sceneIndices.resize(static_cast<size_t>(blockCount));
+            if(!stream.read(reinterpret_cast<char*>(sceneIndices.data()), blockCount * sizeof(int)))
+                return false;
+            for(const int blockIndex : sceneIndices)
+            {
+                if(blockIndex<0 || blockIndex>=blocks.size())
+                    return false;
+            }
+        }
+        m_blocks = std::move(blocks);
+        sceneIds = std::move(ids);
+        sceneBlocks = std::move(indices);
+        return true;
+    }
+    catch(std::exception&)
+    {
+        // an unreadable index is rebuilt from the file
+        return false;
+    }
+}
 
+void CZISlide::writeIndex(const std::string& indexPath, const std::vector<uint64_t>& sceneIds,
+    const std::vector<std::vector<int>>& sceneBlocks) const
+{
+    namespace fs = boost::filesystem;
+    try
+    {
+        IndexSignature signature{};
+        computeIndexSignature(signature);
+        // write to a temporary file and rename it, so readers never see a partial index
+        const fs::path targetPath(indexPath);
+        const fs::path tempPath = fs::path(indexPath + fs::unique_path("-%%%%%%%%.tmp").string());
+        {
+            std::ofstream stream(tempPath.string(), std::ios::binary | std::ios::trunc);
+            if(!stream)
+                return;
+            stream.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+            writeIndexValue(stream, signature.version);
+            writeIndexValue(stream, signature.fileSize);
+            writeIndexValue(stream, signature.modificationTime);
+            writeIndexValue(stream, signature.headerHash);
+            m_blocks.write(stream);
+            const uint64_t sceneCount = sceneIds.size();
+            stream.write(reinterpret_cast<const char*>(&sceneCount), sizeof(sceneCount));
+            for(size_t sceneIndex = 0; sceneIndex < sceneIds.size(); ++sceneIndex)
+            {
+                const std::vector<int>& blockIndices = sceneBlocks[sceneIndex];
+                const uint64_t blockCount = blockIndices.size();
+                stream.write(reinterpret_cast<const char*>(&sceneIds[sceneIndex]), sizeof(uint64_t));
+                stream.write(reinterpret_cast<const char*>(&blockCount), sizeof(blockCount));
+                stream.write(reinterpret_cast<const char*>(blockIndices.data()), blockCount * sizeof(int));
+            }
+            if(!stream)
+            {
+                stream.close();
+                fs::remove(tempPath);
+                return;
+            }
+        }
+        boost::system::error_code error;
+        fs::rename(tempPath, targetPath, error);
+        if(error)
+        {
+            fs::remove(tempPath, error);
+        }
+    }
+    catch(std::exception&)
+    {
+        // the index is an optional cache, the slide is usable without it
+    }
 }
 
 void CZISlide::parseResolutions(XMLNode* root)
@@ -4,9 +4,104 @@
 #include "opencv2/slideio/czisubblock.hpp"
 #include "opencv2/slideio/cziscene.hpp"
 #include <boost/format.hpp>
+#include <algorithm>
 
+using namespace cv::slideio;
 
-bool cv::slideio::CZISubBlock::isInBlock(int channel, int z, int t, int r, int s, int i, int b, int h, int v) const
+template <typename T>
+static void writeColumn(std::ostream& stream, const std::vector<T>& column)
+{
+    const uint64_t count = column.size();
+    stream.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    stream.write(reinterpret_cast<const char*>(column.data()), static_cast<std::streamsize>(count * sizeof(T)));
+}
+
+template <typename T>
+static bool readColumn(std::istream& stream, std::vector<T>& column, uint64_t expectedCount)
+{
+    uint64_t count = 0;
+    if (!stream.read(reinterpret_cast<char*>(&count), sizeof(count)) || count != expectedCount)
+        return false;
+    column.resize(static_cast<size_t>(count));
+    return static_cast<bool>(stream.read(reinterpret_cast<char*>(column.data()),
+        static_cast<std::streamsize>(count * sizeof(T))));
+}
+
+static uint64_t dimensionCode(char dimension)
+{
+    switch (dimension)
+    {
+    case 'C': return CZISubBlock::DimC;
+    case 'Z': return CZISubBlock::DimZ;
+    case 'T': return CZISubBlock::DimT;
+    case 'R': return CZISubBlock::DimR;
+    case 'S': return CZISubBlock::DimS;
+    case 'I': return CZISubBlock::DimI;
+    case 'B': return CZISubBlock::DimB;
+    case 'H': return CZISubBlock::DimH;
+    case 'V': return CZISubBlock::DimV;
+    default: return CZISubBlock::DimCount;
+    }
+}
+
+int CZISubBlock::firstDimensionIndex(int dimension) const
+{
+    return m_table->m_dimensions[static_cast<size_t>(m_index) * DimCount + dimension].start;
+}
+
+int CZISubBlock::lastDimensionIndex(int dimension) const
+{
+    const CZISubBlockTable::DimensionRange& range = m_table->m_dimensions[static_cast<size_t>(m_index) * DimCount + dimension];
+    return range.start + range.size - 1;
+}
+
+double CZISubBlock::zoom() const
+{
+    return m_table->m_zooms[m_index];
+}
+
+const cv::Rect& CZISubBlock::rect() const
+{
+    return m_table->m_rects[m_index];
+}
+
+int CZISubBlock::cziPixelType() const
+{
+    return m_table->m_pixelTypes[m_index];
+}
+
+int CZISubBlock::pixelSize() const
+{
+    DataType componentType;
+    int numComponents(0), pixelSize(0);
+    CZIScene::channelComponentInfo(static_cast<CZIDataType>(cziPixelType()), componentType, numComponents, pixelSize);
+    return pixelSize;
+}
+
+DataType CZISubBlock::dataType() const
+{
+    DataType componentType;
+    int numComponents(0), pixelSize(0);
+    CZIScene::channelComponentInfo(static_cast<CZIDataType>(cziPixelType()), componentType, numComponents, pixelSize);
+    return componentType;
+}
+
+uint64_t CZISubBlock::dataPosition() const
+{
+    return m_table->m_dataPositions[m_index];
+}
+
+uint64_t CZISubBlock::dataSize() const
+{
+    return m_table->m_dataSizes[m_index];
+}
+
+CZISubBlock::Compression CZISubBlock::compression() const
+{
+    return static_cast<Compression>(m_table->m_compressions[m_index]);
+}
+
+bool CZISubBlock::isInBlock(int channel, int z, int t, int r, int s, int i, int b, int h, int v) const
 {
     const bool inBlock = (channel >= firstChannel() && channel <= lastChannel()) &&
         (z >= firstZSlice() && z <= lastZSlice()) &&
@@ -20,154 +115,152 @@ bool cv::slideio::CZISubBlock::isInBlock(int channel, int z, int t, int r, int s
     return inBlock;
 }
 
-
-cv::slideio::CZISubBlock::CZISubBlock() : m_dataType(DataType::DT_Unknown), m_cziPixelType(0), m_pixelSize(1),
-                                          m_planeSize(0), m_filePosition(-1),
-                                          m_dataPosition(-1), m_dataSize(0), m_filePart(-1),
-                                          m_compression(-1), m_channelIndex(-1), m_zSliceIndex(-1),
-                                          m_tFrameIndex(-1), m_illuminationIndex(-1),
-                                          m_bAccusitionIndex(-1), m_rotationIndex(-1), m_sceneIndex(-1),
-                                          m_hPhaseIndex(-1), m_viewIndex(-1), m_zoom(1.)
-{
-}
-
-int64_t cv::slideio::CZISubBlock::computeDataOffset(int channel, int z, int t, int r, int s, int i, int b, int h,
-                                                    int v) const
+int64_t CZISubBlock::computeDataOffset(int channel, int z, int t, int r, int s, int i, int b, int h,
+                                       int v) const
 {
     if (!isInBlock(channel, z, t, r, s, i, b, h, v))
         return -1;
     // compute file offset for the channel
-    int64_t itemSize = m_planeSize;
-    int64_t channelSize(0), zSize(0), tSize(0), rSize(0), sSize(0), iSize(0), bSize(0), hSize(0), vSize(0);
-    for (const auto& dim : m_dimensions)
+    int64_t itemSize = planeSize();
+    int64_t strides[DimCount] = {0};
+    uint64_t order = m_table->m_dimensionOrders[m_index];
+    for (; (order & CZISubBlockTable::DimensionCodeEnd) != CZISubBlockTable::DimensionCodeEnd;
+        order >>= CZISubBlockTable::DimensionCodeBits)
     {
-        switch (dim.type)
+        const uint64_t code = order & CZISubBlockTable::DimensionCodeEnd;
+        if (code == CZISubBlockTable::DimensionCodeM)
+            continue;
+        if (code == CZISubBlockTable::DimensionCodeUnknown)
         {
-        case 'C':
-            channelSize = itemSize;
-            itemSize *= dim.size;
-            break;
-        case 'T':
-            tSize = itemSize;
-            itemSize *= dim.size;
-            break;
-        case 'Z':
-            zSize = itemSize;
-            itemSize *= dim.size;
-            break;
-        case 'R':
-            rSize = itemSize;
-            itemSize *= dim.size;
-            break;
-        case 'S':
-            sSize = itemSize;
-            itemSize *= dim.size;
-            break;
-        case 'I':
-            iSize = itemSize;
-            itemSize *= dim.size;
-            break;
-        case 'B':
-            bSize = itemSize;
-            itemSize *= dim.size;
-            break;
-        case 'H':
-            hSize = itemSize;
-            itemSize *= dim.size;
-            break;
-        case 'V':
-            vSize = itemSize;
-            itemSize *= dim.size;
-            break;
-        case 'M':
-            break;
-        default:
             throw std::runtime_error(
-                (boost::format("CZIImageDriver: Unknown dimension: %1%") % dim.type).str());
+                (boost::format("CZIImageDriver: Unknown dimension in sub-block %1%") % m_index).str());
         }
+        strides[code] = itemSize;
+        itemSize *= m_table->m_dimensions[static_cast<size_t>(m_index) * DimCount + code].size;
+    }
+    const int values[DimCount] = { channel, z, t, r, s, i, b, h, v };
+    int64_t offset = 0;
+    for (int dim = 0; dim < DimCount; ++dim)
+    {
+        offset += (values[dim] - firstDimensionIndex(dim)) * strides[dim];
     }
-    const int64_t offset = 
-        (channel - firstChannel()) * channelSize +
-        (z - firstZSlice()) * zSize +
-        (t - firstTFrame()) * tSize +
-        (r - firstRotation()) * rSize +
-        (s - firstScene()) * sSize +
-        (i - firstIllumination()) * iSize +
-        (b - firstBAccusition()) * bSize +
-        (h - firstHPhase()) * hSize +
-        (v - firstView()) * vSize;
     return offset;
 }
 
-void cv::slideio::CZISubBlock::setupBlock(const SubBlockHeader& subblockHeader, std::vector<DimensionEntryDV>& dimensionEntries)
+void CZISubBlockTable::reserve(size_t count)
+{
+    m_rects.reserve(count);
+    m_zooms.reserve(count);
+    m_dataPositions.reserve(count);
+    m_dataSizes.reserve(count);
+    m_pixelTypes.reserve(count);
+    m_compressions.reserve(count);
+    m_dimensionOrders.reserve(count);
+    m_dimensions.reserve(count * CZISubBlock::DimCount);
+}
+
+void CZISubBlockTable::shrinkToFit()
+{
+    m_rects.shrink_to_fit();
+    m_zooms.shrink_to_fit();
+    m_dataPositions.shrink_to_fit();
+    m_dataSizes.shrink_to_fit();
+    m_pixelTypes.shrink_to_fit();
+    m_compressions.shrink_to_fit();
+    m_dimensionOrders.shrink_to_fit();
+    m_dimensions.shrink_to_fit();
+}
+
+int CZISubBlockTable::addBlock(const SubBlockHeader& subblockHeader, const std::vector<DimensionEntryDV>& dimensionEntries)
 {
     const DirectoryEntryDV& entryHeader = subblockHeader.direEntry;
-    m_filePosition = entryHeader.filePosition;
-    m_compression = entryHeader.compression;
-    m_filePart = entryHeader.filePart;
-    m_cziPixelType = entryHeader.pixelType;
-    m_dataSize = subblockHeader.dataSize;
-    m_dimensions.reserve(entryHeader.dimensionCount);
+    // validate the pixel type
+    DataType componentType;
+    int numComponents(0), pixelSize(0);
+    CZIScene::channelComponentInfo(static_cast<CZIDataType>(entryHeader.pixelType), componentType, numComponents, pixelSize);
     uint64_t subblockHeaderSize = sizeof(SubBlockHeader) + sizeof(DimensionEntryDV)*entryHeader.dimensionCount;
     subblockHeaderSize = std::max((uint64_t)256, subblockHeaderSize);
-    m_dataPosition = m_filePosition + sizeof(SegmentHeader) + subblockHeader.metadataSize + subblockHeaderSize;
-    int numComponents;
-    CZIScene::channelComponentInfo(static_cast<CZIDataType>(m_cziPixelType), m_dataType, numComponents, m_pixelSize);
+    const int64_t dataPosition = entryHeader.filePosition + sizeof(SegmentHeader) + subblockHeader.metadataSize + subblockHeaderSize;
+    cv::Rect rect;
+    double zoom = 1.;
+    // dimensions missing in the sub-block have the single index 0
+    const size_t firstRange = m_dimensions.size();
+    m_dimensions.resize(firstRange + CZISubBlock::DimCount, DimensionRange{0, 1});
+    uint64_t order = 0;
+    int orderShift = 0;
     for (int dim = 0; dim < entryHeader.dimensionCount; ++dim)
     {
         const DimensionEntryDV& dimEntry = dimensionEntries[dim];
-        if (dimEntry.dimension[0] == 'X')
+        const char dimension = dimEntry.dimension[0];
+        if (dimension == 'X')
         {
-            m_rect.x = dimEntry.start;
-            m_rect.width = dimEntry.storedSize;
-            m_zoom = static_cast<double>(dimEntry.storedSize) / static_cast<double>(dimEntry.size);
+            rect.x = dimEntry.start;
+            rect.width = dimEntry.storedSize;
+            zoom = static_cast<double>(dimEntry.storedSize) / static_cast<double>(dimEntry.size);
         }
-        else if (dimEntry.dimension[0] == 'Y')
+        else if (dimension == 'Y')
         {
-            m_rect.y = dimEntry.start;
-            m_rect.height = dimEntry.storedSize;
+            rect.y = dimEntry.start;
+            rect.height = dimEntry.storedSize;
         }
         else
         {
-            if (dimEntry.dimension[0] == 'C')
-            {
-                m_channelIndex = static_cast<int>(m_dimensions.size());
-            }
-            else if (dimEntry.dimension[0] == 'Z')
+            uint64_t code = dimensionCode(dimension);
+            if (code < CZISubBlock::DimCount)
             {
-                m_zSliceIndex = static_cast<int>(m_dimensions.size());
+                m_dimensions[firstRange + code] = DimensionRange{ dimEntry.start, dimEntry.size };
             }
-            else if (dimEntry.dimension[0] == 'T')
+            else
             {
-                m_tFrameIndex = static_cast<int>(m_dimensions.size());
+                code = (dimension == 'M') ? DimensionCodeM : DimensionCodeUnknown;
             }
-            else if (dimEntry.dimension[0] == 'I')
+            if (orderShift + DimensionCodeBits < 64)
             {
-                m_illuminationIndex = static_cast<int>(m_dimensions.size());
+                order |= code << orderShift;
+                orderShift += DimensionCodeBits;
             }
-            else if (dimEntry.dimension[0] == 'B')
-            {
-                m_bAccusitionIndex = static_cast<int>(m_dimensions.size());
-            }
-            else if (dimEntry.dimension[0] == 'R')
-            {
-                m_rotationIndex = static_cast<int>(m_dimensions.size());
-            }
-            else if (dimEntry.dimension[0] == 'S')
-            {
-                m_sceneIndex = static_cast<int>(m_dimensions.size());
-            }
-            else if (dimEntry.dimension[0] == 'H')
-            {
-                m_hPhaseIndex = static_cast<int>(m_dimensions.size());
-            }
-            else if (dimEntry.dimension[0] == 'V')
-            {
-                m_viewIndex = static_cast<int>(m_dimensions.size());
-            }
-            Dimension dimension = { dimEntry.dimension[0], dimEntry.start , dimEntry.size};
-            m_dimensions.push_back(dimension);
         }
     }
-    m_planeSize = m_pixelSize * m_rect.width * m_rect.height;
+    order |= DimensionCodeEnd << orderShift;
+    m_rects.push_back(rect);
+    m_zooms.push_back(zoom);
+    m_dataPositions.push_back(dataPosition);
+    m_dataSizes.push_back(subblockHeader.dataSize);
+    m_pixelTypes.push_back(entryHeader.pixelType);
+    m_compressions.push_back(entryHeader.compression);
+    m_dimensionOrders.push_back(order);
+    return size() - 1;
+}
+
+void CZISubBlockTable::write(std::ostream& stream) const
+{
+    writeColumn(stream, m_rects);
+    writeColumn(stream, m_zooms);
+    writeColumn(stream, m_dataPositions);
+    writeColumn(stream, m_dataSizes);
+    writeColumn(stream, m_pixelTypes);
+    writeColumn(stream, m_compressions);
+    writeColumn(stream, m_dimensionOrders);
+    writeColumn(stream, m_dimensions);
+}
+
+bool CZISubBlockTable::read(std::istream& stream)
+{
+    uint64_t count = 0;
+    if (!stream.read(reinterpret_cast<char*>(&count), sizeof(count)))
+        return false;
+    stream.seekg(-static_cast<std::streamoff>(sizeof(count)), std::ios_base::cur);
+    const bool valid = readColumn(stream, m_rects, count) &&
+        readColumn(stream, m_zooms, count) &&
+        readColumn(stream, m_dataPositions, count) &&
+        readColumn(stream, m_dataSizes, count) &&
+        readColumn(stream, m_pixelTypes, count) &&
+        readColumn(stream, m_compressions, count) &&
+        readColumn(stream, m_dimensionOrders, count) &&
+        readColumn(stream, m_dimensions, count * CZISubBlock::DimCount);
+    if (!valid)
+    {
+        *this = CZISubBlockTable();
+    }
+    return valid;
 }
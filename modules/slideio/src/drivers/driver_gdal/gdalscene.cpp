@@ -131,6 +131,7 @@ void slideio::GDALScene::readResampledBlockChannels(const cv::Rect& blockRect, c
 {
     if(m_hFile==nullptr)
         throw std::runtime_error("GDALDriver: Invalid file header by raster reading operation");
+    std::lock_guard<std::mutex> lock(m_readMutex);
     const int numChannels = GDALGetRasterCount(m_hFile);
     const cv::Size imageSize = { GDALGetRasterXSize(m_hFile),GDALGetRasterYSize(m_hFile) };
     auto channelIndices = channelIndices_;
@@ -142,8 +143,9 @@ void slideio::GDALScene::readResampledBlockChannels(const cv::Rect& blockRect, c
             channelIndices[channelIndex] = channelIndex;
         }
     }
-    std::vector<cv::Mat> channelRasters;
-    channelRasters.reserve(channelIndices.size());
+    std::vector<GDALRasterBandH> bands;
+    bands.reserve(channelIndices.size());
+    int cvDt = -1;
     for (const auto& channelIndex : channelIndices)
     {
         GDALRasterBandH hBand = GDALGetRasterBand(m_hFile, channelIndex + 1);
@@ -157,27 +159,34 @@ void slideio::GDALScene::readResampledBlockChannels(const cv::Rect& blockRect, c
             throw std::runtime_error(
                 (boost::format("Unknown data type %1% of channel %2% of file %3%") % dt % channelIndex % m_filePath).str());
         }
-        const int cvDt = toOpencvType(dataType);
-        cv::Mat channelRaster; 
-        int channelType = CV_MAKETYPE(cvDt, 1);
-        channelRaster.create(blockSize, channelType);
+        const int channelDt = toOpencvType(dataType);
+        if(cvDt>=0 && channelDt!=cvDt)
+        {
+            throw std::runtime_error(
+                (boost::format("Channels of different data types cannot be read in one block from %1%") % m_filePath).str());
+        }
+        cvDt = channelDt;
+        bands.push_back(hBand);
+    }
+    if(bands.empty())
+        return;
+    // bands are read directly into the interleaved output, which may
+    // be a view of a larger buffer supplied by the caller
+    output.create(blockSize, CV_MAKETYPE(cvDt, static_cast<int>(bands.size())));
+    cv::Mat raster = output.getMat();
+    const int pixelSpace = static_cast<int>(raster.elemSize());
+    const int lineSpace = static_cast<int>(raster.step[0]);
+    for (size_t band = 0; band < bands.size(); ++band)
+    {
+        GDALRasterBandH hBand = bands[band];
         CPLErr err = GDALRasterIO(hBand, GF_Read,
             blockRect.x, blockRect.y,
             blockRect.width, blockRect.height,
-            channelRaster.data,
+            raster.data + band*raster.elemSize1(),
             blockSize.width, blockSize.height,
-            GDALGetRasterDataType(hBand), 0, 0);
-        channelRasters.push_back(channelRaster);
+            GDALGetRasterDataType(hBand), pixelSpace, lineSpace);
         if (err != CE_None)
             throw std::runtime_error(
-            (boost::format("Cannot read raster band %1% from %2%") % channelIndex % m_filePath).str());
-    }
-    if(channelRasters.size()>1)
-    {
-        cv::merge(channelRasters, output);
-    }
-    else if(channelRasters.size()==1)
-    {
-        channelRasters[0].copyTo(output);
+            (boost::format("Cannot read raster band %1% from %2%") % channelIndices[band] % m_filePath).str());
     }
 }
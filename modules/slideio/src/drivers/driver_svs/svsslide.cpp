@@ -5,6 +5,8 @@
 #include "opencv2/slideio/imagetools.hpp"
 #include "opencv2/slideio/svssmallscene.hpp"
 #include "opencv2/slideio/svstiledscene.hpp"
+#include "opencv2/slideio/tiffhandlepool.hpp"
+#include "opencv2/slideio/randomaccessfile.hpp"
 
 #include <boost/filesystem.hpp>
 
@@ -49,7 +51,12 @@ cv::Ptr<SVSSlide> SVSSlide::openFile(const std::string& filePath)
     if(!tiff)
         return slide;
     
+    // the pool owns the handle from now on and closes it
+    // when the last scene is released
+    cv::Ptr<TiffHandlePool> filePool(new TiffHandlePool(filePath, tiff));
     TiffTools::scanFile(tiff, directories);
+    // positional reader for tiles which can be decoded without libtiff
+    cv::Ptr<RandomAccessFile> file(new RandomAccessFile(filePath));
     std::vector<int> image;
     int thumbnail(-1), macro(-1), label(-1);
     image.push_back(0); //base image
@@ -82,25 +89,25 @@ cv::Ptr<SVSSlide> SVSSlide::openFile(const std::string& filePath)
             image_dirs.push_back(directories[index]);
         }
         cv::Ptr<Scene> scene(new SVSTiledScene(filePath,"Image",
-            image_dirs, tiff));
+            image_dirs, filePool, file));
         scenes.push_back(scene);
     }
     if(thumbnail>=0)
     {
         cv::Ptr<Scene> scene(new SVSSmallScene(filePath,"Thumbnail",
-            directories[thumbnail], tiff));
+            directories[thumbnail], filePool));
         scenes.push_back(scene);
     }
     if(label>=0)
     {
         cv::Ptr<Scene> scene(new SVSSmallScene(filePath,"Label",
-            directories[label], tiff));
+            directories[label], filePool));
         scenes.push_back(scene);
     }
     if(macro>=0)
     {
         cv::Ptr<Scene> scene(new SVSSmallScene(filePath,"Macro",
-            directories[macro], tiff));
+            directories[macro], filePool));
         scenes.push_back(scene);
     }
     slide.reset(new SVSSlide);
@@ -15,11 +15,11 @@ using namespace cv::slideio;
 SVSSmallScene::SVSSmallScene(const std::string& filePath,
     const std::string& name,
     const TiffDirectory& dir,
-    TIFF* hfile):
+    cv::Ptr<TiffHandlePool> filePool):
         SVSScene(filePath, name),
         m_directory(dir),
         m_dataType(DataType::DT_Unknown),
-        m_hFile(hfile)
+        m_filePool(filePool)
 {
     m_dataType = m_directory.dataType;
 
@@ -71,35 +71,43 @@ double SVSSmallScene::getMagnification() const
 void SVSSmallScene::readResampledBlockChannels(const cv::Rect& blockRect, const cv::Size& blockSize,
     const std::vector<int>& channelIndices, cv::OutputArray output)
 {
-    if (m_hFile == nullptr)
+    if (m_filePool.empty())
         throw std::runtime_error("SVSDriver: Invalid file header by raster reading operation");
+    TiffHandlePool::Lease hFile = m_filePool->lease(m_directory.ifdOffset);
 
-    cv::Mat wholeDirRaster;
+    cv::Mat dirRaster;
+    TiffTools::readStripedDir(hFile, m_directory, dirRaster);
+    const cv::Mat dirBlockRaster = dirRaster(blockRect);
     if(channelIndices.empty())
     {
-        TiffTools::readStripedDir(m_hFile, m_directory, wholeDirRaster);
+        cv::resize(dirBlockRaster, output, blockSize);
+        return;
+    }
+    // channels are picked from the block only. Without resampling
+    // they are written directly to the output.
+    const int numChannels = static_cast<int>(channelIndices.size());
+    const int type = CV_MAKETYPE(dirBlockRaster.depth(), numChannels);
+    const bool resample = blockSize!=blockRect.size();
+    cv::Mat blockRaster;
+    if(resample)
+    {
+        blockRaster.create(blockRect.size(), type);
     }
     else
     {
-        cv::Mat dirRaster;
-        TiffTools::readStripedDir(m_hFile, m_directory, dirRaster);
-        if(channelIndices.size()==1)
-        {
-            cv::extractChannel(dirRaster, wholeDirRaster, channelIndices[0]);
-        }
-        else
-        {
-            std::vector<cv::Mat> channelRasters;
-            channelRasters.reserve(channelIndices.size());
-            for (const auto& channelIndex : channelIndices)
-            {
-                cv::Mat channelRaster;
-                cv::extractChannel(dirRaster, channelRaster, channelIndex);
-                channelRasters.push_back(channelRaster);
-            }
-            cv::merge(channelRasters, wholeDirRaster);
-        }
+        output.create(blockSize, type);
+        blockRaster = output.getMat();
+    }
+    std::vector<int> fromTo;
+    fromTo.reserve(2*numChannels);
+    for(int channel = 0; channel < numChannels; ++channel)
+    {
+        fromTo.push_back(channelIndices[channel]);
+        fromTo.push_back(channel);
+    }
+    cv::mixChannels(&dirBlockRaster, 1, &blockRaster, 1, fromTo.data(), numChannels);
+    if(resample)
+    {
+        cv::resize(blockRaster, output, blockSize);
     }
-    cv::Mat blockRaster = wholeDirRaster(blockRect);
-    cv::resize(blockRaster, output, blockSize);
 }
@@ -7,16 +7,23 @@
 #include "opencv2/slideio/imagetools.hpp"
 #include "opencv2/slideio/svsscene.hpp"
 #include "opencv2/slideio/tools.hpp"
+#include "opencv2/slideio/tilecache.hpp"
+#include <boost/format.hpp>
+#include <cmath>
+#include <map>
 
 using namespace cv::slideio;
 
 SVSTiledScene::SVSTiledScene(const std::string& filePath,
     const std::string& name,
-    std::vector<TiffDirectory> dirs, TIFF* hfile):
+    std::vector<TiffDirectory> dirs, cv::Ptr<TiffHandlePool> filePool,
+    cv::Ptr<RandomAccessFile> file):
     slideio::SVSScene(filePath, name),
         m_directories(dirs),
         m_dataType(slideio::DataType::DT_Unknown),
-        m_hFile(hfile)
+        m_filePool(filePool),
+        m_file(file),
+        m_cacheScope(TileCache::makeScope(filePath))
 {
     auto& dir = m_directories[0];
     m_dataType = dir.dataType;
@@ -44,6 +51,12 @@ cv::Rect SVSTiledScene::getRect() const
     return rect;
 }
 
+SVSTiledScene::~SVSTiledScene()
+{
+    // cached tiles of the scene cannot be requested anymore
+    TileCache::instance().removeScope(m_cacheScope);
+}
+
 int SVSTiledScene::getNumChannels() const
 {
     const auto& dir = m_directories[0];
@@ -69,17 +82,171 @@ double SVSTiledScene::getMagnification() const
 void SVSTiledScene::readResampledBlockChannels(const cv::Rect& blockRect, const cv::Size& blockSize,
     const std::vector<int>& channelIndices, cv::OutputArray output)
 {
-    if (m_hFile == nullptr)
+    readComposedBlockChannels(blockRect, blockSize, channelIndices, ComposeMode::PerTile, output);
+}
+
+void SVSTiledScene::readComposedBlockChannels(const cv::Rect& blockRect, const cv::Size& blockSize,
+    const std::vector<int>& channelIndices, ComposeMode mode, cv::OutputArray output)
+{
+    if (m_filePool.empty())
+        throw std::runtime_error("SVSDriver: Invalid file header by raster reading operation");
+    TilerData tilerData;
+    cv::Rect resizedBlock;
+    prepareBlockRead(blockRect, blockSize, mode, tilerData, resizedBlock);
+    TileComposer::composeRect(this, channelIndices, resizedBlock, blockSize, output, &tilerData, mode);
+}
+
+void SVSTiledScene::readBlocks(const std::vector<cv::Rect>& blockRects, const cv::Size& blockSize,
+    const std::vector<int>& channelIndices, std::vector<cv::Mat>& outputs)
+{
+    if (m_filePool.empty())
         throw std::runtime_error("SVSDriver: Invalid file header by raster reading operation");
+    // blocks read from the same directory at the same scale share tiles
+    struct Batch
+    {
+        TilerData tilerData;
+        std::vector<int> blocks;
+        std::vector<cv::Rect> rects;
+        std::vector<cv::Size> sizes;
+    };
+    std::map<std::pair<int, int>, Batch> batches;
+    for(int block = 0; block < static_cast<int>(blockRects.size()); ++block)
+    {
+        const cv::Rect& blockRect = blockRects[block];
+        const cv::Size size = blockSize.area()>0 ? blockSize : blockRect.size();
+        TilerData tilerData;
+        cv::Rect resizedBlock;
+        prepareBlockRead(blockRect, size, ComposeMode::PerTile, tilerData, resizedBlock);
+        const int dirPosition = static_cast<int>(tilerData.dir - m_directories.data());
+        Batch& batch = batches[std::make_pair(dirPosition, tilerData.scaleDenom)];
+        batch.tilerData = tilerData;
+        batch.blocks.push_back(block);
+        batch.rects.push_back(resizedBlock);
+        batch.sizes.push_back(size);
+    }
+    outputs.resize(blockRects.size());
+    std::vector<cv::Mat> batchOutputs;
+    for(auto& item : batches)
+    {
+        Batch& batch = item.second;
+        TileComposer::composeRects(this, channelIndices, batch.rects, batch.sizes, batchOutputs, &batch.tilerData);
+        for(size_t index = 0; index < batch.blocks.size(); ++index)
+        {
+            outputs[batch.blocks[index]] = batchOutputs[index];
+        }
+    }
+}
+
+int SVSTiledScene::getNumLevels() const
+{
+    return static_cast<int>(m_directories.size());
+}
+
+const TiffDirectory& SVSTiledScene::getLevelDirectory(int level) const
+{
+    if(level<0 || level>=getNumLevels())
+    {
+        throw std::runtime_error(
+            (boost::format("SVSDriver: Invalid level index: %1%") % level).str());
+    }
+    return m_directories[level];
+}
+
+LevelInfo SVSTiledScene::getLevelInfo(int level) const
+{
+    const TiffDirectory& dir = getLevelDirectory(level);
+    LevelInfo info;
+    info.level = level;
+    info.size = cv::Size(dir.width, dir.height);
+    info.downsample = static_cast<double>(m_directories[0].width) / static_cast<double>(dir.width);
+    info.tileSize = cv::Size(dir.tileWidth, dir.tileHeight);
+    return info;
+}
+
+void SVSTiledScene::readLevelBlock(int level, const cv::Rect& blockRect, const std::vector<int>& channelIndices,
+    cv::OutputArray output)
+{
+    const TiffDirectory& dir = getLevelDirectory(level);
+    if (m_filePool.empty())
+        throw std::runtime_error("SVSDriver: Invalid file header by raster reading operation");
+    // tiles of the directory are copied without resampling
+    TilerData tilerData;
+    tilerData.dir = &dir;
+    tilerData.scaleDenom = 1;
+    TileComposer::composeRect(this, channelIndices, blockRect, blockRect.size(), output, &tilerData);
+}
+
+int SVSTiledScene::getLevelTileCount(int level) const
+{
+    const TiffDirectory& dir = getLevelDirectory(level);
+    const int tilesX = (dir.width - 1) / dir.tileWidth + 1;
+    const int tilesY = (dir.height - 1) / dir.tileHeight + 1;
+    return tilesX * tilesY;
+}
+
+cv::Rect SVSTiledScene::getLevelTileRect(int level, int tileIndex) const
+{
+    const TiffDirectory& dir = getLevelDirectory(level);
+    if(tileIndex<0 || tileIndex>=getLevelTileCount(level))
+    {
+        throw std::runtime_error(
+            (boost::format("SVSDriver: Invalid tile index %1% of level %2%") % tileIndex % level).str());
+    }
+    const int tilesX = (dir.width - 1) / dir.tileWidth + 1;
+    return cv::Rect((tileIndex % tilesX) * dir.tileWidth, (tileIndex / tilesX) * dir.tileHeight,
+        dir.tileWidth, dir.tileHeight);
+}
+
+bool SVSTiledScene::readEncodedTile(int level, int tileIndex, EncodedTile& tile)
+{
+    const TiffDirectory& dir = getLevelDirectory(level);
+    if(tileIndex<0 || tileIndex>=getLevelTileCount(level))
+    {
+        throw std::runtime_error(
+            (boost::format("SVSDriver: Invalid tile index %1% of level %2%") % tileIndex % level).str());
+    }
+    if(m_file.empty())
+        return false;
+    return TiffTools::readEncodedTile(*m_file, dir, tileIndex, tile);
+}
+
+int SVSTiledScene::alignBandEnd(int level, int levelRow) const
+{
+    // rows of tiles of the directory
+    const TiffDirectory& dir = getLevelDirectory(level);
+    const int tileRowHeight = std::max(1, dir.tileHeight);
+    return ((levelRow + tileRowHeight - 1) / tileRowHeight) * tileRowHeight;
+}
+
+void SVSTiledScene::prepareBlockRead(const cv::Rect& blockRect, const cv::Size& blockSize, ComposeMode mode,
+    TilerData& tilerData, cv::Rect& resizedBlock) const
+{
     double zoomX = static_cast<double>(blockSize.width) / static_cast<double>(blockRect.width);
     double zoomY = static_cast<double>(blockSize.height) / static_cast<double>(blockRect.height);
     double zoom = std::max(zoomX, zoomY);
     const slideio::TiffDirectory& dir = findZoomDirectory(zoom);
     double zoomDirX = static_cast<double>(dir.width) / static_cast<double>(m_directories[0].width); 
     double zoomDirY = static_cast<double>(dir.height) / static_cast<double>(m_directories[0].height);
-    cv::Rect resizedBlock;
     ImageTools::scaleRect(blockRect, zoomDirX, zoomDirY, resizedBlock);
-    TileComposer::composeRect(this, channelIndices, resizedBlock, blockSize, output, (void*)&dir);
+    const double relativeZoom = std::max(
+        static_cast<double>(blockSize.width) / static_cast<double>(resizedBlock.width),
+        static_cast<double>(blockSize.height) / static_cast<double>(resizedBlock.height));
+    tilerData.dir = &dir;
+    tilerData.scaleDenom = computeScaleDenom(dir, relativeZoom, mode);
+}
+
+int SVSTiledScene::computeScaleDenom(const TiffDirectory& dir, double relativeZoom, ComposeMode mode) const
+{
+    // single pass composition resamples tiles of the directory resolution
+    if(m_file.empty() || !TiffTools::canDecodeTileScaled(dir) || mode!=ComposeMode::PerTile)
+        return 1;
+    // the largest reduction still keeping the requested resolution
+    int scaleDenom = 1;
+    while(scaleDenom<8 && relativeZoom*(scaleDenom*2)<=1.)
+    {
+        scaleDenom *= 2;
+    }
+    return scaleDenom;
 }
 
 const TiffDirectory& SVSTiledScene::findZoomDirectory(double zoom) const
@@ -95,7 +262,7 @@ const TiffDirectory& SVSTiledScene::findZoomDirectory(double zoom) const
 
 int SVSTiledScene::getTileCount(void* userData)
 {
-    const TiffDirectory* dir = (const TiffDirectory*)userData;
+    const TiffDirectory* dir = reinterpret_cast<const TilerData*>(userData)->dir;
     int tilesX = (dir->width-1)/dir->tileWidth + 1;
     int tilesY = (dir->height-1)/dir->tileHeight + 1;
     return tilesX * tilesY;
@@ -103,7 +270,7 @@ int SVSTiledScene::getTileCount(void* userData)
 
 bool SVSTiledScene::getTileRect(int tileIndex, cv::Rect& tileRect, void* userData)
 {
-    const TiffDirectory* dir = (const TiffDirectory*)userData;
+    const TiffDirectory* dir = reinterpret_cast<const TilerData*>(userData)->dir;
     const int tilesX = (dir->width - 1) / dir->tileWidth + 1;
     const int tilesY = (dir->height - 1) / dir->tileHeight + 1;
     const int tileY = tileIndex / tilesX;
@@ -115,11 +282,66 @@ bool SVSTiledScene::getTileRect(int tileIndex, cv::Rect& tileRect, void* userDat
     return true;
 }
 
+void SVSTiledScene::getTilesInRect(const cv::Rect& rect, std::vector<int>& tileIndices, void* userData)
+{
+    // tiles of a tiff directory build a regular grid:
+    // compute the range of grid cells covered by the rectangle
+    const TiffDirectory* dir = reinterpret_cast<const TilerData*>(userData)->dir;
+    const int tilesX = (dir->width - 1) / dir->tileWidth + 1;
+    const int tilesY = (dir->height - 1) / dir->tileHeight + 1;
+    const cv::Rect gridRect(0, 0, tilesX * dir->tileWidth, tilesY * dir->tileHeight);
+    const cv::Rect coveredRect = rect & gridRect;
+    tileIndices.clear();
+    if(coveredRect.area() <= 0)
+        return;
+    const int firstTileX = coveredRect.x / dir->tileWidth;
+    const int firstTileY = coveredRect.y / dir->tileHeight;
+    const int lastTileX = (coveredRect.x + coveredRect.width - 1) / dir->tileWidth;
+    const int lastTileY = (coveredRect.y + coveredRect.height - 1) / dir->tileHeight;
+    tileIndices.reserve((lastTileX - firstTileX + 1) * (lastTileY - firstTileY + 1));
+    for(int tileY = firstTileY; tileY <= lastTileY; ++tileY)
+    {
+        for(int tileX = firstTileX; tileX <= lastTileX; ++tileX)
+        {
+            tileIndices.push_back(tileY * tilesX + tileX);
+        }
+    }
+}
+
 bool SVSTiledScene::readTile(int tileIndex, const std::vector<int>& channelIndices, cv::OutputArray tileRaster,
     void* userData)
 {
-    const TiffDirectory* dir = (const TiffDirectory*)userData;
-    TiffTools::readTile(m_hFile, *dir, tileIndex, channelIndices, tileRaster);
+    const TiffDirectory* dir = reinterpret_cast<const TilerData*>(userData)->dir;
+    const int scaleDenom = reinterpret_cast<const TilerData*>(userData)->scaleDenom;
+    if(!m_file.empty() && TiffTools::canReadTileDirectly(*dir))
+    {
+        // tile data is read by its stored offset
+        // without switching of libtiff directories
+        TiffTools::readTile(*m_file, *dir, tileIndex, channelIndices, tileRaster, scaleDenom);
+    }
+    else
+    {
+        TiffHandlePool::Lease hFile = m_filePool->lease(dir->ifdOffset);
+        TiffTools::readTile(hFile, *dir, tileIndex, channelIndices, tileRaster);
+    }
+    return true;
+}
+
+bool SVSTiledScene::supportsConcurrentReads(void*)
+{
+    // each read leases its own tiff handle
+    return true;
+}
+
+bool SVSTiledScene::hasDisjointTiles(void*)
+{
+    // tiles of a tiff directory form a regular grid
     return true;
 }
 
+std::string SVSTiledScene::getCacheScope(void* userData)
+{
+    const TiffDirectory* dir = reinterpret_cast<const TilerData*>(userData)->dir;
+    const int scaleDenom = reinterpret_cast<const TilerData*>(userData)->scaleDenom;
+    return m_cacheScope + "|" + std::to_string(dir->dirIndex) + "|" + std::to_string(scaleDenom);
+}
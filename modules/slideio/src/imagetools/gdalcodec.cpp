@@ -8,6 +8,8 @@
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
 #include <gdal/gdal.h>
+#include <gdal/cpl_vsi.h>
+#include <atomic>
 
 using namespace cv;
 
@@ -86,3 +88,49 @@ void slideio::ImageTools::readGDALImage(const std::string& filePath, cv::OutputA
         throw exp;
     }
 }
+
+void slideio::ImageTools::encodePngStream(const cv::Mat& raster, std::vector<uint8_t>& data)
+{
+    const int depth = raster.depth();
+    if(raster.empty() || (depth!=CV_8U && depth!=CV_16U) || raster.channels()>4)
+    {
+        throw std::runtime_error(
+            (boost::format("Unsupported raster for png encoding: depth %1%, channels %2%, size %3%x%4%")
+                % depth % raster.channels() % raster.cols % raster.rows).str());
+    }
+    GDALAllRegister();
+    GDALDriverH hMemDriver = GDALGetDriverByName("MEM");
+    GDALDriverH hPngDriver = GDALGetDriverByName("PNG");
+    if(hMemDriver==nullptr || hPngDriver==nullptr)
+        throw std::runtime_error("GDAL PNG driver is not available");
+    const GDALDataType dt = depth==CV_8U ? GDT_Byte : GDT_UInt16;
+    const int numChannels = raster.channels();
+    GDALDatasetH hMemFile = GDALCreate(hMemDriver, "", raster.cols, raster.rows, numChannels, dt, nullptr);
+    if(hMemFile==nullptr)
+        throw std::runtime_error("Cannot create GDAL memory dataset for png encoding");
+    // interleaved pixels of the raster are written to separate bands
+    CPLErr err = GDALDatasetRasterIO(hMemFile, GF_Write, 0, 0, raster.cols, raster.rows,
+        const_cast<uint8_t*>(raster.ptr<uint8_t>()), raster.cols, raster.rows, dt, numChannels, nullptr,
+        static_cast<int>(raster.elemSize()), static_cast<int>(raster.step[0]), static_cast<int>(raster.elemSize1()));
+    if(err!=CE_None)
+    {
+        GDALClose(hMemFile);
+        throw std::runtime_error("Cannot write raster to GDAL memory dataset");
+    }
+    static std::atomic<uint64_t> fileCounter(0);
+    const std::string memPath = (boost::format("/vsimem/slideio_%1%.png") % fileCounter++).str();
+    GDALDatasetH hPngFile = GDALCreateCopy(hPngDriver, memPath.c_str(), hMemFile, FALSE, nullptr, nullptr, nullptr);
+    GDALClose(hMemFile);
+    if(hPngFile==nullptr)
+    {
+        VSIUnlink(memPath.c_str());
+        throw std::runtime_error("Cannot encode raster to png stream");
+    }
+    GDALClose(hPngFile);
+    vsi_l_offset length = 0;
+    GByte* buffer = VSIGetMemFileBuffer(memPath.c_str(), &length, TRUE);
+    if(buffer==nullptr)
+        throw std::runtime_error("Cannot retrieve encoded png stream");
+    data.assign(buffer, buffer + length);
+    CPLFree(buffer);
+}
@@ -4,16 +4,38 @@
 #include "opencv2/slideio/imagetools.hpp"
 #include "opencv2/slideio.hpp"
 #include "opencv2/imgproc.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/core/hal/intrin.hpp"
 #include "opencv2/slideio/memory_stream.hpp"
+#include "opencv2/slideio/pooledallocator.hpp"
 
 #include <openjpeg.h>
 
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 
 using namespace cv;
 
+static std::atomic<int> jp2kDecoderThreads(1);
+static std::atomic<bool> jp2kFusedConversion(false);
+
+void slideio::ImageTools::setJp2KDecoderOptions(const Jp2KDecoderOptions& options)
+{
+    jp2kDecoderThreads = std::max(1, options.numThreads);
+    jp2kFusedConversion = options.fusedConversion;
+}
+
+slideio::ImageTools::Jp2KDecoderOptions slideio::ImageTools::getJp2KDecoderOptions()
+{
+    Jp2KDecoderOptions options;
+    options.numThreads = jp2kDecoderThreads.load();
+    options.fusedConversion = jp2kFusedConversion.load();
+    return options;
+}
+
 void slideio::ImageTools::readJp2KFile(const std::string& filePath, cv::OutputArray output)
 {
     auto fileSize = boost::filesystem::file_size(filePath);
@@ -73,11 +95,268 @@ static OPJ_CODEC_FORMAT getJP2KCodec(const std::vector<uint8_t>& data)
     return eCodecFormat;
 }
 
+static int ceilDivPow2(OPJ_UINT32 value, int power)
+{
+    return static_cast<int>((static_cast<uint64_t>(value) + (1ULL << power) - 1) >> power);
+}
+
+// converts a decoded component to the target type and size
+static void convertComponent(const opj_image_comp_t& component, int dt, const cv::Size& imageSize, cv::Mat& raster)
+{
+    // create a cv::Mat object with the buffer
+    cv::Mat compRaster32S(component.h, component.w, CV_MAKETYPE(CV_32S, 1), component.data);
+    // convert raster from 32 bit integer to the original type
+    cv::Mat compRaster;
+    compRaster.allocator = slideio::PooledMatAllocator::getAllocator();
+    compRaster32S.convertTo(compRaster, CV_MAKETYPE(dt,1));
+    // check if we need to resize the component
+    if(compRaster.size()!=imageSize)
+    {
+        // resize the component so it fits to the image size
+        raster.allocator = slideio::PooledMatAllocator::getAllocator();
+        cv::resize(compRaster, raster, imageSize);
+    }
+    else
+    {
+        raster = compRaster;
+    }
+}
+
+namespace
+{
+    // fixed point coefficients of cv::COLOR_YUV2RGB, the fused conversion is bit-exact with cvtColor
+    const int YUVShift = 14;
+    const int YUV2RGBCoeffs[] = {18678, -9519, -6472, 33292};
+
+    // Vectorized narrowing of 32 bit components. The functions return the number
+    // of processed pixels, the rest of the row is converted by the scalar loop.
+    template <typename T>
+    int narrowRow(const OPJ_INT32*, T*, int)
+    {
+        return 0;
+    }
+    template <typename T>
+    int narrowRowInterleaved3(const OPJ_INT32* const*, T*, int)
+    {
+        return 0;
+    }
+#if CV_SIMD
+    inline v_uint8 narrowU8(const OPJ_INT32* src)
+    {
+        const int step = v_int32::nlanes;
+        const v_int16 low = v_pack(vx_load(src), vx_load(src + step));
+        const v_int16 high = v_pack(vx_load(src + 2*step), vx_load(src + 3*step));
+        return v_pack_u(low, high);
+    }
+    inline v_uint16 narrowU16(const OPJ_INT32* src)
+    {
+        return v_pack_u(vx_load(src), vx_load(src + v_int32::nlanes));
+    }
+    template <>
+    int narrowRow<uint8_t>(const OPJ_INT32* src, uint8_t* dst, int width)
+    {
+        int x = 0;
+        for(; x <= width - v_uint8::nlanes; x += v_uint8::nlanes)
+            v_store(dst + x, narrowU8(src + x));
+        return x;
+    }
+    template <>
+    int narrowRow<uint16_t>(const OPJ_INT32* src, uint16_t* dst, int width)
+    {
+        int x = 0;
+        for(; x <= width - v_uint16::nlanes; x += v_uint16::nlanes)
+            v_store(dst + x, narrowU16(src + x));
+        return x;
+    }
+    template <>
+    int narrowRowInterleaved3<uint8_t>(const OPJ_INT32* const* src, uint8_t* dst, int width)
+    {
+        int x = 0;
+        for(; x <= width - v_uint8::nlanes; x += v_uint8::nlanes)
+            v_store_interleave(dst + 3*x, narrowU8(src[0] + x), narrowU8(src[1] + x), narrowU8(src[2] + x));
+        return x;
+    }
+    template <>
+    int narrowRowInterleaved3<uint16_t>(const OPJ_INT32* const* src, uint16_t* dst, int width)
+    {
+        int x = 0;
+        for(; x <= width - v_uint16::nlanes; x += v_uint16::nlanes)
+            v_store_interleave(dst + 3*x, narrowU16(src[0] + x), narrowU16(src[1] + x), narrowU16(src[2] + x));
+        return x;
+    }
+#endif
+
+    // Narrows 32 bit components to the target type, optionally converts SYCC to RGB
+    // and interleaves the requested channels into the output in a single pass.
+    // Single channel and three channel layouts are stored directly.
+    template <typename T>
+    class FusedComponentConverter : public cv::ParallelLoopBody
+    {
+    public:
+        FusedComponentConverter(const std::vector<const OPJ_INT32*>& components, bool yuv,
+            const std::vector<int>& channels, cv::Mat& output) :
+            m_components(components), m_yuv(yuv), m_channels(channels), m_output(output)
+        {
+            m_rgbOrder = channels.size()==3 && channels[0]==0 && channels[1]==1 && channels[2]==2;
+        }
+        void operator()(const cv::Range& range) const override
+        {
+            const int width = m_output.cols;
+            const int numChannels = static_cast<int>(m_channels.size());
+            for(int row = range.start; row < range.end; ++row)
+            {
+                const size_t offset = static_cast<size_t>(row)*width;
+                T* dst = m_output.ptr<T>(row);
+                if(m_yuv)
+                {
+                    convertYuvRow(offset, width, numChannels, dst);
+                }
+                else if(numChannels==1)
+                {
+                    const OPJ_INT32* src = m_components[0] + offset;
+                    int x = narrowRow<T>(src, dst, width);
+                    for(; x < width; ++x)
+                        dst[x] = cv::saturate_cast<T>(src[x]);
+                }
+                else if(numChannels==3)
+                {
+                    const OPJ_INT32* src[3] = {
+                        m_components[0] + offset, m_components[1] + offset, m_components[2] + offset };
+                    int x = narrowRowInterleaved3<T>(src, dst, width);
+                    for(T* pixel = dst + 3*x; x < width; ++x, pixel += 3)
+                    {
+                        pixel[0] = cv::saturate_cast<T>(src[0][x]);
+                        pixel[1] = cv::saturate_cast<T>(src[1][x]);
+                        pixel[2] = cv::saturate_cast<T>(src[2][x]);
+                    }
+                }
+                else
+                {
+                    for(int channel = 0; channel < numChannels; ++channel)
+                    {
+                        const OPJ_INT32* src = m_components[channel] + offset;
+                        T* channelDst = dst + channel;
+                        for(int x = 0; x < width; ++x, channelDst += numChannels)
+                            *channelDst = cv::saturate_cast<T>(src[x]);
+                    }
+                }
+            }
+        }
+    private:
+        void convertYuvRow(size_t offset, int width, int numChannels, T* dst) const
+        {
+            const int delta = 1 << (sizeof(T)*8 - 1);
+            const int half = 1 << (YUVShift - 1);
+            const OPJ_INT32* ySrc = m_components[0] + offset;
+            const OPJ_INT32* uSrc = m_components[1] + offset;
+            const OPJ_INT32* vSrc = m_components[2] + offset;
+            for(int x = 0; x < width; ++x, dst += numChannels)
+            {
+                const int y = cv::saturate_cast<T>(ySrc[x]);
+                const int u = static_cast<int>(cv::saturate_cast<T>(uSrc[x])) - delta;
+                const int v = static_cast<int>(cv::saturate_cast<T>(vSrc[x])) - delta;
+                const T r = cv::saturate_cast<T>(y + ((v*YUV2RGBCoeffs[0] + half) >> YUVShift));
+                const T g = cv::saturate_cast<T>(y + ((v*YUV2RGBCoeffs[1] + u*YUV2RGBCoeffs[2] + half) >> YUVShift));
+                const T b = cv::saturate_cast<T>(y + ((u*YUV2RGBCoeffs[3] + half) >> YUVShift));
+                if(m_rgbOrder)
+                {
+                    dst[0] = r;
+                    dst[1] = g;
+                    dst[2] = b;
+                }
+                else
+                {
+                    const T rgb[3] = {r, g, b};
+                    for(int channel = 0; channel < numChannels; ++channel)
+                        dst[channel] = rgb[m_channels[channel]];
+                }
+            }
+        }
+        const std::vector<const OPJ_INT32*>& m_components;
+        bool m_yuv;
+        bool m_rgbOrder;
+        const std::vector<int>& m_channels;
+        cv::Mat& m_output;
+    };
+}
+
+template <typename T>
+static void convertFused(const std::vector<const OPJ_INT32*>& components, bool yuv,
+    const std::vector<int>& channels, cv::Mat& output)
+{
+    FusedComponentConverter<T> converter(components, yuv, channels, output);
+    cv::parallel_for_(cv::Range(0, output.rows), converter);
+}
+
+// Converts decoded components straight into the interleaved output.
+// yuv: channels are indices of RGB channels, otherwise indices of components.
+// Returns false if the components do not fit the fused kernel (subsampled components,
+// unsupported types), the caller falls back to the plane by plane conversion.
+static bool convertComponentsFused(const opj_image_t* image, int dt, const cv::Size& imageSize,
+    bool yuv, const std::vector<int>& channelIndices, cv::OutputArray output)
+{
+    const int numComps = static_cast<int>(image->numcomps);
+    if(yuv && (numComps!=3 || (dt!=CV_8U && dt!=CV_16U)))
+        return false;
+    std::vector<int> channels(channelIndices);
+    if(channels.empty())
+    {
+        for(int channel = 0; channel < numComps; ++channel)
+            channels.push_back(channel);
+    }
+    std::vector<int> usedComponents;
+    if(yuv)
+        usedComponents = {0, 1, 2};
+    else
+        usedComponents = channels;
+    std::vector<const OPJ_INT32*> components;
+    for(const int componentIndex : usedComponents)
+    {
+        if(componentIndex<0 || componentIndex>=numComps)
+            return false;
+        const opj_image_comp_t& component = image->comps[componentIndex];
+        if(static_cast<int>(component.w)!=imageSize.width || static_cast<int>(component.h)!=imageSize.height
+            || component.data==nullptr)
+            return false;
+        components.push_back(component.data);
+    }
+    for(const int channel : channels)
+    {
+        if(channel<0 || channel>=(yuv ? 3 : numComps))
+            return false;
+    }
+    output.create(imageSize, CV_MAKETYPE(dt, static_cast<int>(channels.size())));
+    cv::Mat raster = output.getMat();
+    switch(dt)
+    {
+    case CV_8U:
+        convertFused<uint8_t>(components, yuv, channels, raster);
+        break;
+    case CV_8S:
+        convertFused<int8_t>(components, false, channels, raster);
+        break;
+    case CV_16U:
+        convertFused<uint16_t>(components, yuv, channels, raster);
+        break;
+    case CV_16S:
+        convertFused<int16_t>(components, false, channels, raster);
+        break;
+    case CV_32S:
+        convertFused<int32_t>(components, false, channels, raster);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
 void slideio::ImageTools::decodeJp2KStream(
     const std::vector<uint8_t>& data,
     cv::OutputArray output,
     const std::vector<int>& channelIndices,
-    bool forceYUV)
+    bool forceYUV,
+    int reduceFactor,
+    const cv::Rect& area)
 {
     opj_codec_t* codec(nullptr);
     opj_image_t* image(nullptr);
@@ -95,11 +374,63 @@ void slideio::ImageTools::decodeJp2KStream(
         if (!opj_setup_decoder(codec, &jp2dParams)){
             throw std::runtime_error("Cannot setup codec");
         }
+        const int numThreads = jp2kDecoderThreads.load();
+        if(numThreads>1 && opj_has_thread_support())
+        {
+            if(!opj_codec_set_threads(codec, numThreads))
+                throw std::runtime_error("Cannot set number of threads for Jp2K decoding");
+        }
         if(!opj_read_header(stream, codec, &image) || (image->numcomps == 0)){
             throw std::runtime_error("Error reading image header");
         }
         if(forceYUV)
             image->color_space = OPJ_CLRSPC_SYCC;
+        if(reduceFactor>0)
+        {
+            // the codestream cannot be reduced beyond its lowest resolution
+            opj_codestream_info_v2_t* info = opj_get_cstr_info(codec);
+            if(info)
+            {
+                const int numResolutions = static_cast<int>(info->m_default_tile_info.tccp_info[0].numresolutions);
+                reduceFactor = std::min(reduceFactor, numResolutions - 1);
+                opj_destroy_cstr_info(&info);
+            }
+            if(reduceFactor>0 && !opj_set_decoded_resolution_factor(codec, static_cast<OPJ_UINT32>(reduceFactor)))
+                throw std::runtime_error("Cannot set resolution factor for Jp2K decoding");
+        }
+        else
+        {
+            reduceFactor = 0;
+        }
+        if(area.area()>0)
+        {
+            // the area is defined relative to the image origin on the reference grid
+            const OPJ_INT32 x0 = static_cast<OPJ_INT32>(image->x0) + area.x;
+            const OPJ_INT32 y0 = static_cast<OPJ_INT32>(image->y0) + area.y;
+            if(!opj_set_decode_area(codec, image, x0, y0, x0 + area.width, y0 + area.height))
+                throw std::runtime_error("Cannot set decoding area for Jp2K stream");
+        }
+        std::vector<int> channels(channelIndices);
+        std::vector<int> componentIndices(channels);
+#if defined(OPJ_VERSION_MAJOR) && (OPJ_VERSION_MAJOR>2 || (OPJ_VERSION_MAJOR==2 && OPJ_VERSION_MINOR>=5))
+        // decode only requested components. Color conversion needs all of them.
+        if(!forceYUV && !channels.empty())
+        {
+            std::vector<OPJ_UINT32> decodedComponents(channels.begin(), channels.end());
+            std::sort(decodedComponents.begin(), decodedComponents.end());
+            decodedComponents.erase(std::unique(decodedComponents.begin(), decodedComponents.end()),
+                decodedComponents.end());
+            if(!opj_set_decoded_components(codec, static_cast<OPJ_UINT32>(decodedComponents.size()),
+                decodedComponents.data(), OPJ_FALSE))
+                throw std::runtime_error("Cannot set decoded components for Jp2K stream");
+            // decoded image contains the selected components only
+            for(int& componentIndex : componentIndices)
+            {
+                componentIndex = static_cast<int>(std::lower_bound(decodedComponents.begin(),
+                    decodedComponents.end(), static_cast<OPJ_UINT32>(componentIndex)) - decodedComponents.begin());
+            }
+        }
+#endif
         // decode the image
         OPJ_BOOL ret = opj_decode(codec, stream, image);
         if(!ret)
@@ -111,62 +442,62 @@ void slideio::ImageTools::decodeJp2KStream(
         opj_stream_destroy(stream);
         stream = nullptr;
 
-        const OPJ_UINT32 imageWidth = image->x1 - image->x0;
-        const OPJ_UINT32 imageHeight = image->y1 - image->y0;
+        const int imageWidth = ceilDivPow2(image->x1, reduceFactor) - ceilDivPow2(image->x0, reduceFactor);
+        const int imageHeight = ceilDivPow2(image->y1, reduceFactor) - ceilDivPow2(image->y0, reduceFactor);
         const OPJ_UINT32 numComps = image->numcomps;
         const int dt = getComponentDataType(image->comps);
+        const cv::Size imageSize(imageWidth, imageHeight);
 
-        output.create(imageHeight, imageWidth,CV_MAKETYPE(dt, image->numcomps));
-        const cv::Size imageSize(imageWidth, imageHeight); 
-
-        std::vector<cv::Mat> imagePlanes;
-        std::vector<int> channels(channelIndices);
-
-        for(OPJ_UINT32 channel=0; channel<numComps; channel++)
+        if(jp2kFusedConversion.load() &&
+            convertComponentsFused(image, dt, imageSize, forceYUV, forceYUV ? channels : componentIndices, output))
         {
-            const opj_image_comp& component = image->comps[channel];
-            // create a cv::Mat object with the buffer 
-            cv::Mat compRaster32S(component.h, component.w, CV_MAKETYPE(CV_32S, 1), component.data);
-            // convert raster from 32 bit integer to the original type
-            cv::Mat compRaster;
-            compRaster32S.convertTo(compRaster, CV_MAKETYPE(dt,1));
-            // check if we need to resize the component
-            if(component.w!=imageWidth || component.h!=imageHeight)
+            // components are converted and interleaved in a single pass
+        }
+        else if(forceYUV)
+        {
+            std::vector<cv::Mat> imagePlanes(numComps);
+            for(OPJ_UINT32 channel=0; channel<numComps; channel++)
+            {
+                convertComponent(image->comps[channel], dt, imageSize, imagePlanes[channel]);
+            }
+            cv::Mat cvImage, targetImage;
+            cvImage.allocator = targetImage.allocator = slideio::PooledMatAllocator::getAllocator();
+            cv::merge(imagePlanes, cvImage);
+            cv::cvtColor(cvImage, targetImage, cv::COLOR_YUV2RGB);
+            if(channels.empty())
             {
-                // resize the component so it fits to the image size
-                cv::Mat resized(imageSize.height, imageSize.width, CV_MAKETYPE(dt, 1));
-                cv::resize(compRaster, resized, imageSize);
-                imagePlanes.push_back(resized);
+                // if no channel is defined - return all channels
+                targetImage.copyTo(output);
             }
             else
             {
-                imagePlanes.push_back(compRaster);
+                std::vector<cv::Mat> targetChannels;
+                for(const int& channel : channels)
+                {
+                    cv::Mat channelRaster;
+                    channelRaster.allocator = slideio::PooledMatAllocator::getAllocator();
+                    cv::extractChannel(targetImage,channelRaster, channel);
+                    targetChannels.push_back(channelRaster);
+                }
+                cv::merge(targetChannels, output);
             }
         }
-        cv::Mat targetImage;
-        if(forceYUV)
-        {
-            cv::Mat cvImage;
-            cv::merge(imagePlanes, cvImage);
-            cv::cvtColor(cvImage, targetImage, cv::COLOR_YUV2RGB);
-        }
-        else
-        {
-            cv::merge(imagePlanes, targetImage);
-        }
-        if(channels.empty())
-        {
-            // if no channel is defined - return all channels
-            targetImage.copyTo(output);
-        }
         else
         {
-            std::vector<cv::Mat> targetChannels;
-            for(const int& channel : channels)
+            // convert only components required for the output
+            if(componentIndices.empty())
+            {
+                for(OPJ_UINT32 channel=0; channel<numComps; channel++)
+                    componentIndices.push_back(static_cast<int>(channel));
+            }
+            std::vector<cv::Mat> targetChannels(componentIndices.size());
+            for(size_t index=0; index<componentIndices.size(); ++index)
             {
-                cv::Mat channelRaster;
-                cv::extractChannel(targetImage,channelRaster, channel);
-                targetChannels.push_back(channelRaster);
+                const int componentIndex = componentIndices[index];
+                if(componentIndex<0 || componentIndex>=static_cast<int>(numComps))
+                    throw std::runtime_error(
+                        (boost::format("Invalid component index: %1%") % componentIndex).str());
+                convertComponent(image->comps[componentIndex], dt, imageSize, targetChannels[index]);
             }
             if(targetChannels.size()==1)
             {
@@ -0,0 +1,262 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+#include "opencv2/slideio/imagetools.hpp"
+#include "opencv2/slideio.hpp"
+#include "opencv2/core/utility.hpp"
+
+#include <boost/format.hpp>
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <jpeglib.h>
+
+using namespace cv;
+
+// libjpeg reports fatal errors through error_exit which must not return.
+// The handler jumps back to decodeJpegStream where the error is converted
+// to an exception.
+struct JpegErrorManager
+{
+    jpeg_error_mgr base;
+    jmp_buf jumpBuffer;
+    char message[JMSG_LENGTH_MAX];
+};
+
+static void jpegErrorExit(j_common_ptr cinfo)
+{
+    JpegErrorManager* errorManager = reinterpret_cast<JpegErrorManager*>(cinfo->err);
+    (*cinfo->err->format_message)(cinfo, errorManager->message);
+    longjmp(errorManager->jumpBuffer, 1);
+}
+
+static void jpegOutputMessage(j_common_ptr)
+{
+    // suppress printing of warnings to stderr
+}
+
+void slideio::ImageTools::decodeJpegStream(
+    const std::vector<uint8_t>& data,
+    cv::OutputArray output,
+    const std::vector<uint8_t>& tables,
+    bool colorConversion,
+    int scaleDenom)
+{
+    if(scaleDenom!=1 && scaleDenom!=2 && scaleDenom!=4 && scaleDenom!=8)
+    {
+        throw std::runtime_error(
+            (boost::format("JpegCodec: unsupported scale denominator: %1%") % scaleDenom).str());
+    }
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager errorManager;
+    cinfo.err = jpeg_std_error(&errorManager.base);
+    errorManager.base.error_exit = jpegErrorExit;
+    errorManager.base.output_message = jpegOutputMessage;
+    cv::Mat raster;
+    if(setjmp(errorManager.jumpBuffer))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        throw std::runtime_error(
+            (boost::format("JpegCodec: error by decoding of jpeg stream: %1%") % errorManager.message).str());
+    }
+    jpeg_create_decompress(&cinfo);
+    if(!tables.empty())
+    {
+        // abbreviated stream (e.g. tiff tiles): load quantization
+        // and huffman tables from a separate tables-only stream
+        jpeg_mem_src(&cinfo, const_cast<uint8_t*>(tables.data()), static_cast<unsigned long>(tables.size()));
+        jpeg_read_header(&cinfo, FALSE);
+    }
+    jpeg_mem_src(&cinfo, const_cast<uint8_t*>(data.data()), static_cast<unsigned long>(data.size()));
+    jpeg_read_header(&cinfo, TRUE);
+    if(!colorConversion)
+    {
+        // return components as they are stored in the stream
+        cinfo.jpeg_color_space = JCS_UNKNOWN;
+        cinfo.out_color_space = JCS_UNKNOWN;
+    }
+    // scaled decoding in the DCT domain
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = static_cast<unsigned int>(scaleDenom);
+    jpeg_start_decompress(&cinfo);
+    output.create(cinfo.output_height, cinfo.output_width, CV_MAKETYPE(CV_8U, cinfo.output_components));
+    raster = output.getMat();
+    while(cinfo.output_scanline < cinfo.output_height)
+    {
+        JSAMPROW row = raster.ptr<uint8_t>(cinfo.output_scanline);
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+}
+
+namespace
+{
+    // libjpeg compressor reused by the calls of a thread
+    struct JpegEncoder
+    {
+        jpeg_compress_struct cinfo;
+        JpegErrorManager errorManager;
+        // output buffer allocated by the memory destination
+        unsigned char* buffer{nullptr};
+        unsigned long bufferSize{0};
+        JpegEncoder()
+        {
+            cinfo.err = jpeg_std_error(&errorManager.base);
+            errorManager.base.error_exit = jpegErrorExit;
+            errorManager.base.output_message = jpegOutputMessage;
+            if(setjmp(errorManager.jumpBuffer))
+            {
+                throw std::runtime_error(
+                    (boost::format("JpegCodec: cannot create jpeg compressor: %1%") % errorManager.message).str());
+            }
+            jpeg_create_compress(&cinfo);
+        }
+        ~JpegEncoder()
+        {
+            jpeg_destroy_compress(&cinfo);
+        }
+        void releaseBuffer()
+        {
+            free(buffer);
+            buffer = nullptr;
+            bufferSize = 0;
+        }
+    };
+}
+
+// size of the minimum coded unit: 2x2 chroma subsampling
+// is used by default for color images
+static int jpegMcuSize(int channels)
+{
+    return channels==1 ? 8 : 16;
+}
+
+static void encodeJpegBand(const cv::Mat& raster, int quality, std::vector<uint8_t>& data)
+{
+    static thread_local JpegEncoder encoder;
+    jpeg_compress_struct& cinfo = encoder.cinfo;
+    if(setjmp(encoder.errorManager.jumpBuffer))
+    {
+        jpeg_abort_compress(&cinfo);
+        encoder.releaseBuffer();
+        throw std::runtime_error(
+            (boost::format("JpegCodec: error by encoding of jpeg stream: %1%") % encoder.errorManager.message).str());
+    }
+    jpeg_mem_dest(&cinfo, &encoder.buffer, &encoder.bufferSize);
+    cinfo.image_width = static_cast<JDIMENSION>(raster.cols);
+    cinfo.image_height = static_cast<JDIMENSION>(raster.rows);
+    cinfo.input_components = raster.channels();
+    cinfo.in_color_space = raster.channels()==1 ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while(cinfo.next_scanline < cinfo.image_height)
+    {
+        JSAMPROW row = const_cast<JSAMPROW>(raster.ptr<uint8_t>(cinfo.next_scanline));
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    data.assign(encoder.buffer, encoder.buffer + encoder.bufferSize);
+    encoder.releaseBuffer();
+}
+
+// Locates the frame header and the entropy coded data of a baseline stream
+// produced by encodeJpegBand.
+static void parseJpegBand(const std::vector<uint8_t>& band, size_t& sofPos, size_t& sosPos, size_t& dataPos)
+{
+    sofPos = sosPos = dataPos = 0;
+    size_t pos = 2;
+    while(pos + 4 <= band.size() && band[pos]==0xFF)
+    {
+        const uint8_t marker = band[pos + 1];
+        const size_t length = (static_cast<size_t>(band[pos + 2]) << 8) | band[pos + 3];
+        if(marker==0xC0)
+        {
+            sofPos = pos;
+        }
+        else if(marker==0xDA)
+        {
+            sosPos = pos;
+            dataPos = pos + 2 + length;
+            break;
+        }
+        pos += 2 + length;
+    }
+    if(sofPos==0 || sosPos==0 || dataPos + 2 > band.size()
+        || band[band.size() - 2]!=0xFF || band[band.size() - 1]!=0xD9)
+    {
+        throw std::runtime_error("JpegCodec: unexpected structure of encoded jpeg band");
+    }
+}
+
+void slideio::ImageTools::encodeJpegStream(const cv::Mat& raster, std::vector<uint8_t>& data, int quality)
+{
+    if(raster.depth()!=CV_8U || (raster.channels()!=1 && raster.channels()!=3))
+    {
+        throw std::runtime_error(
+            (boost::format("JpegCodec: unsupported raster type for jpeg encoding: depth %1%, channels %2%")
+                % raster.depth() % raster.channels()).str());
+    }
+    if(raster.empty() || raster.cols>JPEG_MAX_DIMENSION || raster.rows>JPEG_MAX_DIMENSION)
+    {
+        throw std::runtime_error(
+            (boost::format("JpegCodec: invalid raster size for jpeg encoding: %1%x%2%")
+                % raster.cols % raster.rows).str());
+    }
+    quality = std::max(1, std::min(quality, 100));
+    const int mcuSize = jpegMcuSize(raster.channels());
+    const int mcusPerRow = (raster.cols + mcuSize - 1) / mcuSize;
+    const int mcuRows = (raster.rows + mcuSize - 1) / mcuSize;
+    // restart interval is limited to 65535 units
+    const int MinBandMcuRows = 16;
+    const int MaxRestartInterval = 65535;
+    int numBands = std::min(cv::getNumThreads(), mcuRows / MinBandMcuRows);
+    if(numBands<=1 || mcusPerRow>MaxRestartInterval)
+    {
+        encodeJpegBand(raster, quality, data);
+        return;
+    }
+    const int bandMcuRows = std::min((mcuRows + numBands - 1) / numBands, MaxRestartInterval / mcusPerRow);
+    numBands = (mcuRows + bandMcuRows - 1) / bandMcuRows;
+    // bands are encoded independently, each of them makes a restart interval of the stream
+    std::vector<std::vector<uint8_t>> bands(numBands);
+    cv::parallel_for_(cv::Range(0, numBands), [&](const cv::Range& range)
+    {
+        for(int band = range.start; band < range.end; ++band)
+        {
+            const int rowBegin = band * bandMcuRows * mcuSize;
+            const int rowEnd = std::min(raster.rows, rowBegin + bandMcuRows * mcuSize);
+            encodeJpegBand(raster.rowRange(rowBegin, rowEnd), quality, bands[band]);
+        }
+    }, numBands);
+
+    size_t sofPos(0), sosPos(0), dataPos(0);
+    parseJpegBand(bands[0], sofPos, sosPos, dataPos);
+    const int restartInterval = bandMcuRows * mcusPerRow;
+    const uint8_t restartSegment[] = { 0xFF, 0xDD, 0x00, 0x04,
+        static_cast<uint8_t>(restartInterval >> 8), static_cast<uint8_t>(restartInterval & 0xFF) };
+    size_t streamSize = sizeof(restartSegment);
+    for(const auto& band : bands)
+    {
+        streamSize += band.size() + 2;
+    }
+    data.clear();
+    data.reserve(streamSize);
+    // headers of the first band with the height of the whole image
+    data.insert(data.end(), bands[0].begin(), bands[0].begin() + sosPos);
+    data[sofPos + 5] = static_cast<uint8_t>(raster.rows >> 8);
+    data[sofPos + 6] = static_cast<uint8_t>(raster.rows & 0xFF);
+    data.insert(data.end(), restartSegment, restartSegment + sizeof(restartSegment));
+    data.insert(data.end(), bands[0].begin() + sosPos, bands[0].end() - 2);
+    for(int band = 1; band < numBands; ++band)
+    {
+        parseJpegBand(bands[band], sofPos, sosPos, dataPos);
+        data.push_back(0xFF);
+        data.push_back(static_cast<uint8_t>(0xD0 + ((band - 1) & 7)));
+        data.insert(data.end(), bands[band].begin() + dataPos, bands[band].end() - 2);
+    }
+    data.push_back(0xFF);
+    data.push_back(0xD9);
+}
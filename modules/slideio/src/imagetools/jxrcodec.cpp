@@ -3,6 +3,7 @@
 // of this distribution and at http://opencv.org/license.html.
 #include "opencv2/slideio/imagetools.hpp"
 #include "opencv2/slideio.hpp"
+#include "opencv2/imgproc.hpp"
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
 #include <JXRGlue.h>
@@ -126,3 +127,77 @@ void slideio::ImageTools::readJxrImage(const std::string& path, cv::OutputArray
 
     cv::flip(raster, raster, 0);
 }
+
+// maps a JPEG XR pixel format to the OpenCV type of the decoded raster.
+// rgbOrder is set for color formats storing the red component first.
+static int jxrPixelFormatToCvType(const PKPixelFormatGUID& format, bool& rgbOrder)
+{
+    rgbOrder = IsEqualGUID(format, GUID_PKPixelFormat24bppRGB) || IsEqualGUID(format, GUID_PKPixelFormat48bppRGB)
+        || IsEqualGUID(format, GUID_PKPixelFormat32bppRGBA);
+    if(IsEqualGUID(format, GUID_PKPixelFormat8bppGray))
+        return CV_8UC1;
+    if(IsEqualGUID(format, GUID_PKPixelFormat16bppGray))
+        return CV_16UC1;
+    if(IsEqualGUID(format, GUID_PKPixelFormat24bppBGR) || IsEqualGUID(format, GUID_PKPixelFormat24bppRGB))
+        return CV_8UC3;
+    if(IsEqualGUID(format, GUID_PKPixelFormat48bppRGB))
+        return CV_16UC3;
+    if(IsEqualGUID(format, GUID_PKPixelFormat32bppBGRA) || IsEqualGUID(format, GUID_PKPixelFormat32bppRGBA))
+        return CV_8UC4;
+    if(IsEqualGUID(format, GUID_PKPixelFormat32bppGrayFloat))
+        return CV_32FC1;
+    return -1;
+}
+
+void slideio::ImageTools::decodeJxrStream(const uint8_t* data, size_t size, cv::OutputArray output)
+{
+    struct WMPStream* stream = nullptr;
+    ERR err = CreateWS_Memory(&stream, const_cast<uint8_t*>(data), size);
+    if(err!=WMP_errSuccess)
+    {
+        throw std::runtime_error(
+            (boost::format("JxrDecoder: cannot create memory stream. Error code: %1%") % err).str());
+    }
+    JxrObjectKeeper<PKImageDecode> decoder(nullptr);
+    err = PKImageDecode_Create_WMP(&decoder.object());
+    if(err==WMP_errSuccess)
+    {
+        err = decoder->Initialize(decoder, stream);
+    }
+    if(err!=WMP_errSuccess)
+    {
+        // the decoder does not own the stream
+        stream->Close(&stream);
+        throw std::runtime_error(
+            (boost::format("JxrDecoder: cannot initialize decoder. Error code: %1%") % err).str());
+    }
+    bool rgbOrder = false;
+    const int cvType = jxrPixelFormatToCvType(decoder->guidPixFormat, rgbOrder);
+    if(cvType<0)
+    {
+        stream->Close(&stream);
+        throw std::runtime_error("JxrDecoder: unsupported pixel format");
+    }
+    decoder->WMP.wmiI.cROILeftX = 0;
+    decoder->WMP.wmiI.cROITopY = 0;
+    decoder->WMP.wmiI.cROIWidth = decoder->WMP.wmiI.cWidth;
+    decoder->WMP.wmiI.cROIHeight = decoder->WMP.wmiI.cHeight;
+    PKRect rect = {0, 0, 0, 0};
+    rect.Width = static_cast<I32>(decoder->uWidth);
+    rect.Height = static_cast<I32>(decoder->uHeight);
+
+    output.create(rect.Height, rect.Width, cvType);
+    cv::Mat raster = output.getMat();
+    err = decoder->Copy(decoder, &rect, raster.data, static_cast<U32>(raster.step[0]));
+    stream->Close(&stream);
+    if(err!=WMP_errSuccess)
+    {
+        throw std::runtime_error(
+            (boost::format("JxrDecoder: error by decoding of the stream. Error code: %1%") % err).str());
+    }
+    if(rgbOrder)
+    {
+        // color rasters keep the BGR(A) order of OpenCV and CZI pixel types
+        cv::cvtColor(raster, raster, raster.channels()==4 ? cv::COLOR_RGBA2BGRA : cv::COLOR_RGB2BGR);
+    }
+}
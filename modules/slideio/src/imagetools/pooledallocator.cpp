@@ -0,0 +1,224 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+#include "opencv2/slideio/pooledallocator.hpp"
+#include <atomic>
+#include <vector>
+
+using namespace cv;
+
+namespace
+{
+    // size classes 2^MinClassBits ... 2^MaxClassBits bytes
+    const int MinClassBits = 12;
+    const int MaxClassBits = 26;
+    const int NumClasses = MaxClassBits - MinClassBits + 1;
+
+    std::atomic<bool> poolEnabled(true);
+    std::atomic<size_t> threadCapacity(slideio::PooledMatAllocator::DefaultThreadCapacity);
+    std::atomic<size_t> processCapacity(slideio::PooledMatAllocator::DefaultCapacity);
+    std::atomic<uint64_t> allocationCount(0);
+    std::atomic<uint64_t> reuseCount(0);
+    std::atomic<uint64_t> discardCount(0);
+    std::atomic<size_t> cachedMemory(0);
+
+    // free lists of a thread
+    struct ThreadCache
+    {
+        std::vector<void*> buffers[NumClasses];
+        size_t memory{0};
+        ~ThreadCache();
+    };
+
+    // thread caches may be requested by deallocations after their destruction
+    thread_local bool threadCacheDestroyed = false;
+
+    ThreadCache::~ThreadCache()
+    {
+        for(int sizeClass = 0; sizeClass < NumClasses; ++sizeClass)
+        {
+            for(void* buffer : buffers[sizeClass])
+            {
+                cv::fastFree(buffer);
+            }
+        }
+        cachedMemory -= memory;
+        threadCacheDestroyed = true;
+    }
+
+    ThreadCache* getThreadCache()
+    {
+        if(threadCacheDestroyed)
+            return nullptr;
+        static thread_local ThreadCache cache;
+        return &cache;
+    }
+
+    // returns the class of the buffer size, -1 for buffers allocated directly
+    int sizeClassOf(size_t size)
+    {
+        int sizeClass = 0;
+        while(sizeClass < NumClasses && (static_cast<size_t>(1) << (MinClassBits + sizeClass)) < size)
+        {
+            ++sizeClass;
+        }
+        return sizeClass < NumClasses ? sizeClass : -1;
+    }
+
+    size_t classSize(int sizeClass)
+    {
+        return static_cast<size_t>(1) << (MinClassBits + sizeClass);
+    }
+
+    uchar* acquireBuffer(size_t size)
+    {
+        const int sizeClass = sizeClassOf(size);
+        if(sizeClass<0)
+            return static_cast<uchar*>(cv::fastMalloc(size));
+        ++allocationCount;
+        ThreadCache* cache = getThreadCache();
+        if(cache!=nullptr && !cache->buffers[sizeClass].empty())
+        {
+            void* buffer = cache->buffers[sizeClass].back();
+            cache->buffers[sizeClass].pop_back();
+            cache->memory -= classSize(sizeClass);
+            cachedMemory -= classSize(sizeClass);
+            ++reuseCount;
+            return static_cast<uchar*>(buffer);
+        }
+        return static_cast<uchar*>(cv::fastMalloc(classSize(sizeClass)));
+    }
+
+    void releaseBuffer(uchar* buffer, size_t size)
+    {
+        const int sizeClass = sizeClassOf(size);
+        if(sizeClass>=0)
+        {
+            ThreadCache* cache = getThreadCache();
+            const size_t bufferSize = classSize(sizeClass);
+            if(cache!=nullptr && cache->memory + bufferSize <= threadCapacity.load())
+            {
+                // reserve the buffer in the budget of the process
+                if(cachedMemory.fetch_add(bufferSize) + bufferSize <= processCapacity.load())
+                {
+                    cache->buffers[sizeClass].push_back(buffer);
+                    cache->memory += bufferSize;
+                    return;
+                }
+                cachedMemory -= bufferSize;
+            }
+            ++discardCount;
+        }
+        cv::fastFree(buffer);
+    }
+}
+
+slideio::PooledMatAllocator& slideio::PooledMatAllocator::instance()
+{
+    // never destroyed: matrices may be released during static destruction
+    static PooledMatAllocator* allocator = new PooledMatAllocator;
+    return *allocator;
+}
+
+cv::MatAllocator* slideio::PooledMatAllocator::getAllocator()
+{
+    return poolEnabled.load() ? &instance() : nullptr;
+}
+
+void slideio::PooledMatAllocator::setEnabled(bool enabled)
+{
+    poolEnabled = enabled;
+}
+
+bool slideio::PooledMatAllocator::isEnabled()
+{
+    return poolEnabled.load();
+}
+
+void slideio::PooledMatAllocator::setThreadCapacity(size_t capacity)
+{
+    threadCapacity = capacity;
+}
+
+size_t slideio::PooledMatAllocator::getThreadCapacity() const
+{
+    return threadCapacity.load();
+}
+
+void slideio::PooledMatAllocator::setCapacity(size_t capacity)
+{
+    processCapacity = capacity;
+}
+
+size_t slideio::PooledMatAllocator::getCapacity() const
+{
+    return processCapacity.load();
+}
+
+slideio::PooledMatAllocator::Statistics slideio::PooledMatAllocator::getStatistics() const
+{
+    Statistics statistics;
+    statistics.allocations = allocationCount.load();
+    statistics.reuses = reuseCount.load();
+    statistics.discards = discardCount.load();
+    statistics.cachedMemory = cachedMemory.load();
+    return statistics;
+}
+
+void slideio::PooledMatAllocator::resetStatistics()
+{
+    allocationCount = 0;
+    reuseCount = 0;
+    discardCount = 0;
+}
+
+cv::UMatData* slideio::PooledMatAllocator::allocate(int dims, const int* sizes, int type, void* data0,
+    size_t* step, cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    // layout computation of the standard allocator
+    size_t total = CV_ELEM_SIZE(type);
+    for(int dim = dims - 1; dim >= 0; dim--)
+    {
+        if(step)
+        {
+            if(data0 && step[dim]!=CV_AUTOSTEP)
+            {
+                CV_Assert(total <= step[dim]);
+                total = step[dim];
+            }
+            else
+            {
+                step[dim] = total;
+            }
+        }
+        total *= sizes[dim];
+    }
+    uchar* data = data0 ? static_cast<uchar*>(data0) : acquireBuffer(total);
+    cv::UMatData* u = new cv::UMatData(this);
+    u->data = u->origdata = data;
+    u->size = total;
+    if(data0)
+    {
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+    }
+    return u;
+}
+
+bool slideio::PooledMatAllocator::allocate(cv::UMatData* u, cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    return u!=nullptr;
+}
+
+void slideio::PooledMatAllocator::deallocate(cv::UMatData* u) const
+{
+    if(!u)
+        return;
+    CV_Assert(u->urefcount==0);
+    CV_Assert(u->refcount==0);
+    if(!(u->flags & cv::UMatData::USER_ALLOCATED))
+    {
+        releaseBuffer(u->origdata, u->size);
+        u->origdata = nullptr;
+    }
+    delete u;
+}
@@ -0,0 +1,186 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+#include "opencv2/slideio/randomaccessfile.hpp"
+#include <boost/format.hpp>
+#if defined(WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#endif
+
+using namespace cv;
+
+#if defined(WIN32)
+
+slideio::RandomAccessFile::RandomAccessFile(const std::string& filePath) : m_filePath(filePath), m_size(0),
+    m_mappedData(nullptr), m_handle(nullptr), m_mapping(nullptr)
+{
+    HANDLE handle = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if(handle == INVALID_HANDLE_VALUE)
+    {
+        throw std::runtime_error(
+            (boost::format("RandomAccessFile: cannot open file %1%") % filePath).str());
+    }
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(handle, &size))
+    {
+        CloseHandle(handle);
+        throw std::runtime_error(
+            (boost::format("RandomAccessFile: cannot query size of file %1%") % filePath).str());
+    }
+    m_size = static_cast<uint64_t>(size.QuadPart);
+    m_handle = handle;
+}
+
+slideio::RandomAccessFile::~RandomAccessFile()
+{
+    unmap();
+    if(m_handle)
+    {
+        CloseHandle(static_cast<HANDLE>(m_handle));
+    }
+}
+
+bool slideio::RandomAccessFile::map()
+{
+    if(m_mappedData)
+        return true;
+    if(m_size == 0 || sizeof(void*) < 8)
+        return false;
+    HANDLE mapping = CreateFileMappingA(static_cast<HANDLE>(m_handle), nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(!mapping)
+        return false;
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!data)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    m_mapping = mapping;
+    m_mappedData = static_cast<uint8_t*>(data);
+    return true;
+}
+
+void slideio::RandomAccessFile::unmap()
+{
+    if(m_mappedData)
+    {
+        UnmapViewOfFile(m_mappedData);
+        m_mappedData = nullptr;
+    }
+    if(m_mapping)
+    {
+        CloseHandle(static_cast<HANDLE>(m_mapping));
+        m_mapping = nullptr;
+    }
+}
+
+void slideio::RandomAccessFile::read(uint64_t position, size_t size, void* buffer) const
+{
+    uint8_t* dest = static_cast<uint8_t*>(buffer);
+    while(size > 0)
+    {
+        // ReadFile with an explicit offset does not depend on the file pointer
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(position & 0xFFFFFFFF);
+        overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+        const DWORD chunk = static_cast<DWORD>(size > 0x40000000 ? 0x40000000 : size);
+        DWORD readBytes = 0;
+        if(!ReadFile(static_cast<HANDLE>(m_handle), dest, chunk, &readBytes, &overlapped) || readBytes == 0)
+        {
+            throw std::runtime_error(
+                (boost::format("RandomAccessFile: error reading %1% bytes at position %2% of file %3%")
+                    % size % position % m_filePath).str());
+        }
+        dest += readBytes;
+        position += readBytes;
+        size -= readBytes;
+    }
+}
+
+#else
+
+slideio::RandomAccessFile::RandomAccessFile(const std::string& filePath) : m_filePath(filePath), m_size(0),
+    m_mappedData(nullptr), m_handle(-1)
+{
+    const int handle = ::open(filePath.c_str(), O_RDONLY);
+    if(handle < 0)
+    {
+        throw std::runtime_error(
+            (boost::format("RandomAccessFile: cannot open file %1%") % filePath).str());
+    }
+    struct stat fileStat;
+    if(::fstat(handle, &fileStat) != 0)
+    {
+        ::close(handle);
+        throw std::runtime_error(
+            (boost::format("RandomAccessFile: cannot query size of file %1%") % filePath).str());
+    }
+    m_size = static_cast<uint64_t>(fileStat.st_size);
+    m_handle = handle;
+}
+
+slideio::RandomAccessFile::~RandomAccessFile()
+{
+    unmap();
+    if(m_handle >= 0)
+    {
+        ::close(m_handle);
+    }
+}
+
+bool slideio::RandomAccessFile::map()
+{
+    if(m_mappedData)
+        return true;
+    if(m_size == 0 || sizeof(void*) < 8)
+        return false;
+    void* data = ::mmap(nullptr, static_cast<size_t>(m_size), PROT_READ, MAP_SHARED, m_handle, 0);
+    if(data == MAP_FAILED)
+        return false;
+    m_mappedData = static_cast<uint8_t*>(data);
+    return true;
+}
+
+void slideio::RandomAccessFile::unmap()
+{
+    if(m_mappedData)
+    {
+        ::munmap(m_mappedData, static_cast<size_t>(m_size));
+        m_mappedData = nullptr;
+    }
+}
+
+void slideio::RandomAccessFile::read(uint64_t position, size_t size, void* buffer) const
+{
+    uint8_t* dest = static_cast<uint8_t*>(buffer);
+    while(size > 0)
+    {
+        const ssize_t readBytes = ::pread(m_handle, dest, size, static_cast<off_t>(position));
+        if(readBytes < 0 && errno == EINTR)
+            continue;
+        if(readBytes <= 0)
+        {
+            throw std::runtime_error(
+                (boost::format("RandomAccessFile: error reading %1% bytes at position %2% of file %3%")
+                    % size % position % m_filePath).str());
+        }
+        dest += readBytes;
+        position += static_cast<uint64_t>(readBytes);
+        size -= static_cast<size_t>(readBytes);
+    }
+}
+
+#endif
+
+void slideio::RandomAccessFile::read(uint64_t position, size_t size, std::vector<uint8_t>& data) const
+{
+    data.resize(size);
+    read(position, size, data.data());
+}
@@ -0,0 +1,95 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+#include "opencv2/slideio/tiffhandlepool.hpp"
+#include "opencv2/slideio/tifftools.hpp"
+#include <tiffio.h>
+#include <algorithm>
+#include <iterator>
+
+using namespace cv;
+
+slideio::TiffHandlePool::Lease::~Lease()
+{
+    if(m_handle)
+    {
+        m_pool->release(m_handle);
+    }
+}
+
+slideio::TiffHandlePool::TiffHandlePool(const std::string& filePath, TIFF* handle, int maxIdleHandles) :
+    m_filePath(filePath),
+    m_maxIdleHandles(static_cast<size_t>(std::max(1, maxIdleHandles>0 ? maxIdleHandles : cv::getNumberOfCPUs())))
+{
+    if(handle)
+    {
+        m_idleHandles.push_back(handle);
+    }
+}
+
+slideio::TiffHandlePool::~TiffHandlePool()
+{
+    for(TIFF* handle : m_idleHandles)
+    {
+        TiffTools::closeTiffFile(handle);
+    }
+}
+
+slideio::TiffHandlePool::Lease slideio::TiffHandlePool::lease(int64 ifdOffset)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(!m_idleHandles.empty())
+        {
+            // a handle already positioned on the directory, the most recently released one otherwise
+            auto itHandle = m_idleHandles.end() - 1;
+            if(ifdOffset>0)
+            {
+                const auto itPositioned = std::find_if(m_idleHandles.rbegin(), m_idleHandles.rend(),
+                    [ifdOffset](TIFF* handle)
+                    {
+                        return static_cast<int64>(TIFFCurrentDirOffset(handle))==ifdOffset;
+                    });
+                if(itPositioned!=m_idleHandles.rend())
+                {
+                    itHandle = std::prev(itPositioned.base());
+                }
+            }
+            TIFF* handle = *itHandle;
+            m_idleHandles.erase(itHandle);
+            return Lease(this, handle);
+        }
+    }
+    // all handles are in use: open a new one outside of the lock
+    TIFF* handle = TiffTools::openTiffFile(m_filePath);
+    if(handle == nullptr)
+    {
+        throw std::runtime_error(std::string("TiffTools: cannot open tiff file ") + m_filePath);
+    }
+    return Lease(this, handle);
+}
+
+void slideio::TiffHandlePool::release(TIFF* handle)
+{
+    TIFF* evicted(nullptr);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_idleHandles.size()>=m_maxIdleHandles)
+        {
+            // the least recently released handle is closed
+            evicted = m_idleHandles.front();
+            m_idleHandles.erase(m_idleHandles.begin());
+        }
+        m_idleHandles.push_back(handle);
+    }
+    if(evicted)
+    {
+        TiffTools::closeTiffFile(evicted);
+    }
+}
+
+int slideio::TiffHandlePool::getIdleHandleCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<int>(m_idleHandles.size());
+}
@@ -3,6 +3,7 @@
 // of this distribution and at http://opencv.org/license.html.
 #include "opencv2/slideio/tifftools.hpp"
 #include "opencv2/slideio/imagetools.hpp"
+#include "opencv2/slideio/pooledallocator.hpp"
 #include "opencv2/slideio.hpp"
 #include "opencv2/core.hpp"
 #include <boost/format.hpp>
@@ -47,6 +48,36 @@ static slideio::DataType dataTypeFromTIFFDataType(TIFFDataType dt)
     }
 }
 
+static void extractTileChannels(const cv::Mat& tileRaster, const std::vector<int>& channelIndices, cv::OutputArray output)
+{
+    if(channelIndices.empty())
+    {
+        tileRaster.copyTo(output);
+    }
+    else if(channelIndices.size()==1)
+    {
+        cv::extractChannel(tileRaster, output, channelIndices[0]);
+    }
+    else
+    {
+        std::vector<cv::Mat> channelRasters;
+        channelRasters.reserve(channelIndices.size());
+        for(int channelIndex : channelIndices)
+        {
+            cv::Mat channelRaster;
+            channelRaster.allocator = slideio::PooledMatAllocator::getAllocator();
+            cv::extractChannel(tileRaster, channelRaster, channelIndex);
+            channelRasters.push_back(channelRaster);
+        }
+        cv::merge(channelRasters, output);
+    }
+}
+
+static bool isJ2KCompression(uint32_t compression)
+{
+    return compression==34712 || compression==33003;
+}
+
 TIFF* slideio::TiffTools::openTiffFile(const std::string& path)
 {
     namespace fs = boost::filesystem;
@@ -65,23 +96,23 @@ void slideio::TiffTools::closeTiffFile(TIFF* file)
     TIFFClose(file);
 }
 
-void  slideio::TiffTools::scanTiffDirTags(TIFF* tiff, int dirIndex, int64_t dirOffset, slideio::TiffDirectory& dir)
+// reads tags of the current directory of the file
+static void readDirectoryTags(TIFF* tiff, int dirIndex, int64_t dirOffset, slideio::TiffDirectory& dir)
 {
-    TIFFSetDirectory(tiff, static_cast<short>(dirIndex));
-    if(dirOffset)
-        TIFFSetSubDirectory(tiff, dirOffset);
-
     dir.dirIndex = dirIndex;
     dir.offset = dirOffset;
+    dir.ifdOffset = static_cast<int64>(TIFFCurrentDirOffset(tiff));
 
     char *description(nullptr);
     short dirchnls(0), dirbits(0);
     uint16_t compress(0);
+    uint16_t photometric(0);
     short  planar_config(0);
     int width(0), height(0), tile_width(0), tile_height(0);
     TIFFGetField(tiff, TIFFTAG_SAMPLESPERPIXEL, &dirchnls);
     TIFFGetField(tiff, TIFFTAG_BITSPERSAMPLE, &dirbits);
     TIFFGetField(tiff, TIFFTAG_COMPRESSION, &compress);
+    TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photometric);
     TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
     TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
     TIFFGetField(tiff,TIFFTAG_TILEWIDTH ,&tile_width);
@@ -127,49 +158,101 @@ void  slideio::TiffTools::scanTiffDirTags(TIFF* tiff, int dirIndex, int64_t dirO
     dir.tiled = tiled;
     dir.compression = compress;
     dir.rowsPerStrip = rowsPerStripe;
-    
-    
+    dir.photometric = photometric;
+    dir.tileOffsets.clear();
+    dir.tileByteCounts.clear();
+    dir.jpegTables.clear();
+    if(tiled)
+    {
+        const size_t numTiles = TIFFNumberOfTiles(tiff);
+        uint64_t* tileOffsets(nullptr);
+        uint64_t* tileByteCounts(nullptr);
+        if(TIFFGetField(tiff, TIFFTAG_TILEOFFSETS, &tileOffsets) &&
+            TIFFGetField(tiff, TIFFTAG_TILEBYTECOUNTS, &tileByteCounts))
+        {
+            dir.tileOffsets.assign(tileOffsets, tileOffsets + numTiles);
+            dir.tileByteCounts.assign(tileByteCounts, tileByteCounts + numTiles);
+        }
+    }
+    uint32_t jpegTablesSize(0);
+    void* jpegTables(nullptr);
+    if(compress==COMPRESSION_JPEG &&
+        TIFFGetField(tiff, TIFFTAG_JPEGTABLES, &jpegTablesSize, &jpegTables) &&
+        jpegTablesSize>0)
+    {
+        const uint8_t* tables = static_cast<const uint8_t*>(jpegTables);
+        dir.jpegTables.assign(tables, tables + jpegTablesSize);
+    }
 }
 
-void slideio::TiffTools::scanTiffDir(TIFF* tiff, int dirIndex, int64_t dirOffset, slideio::TiffDirectory& dir)
+// offsets of sub-directories of the current directory
+static void readSubDirectoryOffsets(TIFF* tiff, std::vector<int64>& offsets)
 {
-    TIFFSetDirectory(tiff, (short)dirIndex);
-    if(dirOffset>0)
-        TIFFSetSubDirectory(tiff, dirOffset);
-
-    dir.dirIndex = dirIndex;
-    dir.offset = dirOffset;
+    offsets.clear();
+    uint16 subdirs(0);
+    uint64* offsetsRaw(nullptr);
+    if(TIFFGetField(tiff, TIFFTAG_SUBIFD, &subdirs, &offsetsRaw) && offsetsRaw)
+    {
+        offsets.assign(offsetsRaw, offsetsRaw + subdirs);
+    }
+}
 
-    scanTiffDirTags(tiff, dirIndex, dirOffset, dir);
-    dir.offset = 0;
-    long subdirs(0);
-    int64 *offsets_raw(nullptr);
-    if(TIFFGetField(tiff, TIFFTAG_SUBIFD, &subdirs, &offsets_raw))
+// reads sub-directories of a directory. Changes the current directory.
+static void scanSubDirectories(TIFF* tiff, const std::vector<int64>& offsets, slideio::TiffDirectory& dir)
+{
+    dir.subdirectories.resize(offsets.size());
+    for(size_t subdir=0; subdir<offsets.size(); subdir++)
     {
-        std::vector<int64> offsets(offsets_raw, offsets_raw+subdirs);
-        if(subdirs>0)
+        if(TIFFSetSubDirectory(tiff, offsets[subdir]))
         {
-            dir.subdirectories.resize(subdirs);
-        }
-        for(int subdir=0; subdir<subdirs; subdir++)
-        {
-            if(TIFFSetSubDirectory(tiff, offsets[subdir]))
-            {
-                scanTiffDirTags(tiff, dirIndex, dir.subdirectories[subdir].offset, dir.subdirectories[subdir]);	
-            }
+            readDirectoryTags(tiff, dir.dirIndex, offsets[subdir], dir.subdirectories[subdir]);
         }
     }
 }
 
+void  slideio::TiffTools::scanTiffDirTags(TIFF* tiff, int dirIndex, int64_t dirOffset, slideio::TiffDirectory& dir)
+{
+    TIFFSetDirectory(tiff, static_cast<short>(dirIndex));
+    if(dirOffset)
+        TIFFSetSubDirectory(tiff, dirOffset);
+    readDirectoryTags(tiff, dirIndex, dirOffset, dir);
+}
+
+void slideio::TiffTools::scanTiffDir(TIFF* tiff, int dirIndex, int64_t dirOffset, slideio::TiffDirectory& dir)
+{
+    scanTiffDirTags(tiff, dirIndex, dirOffset, dir);
+    dir.offset = 0;
+    std::vector<int64> offsets;
+    readSubDirectoryOffsets(tiff, offsets);
+    scanSubDirectories(tiff, offsets, dir);
+}
+
 void slideio::TiffTools::scanFile(TIFF* tiff, std::vector<TiffDirectory>& directories)
 {
-    int dirs = TIFFNumberOfDirectories(tiff);
-    directories.resize(dirs);
-    for(int dir=0; dir<dirs; dir++)
+    // Walks the directory chain once. TIFFSetDirectory(n) walks the chain
+    // from the first directory, calling it for each directory is quadratic.
+    directories.clear();
+    std::vector<std::vector<int64>> subdirOffsets;
+    if(!TIFFSetDirectory(tiff, 0))
+        return;
+    do
+    {
+        const int dirIndex = static_cast<int>(directories.size());
+        directories.emplace_back();
+        subdirOffsets.emplace_back();
+        readDirectoryTags(tiff, dirIndex, 0, directories.back());
+        readSubDirectoryOffsets(tiff, subdirOffsets.back());
+    }
+    while(TIFFReadDirectory(tiff));
+    // sub-directories are visited after the main chain so the chain
+    // is not re-read to return to it
+    for(size_t dir=0; dir<directories.size(); dir++)
     {
-        directories[dir].dirIndex = dir;
-        scanTiffDir(tiff, dir, 0, directories[dir]);
-    }	
+        if(!subdirOffsets[dir].empty())
+        {
+            scanSubDirectories(tiff, subdirOffsets[dir], directories[dir]);
+        }
+    }
 }
 
 void slideio::TiffTools::scanFile(const std::string& filePath, std::vector<TiffDirectory>& directories)
@@ -203,10 +286,7 @@ void slideio::TiffTools::readStripedDir(TIFF* file, const slideio::TiffDirectory
     slideio::DataType dt = dir.dataType;
     output.create(sizeImage, CV_MAKETYPE(slideio::toOpencvType(dt), dir.channels));
     cv::Mat imageRaster = output.getMat();
-    TIFFSetDirectory(file, static_cast<uint16_t>(dir.dirIndex));
-    if(dir.offset>0){
-        TIFFSetSubDirectory(file, dir.offset);
-    }
+    setCurrentDirectory(file, dir);
     uint8* buff_begin = imageRaster.data;
     int strip_buf_size = dir.stripSize;
     
@@ -231,7 +311,7 @@ void slideio::TiffTools::readTile(TIFF* hFile, const slideio::TiffDirectory& dir
     }
     setCurrentDirectory(hFile, dir);
 
-    if(dir.compression==34712 || dir.compression==33003)
+    if(isJ2KCompression(dir.compression))
     {
         readJ2KTile(hFile, dir, tile, channelIndices, output);
     }
@@ -247,11 +327,9 @@ void slideio::TiffTools::readRegularTile(TIFF* hFile, const slideio::TiffDirecto
     cv::Size tileSize = { dir.tileWidth, dir.tileHeight };
     slideio::DataType dt = dir.dataType;
     cv::Mat tileRaster;
+    tileRaster.allocator = PooledMatAllocator::getAllocator();
     tileRaster.create(tileSize, CV_MAKETYPE(slideio::toOpencvType(dt), dir.channels));
-    TIFFSetDirectory(hFile, static_cast<uint16_t>(dir.dirIndex));
-    if (dir.offset > 0) {
-        TIFFSetSubDirectory(hFile, dir.offset);
-    }
+    setCurrentDirectory(hFile, dir);
     uint8* buff_begin = tileRaster.data;
     auto buf_size = tileRaster.total()*tileRaster.elemSize();
     auto readBytes = TIFFReadEncodedTile(hFile, tile, buff_begin, buf_size);
@@ -260,25 +338,7 @@ void slideio::TiffTools::readRegularTile(TIFF* hFile, const slideio::TiffDirecto
         (boost::format(
             "TiffTools: error reading endoced tiff tile %1% of directory %2%."
             "Compression: %3%") % tile %dir.dirIndex % dir.compression).str());
-    if(channelIndices.empty())
-    {
-        tileRaster.copyTo(output);
-    }
-    else if(channelIndices.size()==1)
-    {
-        cv::extractChannel(tileRaster, output, channelIndices[0]);
-    }
-    else
-    {
-        std::vector<cv::Mat> channelRasters;
-        channelRasters.reserve(channelIndices.size());
-        for(int channelIndex : channelIndices)
-        {
-            cv::Mat channelRaster;
-            cv::extractChannel(tileRaster, channelRaster, channelIndices[channelIndex]);
-        }
-        cv::merge(channelRasters, output);
-    }
+    extractTileChannels(tileRaster, channelIndices, output);
 }
 
 void slideio::TiffTools::readJ2KTile(TIFF* hFile, const slideio::TiffDirectory& dir, int tile,
@@ -316,6 +376,22 @@ void slideio::TiffTools::readJ2KTile(TIFF* hFile, const slideio::TiffDirectory&
 
 void slideio::TiffTools::setCurrentDirectory(TIFF* hFile, const slideio::TiffDirectory& dir)
 {
+    if(dir.ifdOffset>0)
+    {
+        if(static_cast<int64>(TIFFCurrentDirOffset(hFile))==dir.ifdOffset)
+            return;
+        // TIFFSetDirectory(0) reads the first directory only and resets the list
+        // of visited directories, libtiff rejects revisited offsets as loops otherwise.
+        // The directory is then read directly by its offset.
+        if(!TIFFSetDirectory(hFile, 0)){
+            throw std::runtime_error("TiffTools: error by setting current directory");
+        }
+        if(static_cast<int64>(TIFFCurrentDirOffset(hFile))!=dir.ifdOffset &&
+            !TIFFSetSubDirectory(hFile, static_cast<uint64>(dir.ifdOffset))){
+            throw std::runtime_error("TiffTools: error by setting current directory");
+        }
+        return;
+    }
     if(!TIFFSetDirectory(hFile, static_cast<uint16_t>(dir.dirIndex))){
         throw std::runtime_error("TiffTools: error by setting current directory");
     }
@@ -326,3 +402,135 @@ void slideio::TiffTools::setCurrentDirectory(TIFF* hFile, const slideio::TiffDir
     }
 }
 
+bool slideio::TiffTools::canReadTileDirectly(const slideio::TiffDirectory& dir)
+{
+    if(!dir.tiled || !dir.interleaved || dir.tileOffsets.empty()
+        || dir.tileOffsets.size()!=dir.tileByteCounts.size())
+        return false;
+    if(isJ2KCompression(dir.compression))
+        return true;
+    return dir.compression==COMPRESSION_JPEG && dir.bitsPerSample==8;
+}
+
+void slideio::TiffTools::readRawTile(const RandomAccessFile& file, const slideio::TiffDirectory& dir, int tile,
+    std::vector<uint8_t>& data)
+{
+    if(tile<0 || tile>=static_cast<int>(dir.tileOffsets.size()))
+    {
+        throw std::runtime_error(
+            (boost::format("TiffTools: invalid tile index %1% of directory %2%") % tile % dir.dirIndex).str());
+    }
+    const uint64_t tileSize = dir.tileByteCounts[tile];
+    if(tileSize==0)
+    {
+        throw std::runtime_error(
+            (boost::format("TiffTools: tile %1% of directory %2% is empty") % tile % dir.dirIndex).str());
+    }
+    file.read(dir.tileOffsets[tile], static_cast<size_t>(tileSize), data);
+}
+
+void slideio::TiffTools::readTile(const RandomAccessFile& file, const slideio::TiffDirectory& dir, int tile,
+    const std::vector<int>& channelIndices, cv::OutputArray output, int scaleDenom)
+{
+    if(scaleDenom!=1 && !canDecodeTileScaled(dir))
+    {
+        throw std::runtime_error(
+            (boost::format("TiffTools: scaled decoding is not supported for directory %1%. Compression: %2%")
+                % dir.dirIndex % dir.compression).str());
+    }
+    if(!canReadTileDirectly(dir))
+    {
+        throw std::runtime_error(
+            (boost::format("TiffTools: direct reading of tiles is not supported for directory %1%. Compression: %2%")
+                % dir.dirIndex % dir.compression).str());
+    }
+    std::vector<uint8_t> rawTile;
+    readRawTile(file, dir, tile, rawTile);
+    if(isJ2KCompression(dir.compression))
+    {
+        const bool yuv = dir.compression==33003;
+        int reduceFactor = 0;
+        while((2 << reduceFactor) <= scaleDenom)
+            reduceFactor++;
+        ImageTools::decodeJp2KStream(rawTile, output, channelIndices, yuv, reduceFactor);
+    }
+    else
+    {
+        // libtiff converts colors only for YCbCr photometric interpretation
+        const bool colorConversion = dir.photometric==PHOTOMETRIC_YCBCR;
+        if(channelIndices.empty())
+        {
+            ImageTools::decodeJpegStream(rawTile, output, dir.jpegTables, colorConversion, scaleDenom);
+        }
+        else
+        {
+            cv::Mat tileRaster;
+            tileRaster.allocator = PooledMatAllocator::getAllocator();
+            ImageTools::decodeJpegStream(rawTile, tileRaster, dir.jpegTables, colorConversion, scaleDenom);
+            extractTileChannels(tileRaster, channelIndices, output);
+        }
+    }
+}
+
+bool slideio::TiffTools::canDecodeTileScaled(const slideio::TiffDirectory& dir)
+{
+    return canReadTileDirectly(dir) &&
+        (dir.compression==COMPRESSION_JPEG || isJ2KCompression(dir.compression));
+}
+
+// Builds a JPEG stream decodable without the tiff directory: the tables-only
+// stream of the directory is inserted after the SOI marker of the tile.
+// Components stored as RGB are marked with an Adobe segment (transform 0),
+// otherwise decoders assume YCbCr.
+static void makeStandaloneJpeg(const std::vector<uint8_t>& tables, const std::vector<uint8_t>& tile,
+    bool rgbComponents, std::vector<uint8_t>& stream)
+{
+    static const uint8_t adobeSegment[] = {
+        0xFF, 0xEE, 0x00, 0x0E, 'A', 'd', 'o', 'b', 'e', 0x00, 0x64, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    if(tile.size()<4 || tile[0]!=0xFF || tile[1]!=0xD8)
+    {
+        throw std::runtime_error("TiffTools: tile is not a JPEG stream");
+    }
+    // tables-only stream: SOI, tables, EOI
+    size_t tablesBegin(0), tablesEnd(0);
+    if(tables.size()>4 && tables[0]==0xFF && tables[1]==0xD8)
+    {
+        tablesBegin = 2;
+        tablesEnd = tables.size();
+        if(tables[tablesEnd-2]==0xFF && tables[tablesEnd-1]==0xD9)
+            tablesEnd -= 2;
+    }
+    stream.clear();
+    stream.reserve(tile.size() + tablesEnd - tablesBegin + sizeof(adobeSegment));
+    stream.insert(stream.end(), tile.begin(), tile.begin() + 2);
+    if(rgbComponents)
+    {
+        stream.insert(stream.end(), adobeSegment, adobeSegment + sizeof(adobeSegment));
+    }
+    stream.insert(stream.end(), tables.begin() + tablesBegin, tables.begin() + tablesEnd);
+    stream.insert(stream.end(), tile.begin() + 2, tile.end());
+}
+
+bool slideio::TiffTools::readEncodedTile(const RandomAccessFile& file, const slideio::TiffDirectory& dir, int tile,
+    EncodedTile& encodedTile)
+{
+    if(!canReadTileDirectly(dir))
+        return false;
+    encodedTile.size = cv::Size(dir.tileWidth, dir.tileHeight);
+    encodedTile.numChannels = dir.channels;
+    encodedTile.dataType = dir.bitsPerSample==16 ? DataType::DT_UInt16 : DataType::DT_Byte;
+    if(isJ2KCompression(dir.compression))
+    {
+        encodedTile.codec = Codec::Jpeg2000;
+        encodedTile.ycbcr = dir.compression==33003;
+        readRawTile(file, dir, tile, encodedTile.data);
+        return true;
+    }
+    encodedTile.codec = Codec::Jpeg;
+    encodedTile.ycbcr = false;
+    std::vector<uint8_t> rawTile;
+    readRawTile(file, dir, tile, rawTile);
+    const bool rgbComponents = dir.channels==3 && dir.photometric==PHOTOMETRIC_RGB;
+    makeStandaloneJpeg(dir.jpegTables, rawTile, rgbComponents, encodedTile.data);
+    return true;
+}
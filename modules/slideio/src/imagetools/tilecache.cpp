@@ -0,0 +1,150 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+#include "opencv2/slideio/tilecache.hpp"
+#include <atomic>
+#include <sstream>
+
+using namespace cv;
+
+static size_t rasterSize(const cv::Mat& raster)
+{
+    return raster.total()*raster.elemSize();
+}
+
+slideio::TileCache::TileCache() : m_capacity(DefaultCapacity)
+{
+}
+
+slideio::TileCache& slideio::TileCache::instance()
+{
+    // never destroyed: scenes held in static objects remove their scopes
+    // during static destruction
+    static TileCache* cache = new TileCache;
+    return *cache;
+}
+
+void slideio::TileCache::setCapacity(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_capacity = capacity;
+    evict(m_capacity);
+}
+
+size_t slideio::TileCache::getCapacity() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_capacity;
+}
+
+bool slideio::TileCache::get(const std::string& key, cv::Mat& tile)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if(it==m_index.end())
+    {
+        m_statistics.misses++;
+        return false;
+    }
+    // move the entry to the front of the lru list
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    tile = it->second->second;
+    m_statistics.hits++;
+    return true;
+}
+
+void slideio::TileCache::put(const std::string& key, const cv::Mat& tile)
+{
+    const size_t tileSize = rasterSize(tile);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(tileSize==0 || tileSize>m_capacity)
+        return;
+    auto it = m_index.find(key);
+    if(it!=m_index.end())
+    {
+        m_statistics.memoryUsage -= rasterSize(it->second->second);
+        m_entries.erase(it->second);
+        m_index.erase(it);
+        m_statistics.tileCount--;
+    }
+    evict(m_capacity - tileSize);
+    m_entries.emplace_front(key, tile);
+    m_index[key] = m_entries.begin();
+    m_statistics.memoryUsage += tileSize;
+    m_statistics.tileCount++;
+}
+
+void slideio::TileCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_index.clear();
+    m_statistics.memoryUsage = 0;
+    m_statistics.tileCount = 0;
+}
+
+void slideio::TileCache::removeScope(const std::string& scope)
+{
+    const std::string prefix = scope + '|';
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(auto it = m_entries.begin(); it != m_entries.end();)
+    {
+        if(it->first.compare(0, prefix.size(), prefix)==0)
+        {
+            m_statistics.memoryUsage -= rasterSize(it->second);
+            m_index.erase(it->first);
+            it = m_entries.erase(it);
+            m_statistics.tileCount--;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+slideio::TileCache::Statistics slideio::TileCache::getStatistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+void slideio::TileCache::resetStatistics()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_statistics.hits = 0;
+    m_statistics.misses = 0;
+    m_statistics.evictions = 0;
+}
+
+std::string slideio::TileCache::makeScope(const std::string& filePath)
+{
+    static std::atomic<uint64_t> openCount(0);
+    return filePath + "#" + std::to_string(++openCount);
+}
+
+std::string slideio::TileCache::makeKey(const std::string& scope, int tileIndex,
+    const std::vector<int>& channelIndices)
+{
+    std::ostringstream key;
+    key << scope << '|' << tileIndex << '|';
+    for(int channelIndex : channelIndices)
+    {
+        key << channelIndex << ',';
+    }
+    return key.str();
+}
+
+void slideio::TileCache::evict(size_t capacity)
+{
+    // the caller holds the lock
+    while(!m_entries.empty() && m_statistics.memoryUsage>capacity)
+    {
+        const Entry& entry = m_entries.back();
+        m_statistics.memoryUsage -= rasterSize(entry.second);
+        m_index.erase(entry.first);
+        m_entries.pop_back();
+        m_statistics.tileCount--;
+        m_statistics.evictions++;
+    }
+}
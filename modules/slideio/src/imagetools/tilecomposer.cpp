@@ -3,55 +3,485 @@
 // of this distribution and at http://opencv.org/license.html.
 #include "opencv2/slideio/tilecomposer.hpp"
 #include "opencv2/imgproc.hpp"
+#include "opencv2/core/utility.hpp"
 #include "opencv2/slideio/imagetools.hpp"
+#include "opencv2/slideio/tilecache.hpp"
+#include "opencv2/slideio/pooledallocator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <boost/format.hpp>
 
 
 using namespace cv;
 
+static bool readCachedTile(slideio::Tiler* tiler, int tileIndex, const std::vector<int>& channelIndices,
+    const std::string& cacheScope, cv::Mat& tileRaster, void* userData)
+{
+    if(cacheScope.empty() || slideio::TileCache::instance().getCapacity()==0)
+    {
+        // pooled buffers are rounded up to size classes: they are not
+        // used for tiles kept by the cache, which accounts exact sizes
+        tileRaster.allocator = slideio::PooledMatAllocator::getAllocator();
+    }
+    if(cacheScope.empty())
+    {
+        return tiler->readTile(tileIndex, channelIndices, tileRaster, userData);
+    }
+    slideio::TileCache& cache = slideio::TileCache::instance();
+    const std::string key = slideio::TileCache::makeKey(cacheScope, tileIndex, channelIndices);
+    if(cache.get(key, tileRaster))
+    {
+        return true;
+    }
+    if(!tiler->readTile(tileIndex, channelIndices, tileRaster, userData))
+    {
+        return false;
+    }
+    cache.put(key, tileRaster);
+    return true;
+}
+
+
+namespace
+{
+    // part of the output block filled from a tile
+    struct TilePart
+    {
+        int tileIndex;
+        cv::Rect tileRect;
+        cv::Rect blockPart;
+    };
+}
+
+// Computes the range of output pixels [begin, end) whose centers
+// map into the source interval [tileBegin, tileEnd).
+// Adjacent tiles get adjacent ranges, so the parts of a regular grid do not overlap.
+static void computeOwnedRange(int tileBegin, int tileEnd, int blockBegin, double srcPerDst, int dstLength,
+    int& begin, int& end)
+{
+    begin = static_cast<int>(std::ceil(static_cast<double>(tileBegin - blockBegin) / srcPerDst - 0.5));
+    end = static_cast<int>(std::ceil(static_cast<double>(tileEnd - blockBegin) / srcPerDst - 0.5));
+    begin = std::max(0, std::min(begin, dstLength));
+    end = std::max(begin, std::min(end, dstLength));
+}
+
+// Computes the source columns (rows) of the tile raster needed for bilinear
+// interpolation of the output range and the source coordinate of the first output pixel.
+static void computeSourceRange(int tileBegin, int tileLength, int rasterLength, int blockBegin,
+    double srcPerDst, int begin, int end, int& rasterBegin, int& rasterEnd, double& firstCoord, double& step)
+{
+    const double rasterPerTile = static_cast<double>(rasterLength) / static_cast<double>(tileLength);
+    step = srcPerDst * rasterPerTile;
+    firstCoord = (blockBegin + (begin + 0.5) * srcPerDst - tileBegin) * rasterPerTile - 0.5;
+    const double lastCoord = firstCoord + (end - begin - 1) * step;
+    rasterBegin = std::max(0, std::min(static_cast<int>(std::floor(firstCoord)), rasterLength - 1));
+    rasterEnd = std::max(rasterBegin + 1, std::min(static_cast<int>(std::floor(lastCoord)) + 2, rasterLength));
+}
+
+// Resamples the part of the tile raster covering the block part
+// directly into the corresponding view of the block raster.
+static void placeTilePart(const TilePart& part, const cv::Mat& tileRaster, const cv::Rect& blockRect,
+    const cv::Size& blockSize, cv::Mat& blockRaster)
+{
+    cv::Mat blockPartRaster(blockRaster, part.blockPart);
+    const cv::Rect& tileRect = part.tileRect;
+    if(blockRect.size()==blockSize && tileRaster.size()==tileRect.size())
+    {
+        // no scaling: copy pixels
+        const cv::Rect rasterPart = part.blockPart + blockRect.tl() - tileRect.tl();
+        tileRaster(rasterPart).copyTo(blockPartRaster);
+        return;
+    }
+    const double srcPerDstX = static_cast<double>(blockRect.width) / static_cast<double>(blockSize.width);
+    const double srcPerDstY = static_cast<double>(blockRect.height) / static_cast<double>(blockSize.height);
+    const cv::Rect& dst = part.blockPart;
+    int rasterX0(0), rasterX1(0), rasterY0(0), rasterY1(0);
+    double firstX(0), firstY(0), stepX(0), stepY(0);
+    computeSourceRange(tileRect.x, tileRect.width, tileRaster.cols, blockRect.x, srcPerDstX,
+        dst.x, dst.x + dst.width, rasterX0, rasterX1, firstX, stepX);
+    computeSourceRange(tileRect.y, tileRect.height, tileRaster.rows, blockRect.y, srcPerDstY,
+        dst.y, dst.y + dst.height, rasterY0, rasterY1, firstY, stepY);
+    const cv::Mat rasterPart(tileRaster, cv::Rect(rasterX0, rasterY0, rasterX1 - rasterX0, rasterY1 - rasterY0));
+    // maps output pixels of the block part to pixels of the raster part
+    const cv::Matx23d transform(
+        stepX, 0., firstX - rasterX0,
+        0., stepY, firstY - rasterY0);
+    cv::warpAffine(rasterPart, blockPartRaster, transform, blockPartRaster.size(),
+        cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_REPLICATE);
+}
+
+// Computes parts of the output block covered by each tile intersecting the rectangle.
+static void computeTileParts(slideio::Tiler* tiler, const cv::Rect& blockRect, const cv::Size& blockSize,
+    std::vector<TilePart>& parts, void* userData)
+{
+    const double srcPerDstX = static_cast<double>(blockRect.width) / static_cast<double>(blockSize.width);
+    const double srcPerDstY = static_cast<double>(blockRect.height) / static_cast<double>(blockSize.height);
+
+    std::vector<int> tileIndices;
+    tiler->getTilesInRect(blockRect, tileIndices, userData);
+
+    parts.clear();
+    parts.reserve(tileIndices.size());
+    for(const int tileIndex : tileIndices)
+    {
+        TilePart part;
+        part.tileIndex = tileIndex;
+        tiler->getTileRect(tileIndex, part.tileRect, userData);
+        int x0(0), x1(0), y0(0), y1(0);
+        computeOwnedRange(part.tileRect.x, part.tileRect.x + part.tileRect.width, blockRect.x, srcPerDstX,
+            blockSize.width, x0, x1);
+        computeOwnedRange(part.tileRect.y, part.tileRect.y + part.tileRect.height, blockRect.y, srcPerDstY,
+            blockSize.height, y0, y1);
+        part.blockPart = cv::Rect(x0, y0, x1 - x0, y1 - y0);
+        if(part.blockPart.area() > 0)
+        {
+            parts.push_back(part);
+        }
+    }
+}
+
+// tiles of mosaic images may overlap. Overlapping parts are placed
+// in the order of tile indices. Parts sorted by the left edge are swept
+// and compared only with the parts starting before their right edge.
+static bool partsDisjoint(slideio::Tiler* tiler, const std::vector<TilePart>& parts, void* userData)
+{
+    if(parts.size() < 2 || tiler->hasDisjointTiles(userData))
+        return true;
+    std::vector<cv::Rect> rects;
+    rects.reserve(parts.size());
+    for(const TilePart& part : parts)
+    {
+        rects.push_back(part.blockPart);
+    }
+    std::sort(rects.begin(), rects.end(), [](const cv::Rect& left, const cv::Rect& right)
+    {
+        return left.x < right.x;
+    });
+    const size_t rectCount = rects.size();
+    for(size_t first = 0; first < rectCount; ++first)
+    {
+        const cv::Rect& rect = rects[first];
+        for(size_t second = first + 1; second < rectCount && rects[second].x < rect.x + rect.width; ++second)
+        {
+            if((rect & rects[second]).area() > 0)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// returns true if disjoint parts cover all pixels of the block
+static bool partsCoverBlock(const std::vector<TilePart>& parts, const cv::Size& blockSize)
+{
+    int64_t coveredArea = 0;
+    for(const TilePart& part : parts)
+    {
+        coveredArea += part.blockPart.area();
+    }
+    return coveredArea >= static_cast<int64_t>(blockSize.area());
+}
+
+// a block without tile data stays empty. A preallocated output of
+// the block size is cleared instead of keeping its previous content.
+static void clearPreallocatedBlock(cv::OutputArray output, const cv::Size& blockSize)
+{
+    if(!output.empty() && output.size()==blockSize)
+    {
+        output.setTo(cv::Scalar::all(0));
+    }
+}
 
 void slideio::TileComposer::composeRect(slideio::Tiler* tiler,
                                         const std::vector<int>& channelIndices,
                                         const cv::Rect& blockRect,
                                         const cv::Size& blockSize,
                                         cv::OutputArray output,
-                                        void *userData)
+                                        void *userData,
+                                        ComposeMode mode)
 {
-    const int tileCount = tiler->getTileCount(userData);
-    const int channelCount = static_cast<int>(channelIndices.size());
-    cv::Mat scaledBlockRaster;
-    const cv::Point blockOrigin = blockRect.tl();
-    const double scaleX = static_cast<double>(blockSize.width)/static_cast<double>(blockRect.width);
-    const double scaleY = static_cast<double>(blockSize.height)/static_cast<double>(blockRect.height);
-    cv::Rect scaledBlockRect;
-    slideio::ImageTools::scaleRect(blockRect, blockSize, scaledBlockRect);
+    if(mode==ComposeMode::SinglePass && blockSize!=blockRect.size())
+    {
+        // assemble the region without scaling, then resample it at once
+        cv::Mat nativeRaster;
+        nativeRaster.allocator = slideio::PooledMatAllocator::getAllocator();
+        composeRect(tiler, channelIndices, blockRect, blockRect.size(), nativeRaster, userData);
+        if(nativeRaster.empty())
+        {
+            clearPreallocatedBlock(output, blockSize);
+            return;
+        }
+        const bool downscale = blockSize.width<=blockRect.width && blockSize.height<=blockRect.height;
+        cv::resize(nativeRaster, output, blockSize, 0, 0, downscale ? cv::INTER_AREA : cv::INTER_LINEAR);
+        return;
+    }
+    const std::string cacheScope = tiler->getCacheScope(userData);
+    std::vector<TilePart> parts;
+    computeTileParts(tiler, blockRect, blockSize, parts, userData);
+    const int partCount = static_cast<int>(parts.size());
+    const bool disjoint = partsDisjoint(tiler, parts, userData);
+    const bool covered = disjoint && partsCoverBlock(parts, blockSize);
 
-    for(int tileIndex = 0; tileIndex<tileCount; tileIndex++)
+    cv::Mat blockRaster;
+    auto createBlock = [&](int type)
     {
-        cv::Rect tileRect;
-        tiler->getTileRect(tileIndex, tileRect, userData);
-        cv::Rect intersection = blockRect & tileRect;
-        if(intersection.area()>0)
+        output.create(blockSize, type);
+        blockRaster = output.getMat();
+        if(!covered)
+        {
+            // not all pixels are covered by tiles
+            blockRaster.setTo(cv::Scalar::all(0));
+        }
+    };
+    auto placePart = [&](const TilePart& part, const cv::Mat& tileRaster)
+    {
+        if(tileRaster.empty())
+            return;
+        if(blockRaster.empty())
+        {
+            createBlock(tileRaster.type());
+        }
+        placeTilePart(part, tileRaster, blockRect, blockSize, blockRaster);
+    };
+
+    if(partCount > 1 && tiler->supportsConcurrentReads(userData))
+    {
+        if(disjoint)
+        {
+            // the type of the output is defined by the first tile with data
+            int first = 0;
+            for(; first < partCount && blockRaster.empty(); ++first)
+            {
+                cv::Mat tileRaster;
+                if(readCachedTile(tiler, parts[first].tileIndex, channelIndices, cacheScope, tileRaster, userData))
+                {
+                    placePart(parts[first], tileRaster);
+                }
+            }
+            // the rest of the tiles write to disjoint parts of the output
+            cv::parallel_for_(cv::Range(first, partCount), [&](const cv::Range& range)
+            {
+                for(int index = range.start; index < range.end; ++index)
+                {
+                    cv::Mat tileRaster;
+                    if(readCachedTile(tiler, parts[index].tileIndex, channelIndices, cacheScope, tileRaster, userData)
+                        && !tileRaster.empty())
+                    {
+                        placeTilePart(parts[index], tileRaster, blockRect, blockSize, blockRaster);
+                    }
+                }
+            }, partCount - first);
+        }
+        else
+        {
+            // decode tiles in parallel, place them in the order of indices
+            std::vector<cv::Mat> tileRasters(partCount);
+            cv::parallel_for_(cv::Range(0, partCount), [&](const cv::Range& range)
+            {
+                for(int index = range.start; index < range.end; ++index)
+                {
+                    if(!readCachedTile(tiler, parts[index].tileIndex, channelIndices, cacheScope,
+                        tileRasters[index], userData))
+                    {
+                        tileRasters[index].release();
+                    }
+                }
+            }, partCount);
+            for(int index = 0; index < partCount; ++index)
+            {
+                placePart(parts[index], tileRasters[index]);
+            }
+        }
+    }
+    else
+    {
+        for(const TilePart& part : parts)
         {
             cv::Mat tileRaster;
-            if(tiler->readTile(tileIndex, channelIndices, tileRaster, userData))
+            if(readCachedTile(tiler, part.tileIndex, channelIndices, cacheScope, tileRaster, userData))
+            {
+                placePart(part, tileRaster);
+            }
+        }
+    }
+    if(blockRaster.empty())
+    {
+        clearPreallocatedBlock(output, blockSize);
+    }
+}
+
+void slideio::TileComposer::composeRects(slideio::Tiler* tiler,
+                                         const std::vector<int>& channelIndices,
+                                         const std::vector<cv::Rect>& blockRects,
+                                         const std::vector<cv::Size>& blockSizes,
+                                         std::vector<cv::Mat>& outputs,
+                                         void* userData,
+                                         ComposeMode mode)
+{
+    if(blockRects.size()!=blockSizes.size())
+    {
+        throw std::runtime_error(
+            (boost::format("TileComposer: number of block sizes (%1%) does not match number of rectangles (%2%)")
+                % blockSizes.size() % blockRects.size()).str());
+    }
+    const int blockCount = static_cast<int>(blockRects.size());
+    outputs.resize(blockCount);
+    // single pass composition assembles the blocks without scaling
+    // and resamples each of them at once
+    std::vector<cv::Size> composeSizes(blockSizes);
+    if(mode==ComposeMode::SinglePass)
+    {
+        for(int block = 0; block < blockCount; ++block)
+        {
+            composeSizes[block] = blockRects[block].size();
+        }
+    }
+    // collect the union of tiles required by the blocks
+    std::vector<std::vector<TilePart>> blockParts(blockCount);
+    std::vector<int> tileIndices;
+    for(int block = 0; block < blockCount; ++block)
+    {
+        computeTileParts(tiler, blockRects[block], composeSizes[block], blockParts[block], userData);
+        for(const TilePart& part : blockParts[block])
+        {
+            tileIndices.push_back(part.tileIndex);
+        }
+    }
+    std::sort(tileIndices.begin(), tileIndices.end());
+    tileIndices.erase(std::unique(tileIndices.begin(), tileIndices.end()), tileIndices.end());
+    const int tileCount = static_cast<int>(tileIndices.size());
+    auto tilePosition = [&tileIndices](int tileIndex)
+    {
+        return static_cast<int>(std::lower_bound(tileIndices.begin(), tileIndices.end(), tileIndex) - tileIndices.begin());
+    };
+
+    // blocks are composed in the spatial order, in chunks of one block per thread.
+    // A tile is decoded once, before the first block using it, and released
+    // after the last one: only tiles shared with the following blocks are kept.
+    std::vector<int> blockOrder(blockCount);
+    for(int block = 0; block < blockCount; ++block)
+    {
+        blockOrder[block] = block;
+    }
+    std::stable_sort(blockOrder.begin(), blockOrder.end(), [&blockRects](int left, int right)
+    {
+        const cv::Rect& leftRect = blockRects[left];
+        const cv::Rect& rightRect = blockRects[right];
+        return leftRect.y < rightRect.y || (leftRect.y == rightRect.y && leftRect.x < rightRect.x);
+    });
+    std::vector<int> lastUse(tileCount, -1);
+    for(int position = 0; position < blockCount; ++position)
+    {
+        for(const TilePart& part : blockParts[blockOrder[position]])
+        {
+            lastUse[tilePosition(part.tileIndex)] = position;
+        }
+    }
+
+    const std::string cacheScope = tiler->getCacheScope(userData);
+    const bool concurrentReads = tiler->supportsConcurrentReads(userData);
+    const bool tilesDisjoint = tiler->hasDisjointTiles(userData);
+    std::vector<cv::Mat> tileRasters(tileCount);
+    std::vector<bool> tileRead(tileCount, false);
+    auto composeBlock = [&](int block)
+    {
+        const std::vector<TilePart>& parts = blockParts[block];
+        const cv::Size& composeSize = composeSizes[block];
+        const bool covered = (tilesDisjoint || partsDisjoint(tiler, parts, userData))
+            && partsCoverBlock(parts, composeSize);
+        cv::Mat blockRaster;
+        if(composeSize!=blockSizes[block])
+        {
+            // temporary raster of single pass composition
+            blockRaster.allocator = slideio::PooledMatAllocator::getAllocator();
+        }
+        // parts of a block are placed in the order of tile indices
+        for(const TilePart& part : parts)
+        {
+            const cv::Mat& tileRaster = tileRasters[tilePosition(part.tileIndex)];
+            if(tileRaster.empty())
+                continue;
+            if(blockRaster.empty())
+            {
+                // the type of the block is defined by the first tile with data
+                blockRaster.create(composeSize, tileRaster.type());
+                if(!covered)
+                {
+                    blockRaster.setTo(cv::Scalar::all(0));
+                }
+            }
+            placeTilePart(part, tileRaster, blockRects[block], composeSize, blockRaster);
+        }
+        const cv::Size& blockSize = blockSizes[block];
+        if(blockRaster.empty() || composeSize==blockSize)
+        {
+            outputs[block] = blockRaster;
+        }
+        else
+        {
+            const bool downscale = blockSize.width<=composeSize.width && blockSize.height<=composeSize.height;
+            cv::resize(blockRaster, outputs[block], blockSize, 0, 0, downscale ? cv::INTER_AREA : cv::INTER_LINEAR);
+        }
+    };
+
+    const int chunkSize = std::max(1, cv::getNumThreads());
+    std::vector<int> chunkTiles;
+    for(int chunkBegin = 0; chunkBegin < blockCount; chunkBegin += chunkSize)
+    {
+        const int chunkEnd = std::min(chunkBegin + chunkSize, blockCount);
+        // decode tiles first used by the blocks of the chunk
+        chunkTiles.clear();
+        for(int position = chunkBegin; position < chunkEnd; ++position)
+        {
+            for(const TilePart& part : blockParts[blockOrder[position]])
+            {
+                const int tilePos = tilePosition(part.tileIndex);
+                if(!tileRead[tilePos])
+                {
+                    tileRead[tilePos] = true;
+                    chunkTiles.push_back(tilePos);
+                }
+            }
+        }
+        const int chunkTileCount = static_cast<int>(chunkTiles.size());
+        auto readTiles = [&](const cv::Range& range)
+        {
+            for(int index = range.start; index < range.end; ++index)
+            {
+                const int tilePos = chunkTiles[index];
+                if(!readCachedTile(tiler, tileIndices[tilePos], channelIndices, cacheScope, tileRasters[tilePos], userData))
+                {
+                    tileRasters[tilePos].release();
+                }
+            }
+        };
+        if(chunkTileCount > 1 && concurrentReads)
+        {
+            cv::parallel_for_(cv::Range(0, chunkTileCount), readTiles, chunkTileCount);
+        }
+        else
+        {
+            readTiles(cv::Range(0, chunkTileCount));
+        }
+        // blocks of the chunk are independent
+        cv::parallel_for_(cv::Range(chunkBegin, chunkEnd), [&](const cv::Range& range)
+        {
+            for(int position = range.start; position < range.end; ++position)
+            {
+                composeBlock(blockOrder[position]);
+            }
+        });
+        // release tiles not used by the following blocks
+        for(int position = chunkBegin; position < chunkEnd; ++position)
+        {
+            for(const TilePart& part : blockParts[blockOrder[position]])
             {
-                if(scaledBlockRaster.empty())
+                const int tilePos = tilePosition(part.tileIndex);
+                if(lastUse[tilePos] < chunkEnd)
                 {
-                    output.create(scaledBlockRect.height, scaledBlockRect.width, tileRaster.type());
-                    scaledBlockRaster = output.getMat();
+                    tileRasters[tilePos].release();
                 }
-                cv::Rect scaledTileRect;
-                slideio::ImageTools::scaleRect(tileRect, scaleX, scaleY, scaledTileRect);
-                // scale tile raster
-                cv::Mat scaledTileRaster;
-                cv::resize(tileRaster, scaledTileRaster, scaledTileRect.size());
-                // compute intersection of scaled tile rectangle and scaled block rectangle
-                cv::Rect scaledIntersectionRect = scaledBlockRect & scaledTileRect;
-                const cv::Rect blockPart = scaledIntersectionRect - scaledBlockRect.tl();
-                const cv::Rect tilePart = scaledIntersectionRect - scaledTileRect.tl();
-                cv::Mat blockPartRaster(scaledBlockRaster, blockPart);
-                cv::Mat tilePartRaster(scaledTileRaster, tilePart);
-                tilePartRaster.copyTo(blockPartRaster);
             }
         }
     }
@@ -0,0 +1,141 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+#include "opencv2/slideio/workerpool.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace cv;
+
+// true for threads of the pool
+static thread_local bool workerThread = false;
+
+slideio::WorkerPool::WorkerPool() : m_numThreads(0), m_stopping(false), m_shutdown(false)
+{
+}
+
+slideio::WorkerPool::~WorkerPool()
+{
+    stop();
+    std::deque<Entry> tasks;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+        tasks.swap(m_tasks);
+    }
+    for(const Entry& entry : tasks)
+    {
+        abort(entry.second);
+    }
+}
+
+void slideio::WorkerPool::abort(const AbortHandler& onAbort)
+{
+    if(onAbort)
+    {
+        onAbort(std::make_exception_ptr(
+            std::runtime_error("WorkerPool: the pool is shut down before the task is started")));
+    }
+}
+
+slideio::WorkerPool& slideio::WorkerPool::instance()
+{
+    static WorkerPool pool;
+    return pool;
+}
+
+void slideio::WorkerPool::setNumThreads(int numThreads)
+{
+    // a thread of the pool would join itself
+    if(workerThread)
+        throw std::runtime_error("WorkerPool: the number of threads cannot be changed from a task of the pool");
+    stop();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = false;
+        m_numThreads = std::max(0, numThreads);
+        if(m_tasks.empty())
+            return;
+        // tasks queued while the threads were stopping
+        start();
+    }
+    m_condition.notify_all();
+}
+
+int slideio::WorkerPool::getNumThreads() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_numThreads>0)
+        return m_numThreads;
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+void slideio::WorkerPool::submit(Task task, AbortHandler onAbort)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if(m_shutdown)
+        {
+            lock.unlock();
+            abort(onAbort);
+            return;
+        }
+        m_tasks.emplace_back(std::move(task), std::move(onAbort));
+        if(m_threads.empty() && !m_stopping)
+        {
+            start();
+        }
+    }
+    m_condition.notify_one();
+}
+
+size_t slideio::WorkerPool::getQueueSize() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_tasks.size();
+}
+
+void slideio::WorkerPool::start()
+{
+    // called under the lock
+    const int numThreads = m_numThreads>0 ? m_numThreads
+        : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    m_threads.reserve(numThreads);
+    for(int thread = 0; thread < numThreads; ++thread)
+    {
+        m_threads.emplace_back(&WorkerPool::run, this);
+    }
+}
+
+void slideio::WorkerPool::stop()
+{
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        threads.swap(m_threads);
+    }
+    m_condition.notify_all();
+    for(std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void slideio::WorkerPool::run()
+{
+    workerThread = true;
+    for(;;)
+    {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]{ return m_stopping || !m_tasks.empty(); });
+            if(m_stopping)
+                return;
+            task = std::move(m_tasks.front().first);
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
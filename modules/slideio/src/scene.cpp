@@ -2,6 +2,14 @@
 // It is subject to the license terms in the LICENSE file found in the top-level directory
 // of this distribution and at http://opencv.org/license.html.
 #include "opencv2/slideio/scene.hpp"
+#include "opencv2/slideio.hpp"
+#include "opencv2/slideio/workerpool.hpp"
+#include "opencv2/slideio/imagetools.hpp"
+#include "opencv2/slideio/tools.hpp"
+#include "opencv2/imgproc.hpp"
+#include <boost/format.hpp>
+#include <cmath>
+#include <memory>
 
 using namespace cv::slideio;
 
@@ -10,6 +18,35 @@ std::string Scene::getChannelName(int) const
     return "";
 }
 
+LevelInfo Scene::getLevelInfo(int level) const
+{
+    if(level!=0)
+    {
+        throw std::runtime_error(
+            (boost::format("Invalid level index %1% of scene %2%") % level % getName()).str());
+    }
+    LevelInfo info;
+    info.size = getRect().size();
+    return info;
+}
+
+void Scene::readLevelBlock(int level, const cv::Rect& blockRect, const std::vector<int>& channelIndices,
+    cv::OutputArray output)
+{
+    if(level!=0)
+    {
+        throw std::runtime_error(
+            (boost::format("Invalid level index %1% of scene %2%") % level % getName()).str());
+    }
+    readBlockChannels(blockRect + getRect().tl(), channelIndices, output);
+}
+
+cv::Rect Scene::getLevelTileRect(int level, int tileIndex) const
+{
+    throw std::runtime_error(
+        (boost::format("Invalid tile index %1% of level %2% of scene %3%") % tileIndex % level % getName()).str());
+}
+
 void Scene::readBlock(const cv::Rect& blockRect, cv::OutputArray output)
 {
     const std::vector<int> channelIndices;
@@ -28,6 +65,228 @@ void Scene::readResampledBlock(const cv::Rect& blockRect, const cv::Size& blockS
     return readResampledBlockChannels(blockRect, blockSize, channelIndices, output);
 }
 
+void Scene::readComposedBlockChannels(const cv::Rect& blockRect, const cv::Size& blockSize,
+    const std::vector<int>& channelIndices, ComposeMode, cv::OutputArray output)
+{
+    readResampledBlockChannels(blockRect, blockSize, channelIndices, output);
+}
+
+void Scene::readBlocks(const std::vector<cv::Rect>& blockRects, const cv::Size& blockSize,
+    const std::vector<int>& channelIndices, std::vector<cv::Mat>& outputs)
+{
+    outputs.resize(blockRects.size());
+    for(size_t block = 0; block < blockRects.size(); ++block)
+    {
+        const cv::Size size = blockSize.area()>0 ? blockSize : blockRects[block].size();
+        readResampledBlockChannels(blockRects[block], size, channelIndices, outputs[block]);
+    }
+}
+
+void Scene::readBlockInto(const cv::Rect& blockRect, const cv::Size& blockSize,
+    const std::vector<int>& channelIndices, cv::Mat& output)
+{
+    const cv::Size size = blockSize.area()>0 ? blockSize : blockRect.size();
+    const int firstChannel = channelIndices.empty() ? 0 : channelIndices.front();
+    const int numChannels = channelIndices.empty() ? getNumChannels() : static_cast<int>(channelIndices.size());
+    const int type = CV_MAKETYPE(toOpencvType(getChannelDataType(firstChannel)), numChannels);
+    if(output.empty() || output.dims!=2 || output.size()!=size || output.type()!=type)
+    {
+        throw std::runtime_error(
+            (boost::format("Output buffer of block (%1%,%2%,%3%,%4%) must be a %5%x%6% matrix of type %7%")
+                % blockRect.x % blockRect.y % blockRect.width % blockRect.height
+                % size.width % size.height % type).str());
+    }
+    // drivers write to the matching buffer in place, the header
+    // is only replaced if a driver has produced a raster of its own
+    cv::Mat raster = output;
+    readResampledBlockChannels(blockRect, size, channelIndices, raster);
+    if(raster.data!=output.data)
+    {
+        if(raster.empty())
+        {
+            output.setTo(cv::Scalar::all(0));
+        }
+        else if(raster.size()==size && raster.type()==type)
+        {
+            raster.copyTo(output);
+        }
+        else
+        {
+            throw std::runtime_error(
+                (boost::format("Unexpected raster %1%x%2% of type %3% read from %4%")
+                    % raster.cols % raster.rows % raster.type() % getFilePath()).str());
+        }
+    }
+}
+
+void Scene::readBlockEncoded(const cv::Rect& blockRect, const cv::Size& blockSize,
+    const std::vector<int>& channelIndices, Codec format, int quality, std::vector<uint8_t>& data)
+{
+    const cv::Size size = blockSize.area()>0 ? blockSize : blockRect.size();
+    cv::Mat raster;
+    readResampledBlockChannels(blockRect, size, channelIndices, raster);
+    switch(format)
+    {
+    case Codec::Jpeg:
+        ImageTools::encodeJpegStream(raster, data, quality);
+        break;
+    case Codec::Png:
+        ImageTools::encodePngStream(raster, data);
+        break;
+    default:
+        throw std::runtime_error(
+            (boost::format("Unsupported format %1% of encoded blocks") % static_cast<int>(format)).str());
+    }
+}
+
+std::future<cv::Mat> Scene::readBlockAsync(const cv::Ptr<Scene>& scene, const cv::Rect& blockRect,
+    const cv::Size& blockSize, const std::vector<int>& channelIndices, const cv::Ptr<ReadCancellation>& cancellation)
+{
+    auto promise = std::make_shared<std::promise<cv::Mat>>();
+    std::future<cv::Mat> future = promise->get_future();
+    readBlockAsync(scene, blockRect, blockSize, channelIndices, [promise](const cv::Mat& raster, std::exception_ptr error)
+    {
+        if(error)
+        {
+            promise->set_exception(error);
+        }
+        else
+        {
+            promise->set_value(raster);
+        }
+    }, cancellation);
+    return future;
+}
+
+void Scene::readBlockAsync(const cv::Ptr<Scene>& scene, const cv::Rect& blockRect, const cv::Size& blockSize,
+    const std::vector<int>& channelIndices, const ReadCallback& callback, const cv::Ptr<ReadCancellation>& cancellation)
+{
+    if(scene.empty())
+    {
+        throw std::runtime_error("Asynchronous read: the scene is not defined");
+    }
+    const cv::Size size = blockSize.area()>0 ? blockSize : blockRect.size();
+    // the task keeps the scene alive until the read is completed
+    WorkerPool::instance().submit([scene, blockRect, size, channelIndices, callback, cancellation]()
+    {
+        cv::Mat raster;
+        std::exception_ptr error;
+        try
+        {
+            if(!cancellation.empty() && cancellation->isCancelled())
+            {
+                throw std::runtime_error(
+                    (boost::format("Read of block (%1%,%2%,%3%,%4%) from %5% is cancelled")
+                        % blockRect.x % blockRect.y % blockRect.width % blockRect.height % scene->getFilePath()).str());
+            }
+            scene->readResampledBlockChannels(blockRect, size, channelIndices, raster);
+        }
+        catch(...)
+        {
+            error = std::current_exception();
+        }
+        callback(raster, error);
+    }, [callback](std::exception_ptr error)
+    {
+        callback(cv::Mat(), error);
+    });
+}
+
+void Scene::visitPatches(const cv::Size& patchSize, const cv::Size& stride, double zoom,
+    const std::vector<int>& channelIndices, const PatchVisitor& visitor)
+{
+    if(patchSize.width<=0 || patchSize.height<=0 || stride.width<=0 || stride.height<=0 || zoom<=0)
+    {
+        throw std::runtime_error(
+            (boost::format("Invalid patch parameters: size %1%x%2%, stride %3%x%4%, zoom %5%")
+                % patchSize.width % patchSize.height % stride.width % stride.height % zoom).str());
+    }
+    const cv::Rect sceneRect = getRect();
+    const cv::Size zoomedSize(
+        static_cast<int>(std::lround(sceneRect.width * zoom)),
+        static_cast<int>(std::lround(sceneRect.height * zoom)));
+    if(patchSize.width>zoomedSize.width || patchSize.height>zoomedSize.height)
+        return;
+    // bands keep native pixels of the level with the lowest resolution covering the zoom,
+    // patches are resampled from the band with the same scale
+    const double sceneWidth = static_cast<double>(sceneRect.width);
+    const int level = Tools::findZoomLevel(zoom, getNumLevels(), [this, sceneWidth](int index){
+        return getLevelInfo(index).size.width/sceneWidth;
+    });
+    const cv::Size levelSize = getLevelInfo(level).size;
+    const cv::Rect levelBounds(cv::Point(0, 0), levelSize);
+    const double scaleX = static_cast<double>(levelSize.width) / (sceneRect.width * zoom);
+    const double scaleY = static_cast<double>(levelSize.height) / (sceneRect.height * zoom);
+    // type of bands not covered by data
+    const int firstChannel = channelIndices.empty() ? 0 : channelIndices.front();
+    const int numChannels = channelIndices.empty() ? getNumChannels() : static_cast<int>(channelIndices.size());
+    const int bandType = CV_MAKETYPE(toOpencvType(getChannelDataType(firstChannel)), numChannels);
+    // band keeps rows [bandTop, bandBottom) of the level
+    cv::Mat band, patch;
+    int bandTop(0), bandBottom(0);
+    for(int y = 0; y + patchSize.height <= zoomedSize.height; y += stride.height)
+    {
+        cv::Rect levelRow;
+        ImageTools::scaleRect(cv::Rect(0, y, zoomedSize.width, patchSize.height), scaleX, scaleY, levelRow);
+        levelRow &= levelBounds;
+        if(levelRow.y >= bandBottom)
+        {
+            // the band does not overlap the row of patches
+            band.release();
+            bandTop = bandBottom = levelRow.y;
+        }
+        else if(levelRow.y > bandTop)
+        {
+            // drop rows above the row of patches
+            band = band.rowRange(levelRow.y - bandTop, band.rows);
+            bandTop = levelRow.y;
+        }
+        const int rowBottom = levelRow.y + levelRow.height;
+        if(rowBottom > bandBottom)
+        {
+            // read the missing rows up to the bottom of the tiles crossing the row end
+            const int stripEnd = std::max(rowBottom, std::min(alignBandEnd(level, rowBottom), levelSize.height));
+            const cv::Rect stripRect(0, bandBottom, levelSize.width, stripEnd - bandBottom);
+            cv::Mat strip;
+            readLevelBlock(level, stripRect, channelIndices, strip);
+            if(strip.empty())
+            {
+                strip = cv::Mat::zeros(stripRect.size(), bandType);
+            }
+            if(band.empty())
+            {
+                band = strip;
+            }
+            else
+            {
+                cv::Mat extendedBand;
+                cv::vconcat(band, strip, extendedBand);
+                band = extendedBand;
+            }
+            bandBottom = stripEnd;
+        }
+        for(int x = 0; x + patchSize.width <= zoomedSize.width; x += stride.width)
+        {
+            const cv::Rect patchRect(x, y, patchSize.width, patchSize.height);
+            cv::Rect levelPatch;
+            ImageTools::scaleRect(patchRect, scaleX, scaleY, levelPatch);
+            levelPatch &= levelBounds;
+            const cv::Mat nativePatch(band, levelPatch - cv::Point(0, bandTop));
+            if(nativePatch.size()==patchSize)
+            {
+                patch = nativePatch;
+            }
+            else
+            {
+                const bool downscale = patchSize.width < nativePatch.cols;
+                cv::resize(nativePatch, patch, patchSize, 0, 0, downscale ? cv::INTER_AREA : cv::INTER_LINEAR);
+            }
+            if(!visitor(patchRect, patch))
+                return;
+        }
+    }
+}
+
 void Scene::read4DBlock(const cv::Rect& blockRect, const cv::Range& zSliceRange, const cv::Range& timeFrameRange,
     cv::OutputArray output)
 {
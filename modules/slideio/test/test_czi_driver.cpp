@@ -5,7 +5,13 @@
 #include "opencv2/slideio/imagedrivermanager.hpp"
 #include "opencv2/slideio/cziimagedriver.hpp"
 #include "testtools.hpp"
+#include "testtiler.hpp"
+#include "opencv2/slideio/cziscene.hpp"
 #include "opencv2/slideio/czislide.hpp"
+#include "opencv2/slideio/imagetools.hpp"
+#include "opencv2/slideio/tilecache.hpp"
+#include <fstream>
+#include <sstream>
 
 namespace opencv_test
 {
@@ -261,6 +267,26 @@ TEST(Slideio_CZIImageDriver, sceneIdsFromDims)
     }
 }
 
+TEST(Slideio_CZIImageDriver, getTilesInRect)
+{
+    slideio::CZIImageDriver driver;
+    std::string filePath = TestTools::getTestImagePath("czi","test3.czi");
+    cv::Ptr<slideio::Slide> slide = driver.openFile(filePath);
+    ASSERT_TRUE(slide!=nullptr);
+    for(int sceneIndex=0; sceneIndex<slide->getNumbScenes(); ++sceneIndex)
+    {
+        cv::Ptr<slideio::CZIScene> scene = slide->getScene(sceneIndex).dynamicCast<slideio::CZIScene>();
+        ASSERT_FALSE(scene == nullptr);
+        // mosaic tiles of the base zoom level
+        slideio::CZIScene::TilerData tilerData;
+        tilerData.zoomLevelIndex = 0;
+        tilerData.zSliceIndex = 0;
+        tilerData.tFrameIndex = 0;
+        tilerData.relativeZoom = 1.;
+        expectTilesInRectMatchScan(*scene, &tilerData);
+    }
+}
+
 TEST(Slideio_CZIImageDriver, readBlock3)
 {
     slideio::CZIImageDriver driver;
@@ -334,4 +360,484 @@ TEST(Slideio_CZIImageDriver, readBlock5)
     waitKey(0);
 }
 
+TEST(Slideio_CZIImageDriver, readJpegXRBlock)
+{
+    slideio::CZIImageDriver driver;
+    std::string filePath = TestTools::getTestImagePath("czi","jxr-rgb-5scenes.czi");
+    cv::Ptr<slideio::Slide> slide = driver.openFile(filePath);
+    ASSERT_TRUE(slide!=nullptr);
+    auto scene = slide->getScene(0);
+    ASSERT_FALSE(scene == nullptr);
+    ASSERT_EQ(3, scene->getNumChannels());
+    const cv::Rect sceneRect = scene->getRect();
+    const cv::Rect blockRect(sceneRect.x + sceneRect.width/4, sceneRect.y + sceneRect.height/4,
+        sceneRect.width/2, sceneRect.height/2);
+    cv::Mat raster;
+    scene->readBlock(blockRect, raster);
+    ASSERT_EQ(blockRect.size(), raster.size());
+    EXPECT_EQ(CV_8UC3, raster.type());
+    EXPECT_LT(0., cv::norm(raster, cv::NORM_L1));
+    // channels keep the order of the Bgr24 pixel type for any order of the stream
+    std::vector<cv::Mat> channelRasters;
+    cv::split(raster, channelRasters);
+    for(int channel = 0; channel < 3; ++channel)
+    {
+        cv::Mat channelRaster;
+        scene->readBlockChannels(blockRect, {channel}, channelRaster);
+        EXPECT_EQ(0., cv::norm(channelRasters[channel], channelRaster, cv::NORM_INF));
+    }
+}
+
+TEST(Slideio_CZIImageDriver, readBlockConcurrent)
+{
+    slideio::CZIImageDriver driver;
+    std::string filePath = TestTools::getTestImagePath("czi","test3.czi");
+    cv::Ptr<slideio::Slide> slide = driver.openFile(filePath);
+    ASSERT_TRUE(slide!=nullptr);
+    const int numScenes = slide->getNumbScenes();
+    ASSERT_GT(numScenes, 1);
+    std::vector<cv::Mat> sequential(numScenes);
+    for(int sceneIndex=0; sceneIndex<numScenes; ++sceneIndex)
+    {
+        auto scene = slide->getScene(sceneIndex);
+        scene->readBlock(scene->getRect(), sequential[sceneIndex]);
+    }
+    // all scenes share one opened file
+    std::vector<cv::Mat> concurrent(numScenes);
+    cv::parallel_for_(cv::Range(0, numScenes), [&](const cv::Range& range)
+    {
+        for(int sceneIndex=range.start; sceneIndex<range.end; ++sceneIndex)
+        {
+            auto scene = slide->getScene(sceneIndex);
+            scene->readBlock(scene->getRect(), concurrent[sceneIndex]);
+        }
+    });
+    for(int sceneIndex=0; sceneIndex<numScenes; ++sceneIndex)
+    {
+        ASSERT_EQ(sequential[sceneIndex].size(), concurrent[sceneIndex].size());
+        EXPECT_EQ(0., cv::norm(sequential[sceneIndex], concurrent[sceneIndex], cv::NORM_INF));
+    }
+}
+
+TEST(Slideio_CZIImageDriver, visitPatches)
+{
+    slideio::CZIImageDriver driver;
+    std::string filePath = TestTools::getTestImagePath("czi","test3.czi");
+    cv::Ptr<slideio::Slide> slide = driver.openFile(filePath);
+    ASSERT_TRUE(slide!=nullptr);
+    auto scene = slide->getScene(0);
+    ASSERT_FALSE(scene == nullptr);
+    const cv::Rect sceneRect = scene->getRect();
+    const cv::Size patchSize(std::min(256, sceneRect.width), std::min(256, sceneRect.height));
+    const cv::Size stride(patchSize.width/2, patchSize.height/2);
+    const std::vector<int> channelIndices;
+    // without caching every tile read is a decode counted as a cache miss
+    slideio::TileCache& cache = slideio::TileCache::instance();
+    const size_t orgCapacity = cache.getCapacity();
+    cache.setCapacity(0);
+    cache.resetStatistics();
+    int patchCount = 0;
+    scene->visitPatches(patchSize, stride, 1., channelIndices,
+        [&](const cv::Rect&, const cv::Mat& patch)
+    {
+        EXPECT_EQ(patchSize, patch.size());
+        ++patchCount;
+        return true;
+    });
+    const uint64_t decodes = cache.getStatistics().misses;
+    cache.setCapacity(orgCapacity);
+    EXPECT_LT(0, patchCount);
+    // bands end at the bottom of tiles crossing the rows of patches: a tile
+    // is decoded by two bands at most
+    EXPECT_LT(0u, decodes);
+    EXPECT_LE(decodes, 2u * static_cast<uint64_t>(scene->getLevelTileCount(0)));
+}
+
+TEST(Slideio_CZIImageDriver, alignBandEnd)
+{
+    slideio::CZIImageDriver driver;
+    std::string filePath = TestTools::getTestImagePath("czi","test3.czi");
+    cv::Ptr<slideio::Slide> slide = driver.openFile(filePath);
+    ASSERT_TRUE(slide!=nullptr);
+    for(int sceneIndex = 0; sceneIndex < slide->getNumbScenes(); ++sceneIndex)
+    {
+        auto scene = slide->getScene(sceneIndex);
+        ASSERT_FALSE(scene == nullptr);
+        for(int level = 0; level < scene->getNumLevels(); ++level)
+        {
+            // bands of overlapping mosaics grow by one tile height at most
+            const slideio::LevelInfo info = scene->getLevelInfo(level);
+            const int step = std::max(1, info.size.height / 50);
+            for(int row = 0; row <= info.size.height; row += step)
+            {
+                const int bandEnd = scene->alignBandEnd(level, row);
+                EXPECT_LE(row, bandEnd);
+                EXPECT_LE(bandEnd, row + info.tileSize.height);
+            }
+        }
+    }
+    EXPECT_THROW(slide->getScene(0)->alignBandEnd(-1, 0), std::runtime_error);
+}
+
+TEST(Slideio_CZIImageDriver, readLevelBlock)
+{
+    slideio::CZIImageDriver driver;
+    std::string filePath = TestTools::getTestImagePath("czi","test3.czi");
+    cv::Ptr<slideio::Slide> slide = driver.openFile(filePath);
+    ASSERT_TRUE(slide!=nullptr);
+    for(int sceneIndex = 0; sceneIndex < slide->getNumbScenes(); ++sceneIndex)
+    {
+        auto scene = slide->getScene(sceneIndex);
+        ASSERT_FALSE(scene == nullptr);
+        const cv::Rect sceneRect = scene->getRect();
+        const slideio::LevelInfo info = scene->getLevelInfo(0);
+        EXPECT_EQ(sceneRect.size(), info.size);
+        // level coordinates are relative to the scene origin
+        const cv::Rect levelRect(info.size.width/4, info.size.height/3, info.size.width/2, info.size.height/2);
+        const std::vector<int> channelIndices;
+        cv::Mat levelRaster, blockRaster;
+        scene->readLevelBlock(0, levelRect, channelIndices, levelRaster);
+        scene->readBlock(levelRect + sceneRect.tl(), blockRaster);
+        ASSERT_EQ(levelRect.size(), levelRaster.size());
+        EXPECT_EQ(0., cv::norm(blockRaster, levelRaster, cv::NORM_INF));
+        // native tiles lie inside the level
+        const cv::Rect levelBounds(cv::Point(0, 0), info.size);
+        for(int tileIndex = 0; tileIndex < scene->getLevelTileCount(0); ++tileIndex)
+        {
+            const cv::Rect tileRect = scene->getLevelTileRect(0, tileIndex);
+            EXPECT_EQ(tileRect, tileRect & levelBounds);
+        }
+    }
+}
+
+TEST(Slideio_CZIImageDriver, readEncodedTile)
+{
+    slideio::CZIImageDriver driver;
+    {
+        // compressed sub-blocks are passed through
+        cv::Ptr<slideio::Slide> slide = driver.openFile(TestTools::getTestImagePath("czi","jxr-rgb-5scenes.czi"));
+        ASSERT_TRUE(slide!=nullptr);
+        auto scene = slide->getScene(0);
+        ASSERT_FALSE(scene == nullptr);
+        const int tileCount = scene->getLevelTileCount(0);
+        int tileIndex = 0;
+        slideio::EncodedTile tile;
+        while(tileIndex<tileCount && !scene->readEncodedTile(0, tileIndex, tile))
+        {
+            tileIndex++;
+        }
+        ASSERT_LT(tileIndex, tileCount);
+        EXPECT_EQ(slideio::Codec::JpegXR, tile.codec);
+        EXPECT_EQ(3, tile.numChannels);
+        const cv::Rect tileRect = scene->getLevelTileRect(0, tileIndex);
+        EXPECT_EQ(tileRect.size(), tile.size);
+        cv::Mat tileRaster;
+        slideio::ImageTools::decodeJxrStream(tile.data, tileRaster);
+        ASSERT_EQ(tile.size, tileRaster.size());
+        cv::Mat levelRaster;
+        scene->readLevelBlock(0, tileRect, std::vector<int>(), levelRaster);
+        ASSERT_EQ(levelRaster.size(), tileRaster.size());
+        // pixels of overlapping tiles may come from their neighbours
+        cv::Mat mask(tileRect.size(), CV_8U, cv::Scalar(255));
+        for(int other = 0; other<tileCount; other++)
+        {
+            const cv::Rect overlap = scene->getLevelTileRect(0, other) & tileRect;
+            if(other!=tileIndex && !overlap.empty())
+            {
+                mask(overlap - tileRect.tl()).setTo(0);
+            }
+        }
+        EXPECT_EQ(0., cv::norm(levelRaster, tileRaster, cv::NORM_INF, mask));
+    }
+    {
+        // uncompressed sub-blocks have no stream to pass
+        cv::Ptr<slideio::Slide> slide = driver.openFile(TestTools::getTestImagePath("czi","pJP31mCherry.czi"));
+        ASSERT_TRUE(slide!=nullptr);
+        auto scene = slide->getScene(0);
+        ASSERT_FALSE(scene == nullptr);
+        slideio::EncodedTile tile;
+        for(int tileIndex = 0; tileIndex<scene->getLevelTileCount(0); tileIndex++)
+        {
+            EXPECT_FALSE(scene->readEncodedTile(0, tileIndex, tile));
+        }
+    }
+}
+
+TEST(Slideio_CZIImageDriver, readBlockInto)
+{
+    slideio::CZIImageDriver driver;
+    std::string filePath = TestTools::getTestImagePath("czi","pJP31mCherry.czi");
+    cv::Ptr<slideio::Slide> slide = driver.openFile(filePath);
+    ASSERT_TRUE(slide!=nullptr);
+    auto scene = slide->getScene(0);
+    ASSERT_FALSE(scene == nullptr);
+    const cv::Rect sceneRect = scene->getRect();
+    const cv::Rect blockRect(sceneRect.x + sceneRect.width/4, sceneRect.y + sceneRect.height/4,
+        sceneRect.width/2, sceneRect.height/2);
+    const cv::Size blockSize(blockRect.width/2, blockRect.height/2);
+    const std::vector<int> channelIndices = { 2, 0 };
+    cv::Mat expected;
+    scene->readResampledBlockChannels(blockRect, blockSize, channelIndices, expected);
+    ASSERT_FALSE(expected.empty());
+    // the block is read to a slot of a batch buffer
+    cv::Mat batch(blockSize.height, 3*blockSize.width, expected.type(), cv::Scalar::all(7));
+    cv::Mat slot = batch.colRange(blockSize.width, 2*blockSize.width);
+    const uchar* slotData = slot.data;
+    scene->readBlockInto(blockRect, blockSize, channelIndices, slot);
+    EXPECT_EQ(slotData, slot.data);
+    EXPECT_EQ(0., cv::norm(expected, slot, cv::NORM_INF));
+    EXPECT_EQ(cv::Scalar(7, 7), cv::mean(batch.colRange(0, blockSize.width)));
+    EXPECT_EQ(cv::Scalar(7, 7), cv::mean(batch.colRange(2*blockSize.width, 3*blockSize.width)));
+    // a block outside of the scene tiles clears the previous content of the slot
+    const cv::Rect outsideRect(sceneRect.x + sceneRect.width + 1000, sceneRect.y, blockRect.width, blockRect.height);
+    scene->readBlockInto(outsideRect, blockSize, channelIndices, slot);
+    EXPECT_EQ(slotData, slot.data);
+    EXPECT_EQ(0., cv::norm(slot, cv::NORM_INF));
+    EXPECT_EQ(cv::Scalar(7, 7), cv::mean(batch.colRange(0, blockSize.width)));
+}
+
+TEST(Slideio_CZIImageDriver, read4DBlock)
+{
+    slideio::CZIImageDriver driver;
+    std::string filePath = TestTools::getTestImagePath("czi","08_18_2018_enc_1001_633.czi");
+    cv::Ptr<slideio::Slide> slide = driver.openFile(filePath);
+    ASSERT_TRUE(slide!=nullptr);
+    auto scene = slide->getScene(0);
+    ASSERT_FALSE(scene == nullptr);
+    const cv::Rect sceneRect = scene->getRect();
+    const cv::Rect blockRect(sceneRect.width/4, sceneRect.height/4, sceneRect.width/2, sceneRect.height/2);
+    const cv::Size blockSize(blockRect.width/2, blockRect.height/2);
+    const std::vector<int> channelIndices = { 2, 0 };
+    const int numZSlices = scene->getNumZSlices();
+    const int numTFrames = scene->getNumTFrames();
+    // the first plane is the 2D block
+    cv::Mat planeRaster, expected;
+    scene->readResampled4DBlockChannels(blockRect, blockSize, channelIndices, cv::Range(0, 0), cv::Range(0, 0), planeRaster);
+    scene->readResampledBlockChannels(blockRect, blockSize, channelIndices, expected);
+    ASSERT_EQ(2, planeRaster.dims);
+    EXPECT_EQ(0., cv::norm(expected, planeRaster, cv::NORM_INF));
+    // all planes are read in one call
+    cv::Mat raster;
+    scene->readResampled4DBlockChannels(blockRect, blockSize, channelIndices,
+        cv::Range(0, numZSlices), cv::Range(0, numTFrames), raster);
+    if(numZSlices * numTFrames > 1)
+    {
+        ASSERT_EQ(4, raster.dims);
+        EXPECT_EQ(numTFrames, raster.size[0]);
+        EXPECT_EQ(numZSlices, raster.size[1]);
+        EXPECT_EQ(blockSize.height, raster.size[2]);
+        EXPECT_EQ(blockSize.width, raster.size[3]);
+        EXPECT_EQ(expected.type(), raster.type());
+        for(int tFrame = 0; tFrame < numTFrames; ++tFrame)
+        {
+            for(int zSlice = 0; zSlice < numZSlices; ++zSlice)
+            {
+                // single planes are read tile by tile without staging of the sub-blocks
+                cv::Mat singlePlane;
+                scene->readResampled4DBlockChannels(blockRect, blockSize, channelIndices,
+                    cv::Range(zSlice, zSlice + 1), cv::Range(tFrame, tFrame + 1), singlePlane);
+                const cv::Mat plane(blockSize, raster.type(), raster.ptr(tFrame, zSlice));
+                EXPECT_EQ(0., cv::norm(singlePlane, plane, cv::NORM_INF));
+            }
+        }
+    }
+    else
+    {
+        EXPECT_EQ(0., cv::norm(expected, raster, cv::NORM_INF));
+    }
+    EXPECT_THROW(scene->readResampled4DBlockChannels(blockRect, blockSize, channelIndices,
+        cv::Range(0, numZSlices + 1), cv::Range(0, 1), raster), std::runtime_error);
+}
+
+// enables memory mapping of CZI files for the scope of a test
+class MemoryMappingScope
+{
+public:
+    MemoryMappingScope() : m_orgMapping(slideio::CZISlide::getMemoryMapping())
+    {
+        slideio::CZISlide::setMemoryMapping(true);
+    }
+    ~MemoryMappingScope()
+    {
+        slideio::CZISlide::setMemoryMapping(m_orgMapping);
+    }
+private:
+    bool m_orgMapping;
+};
+
+TEST(Slideio_CZIImageDriver, readBlockMemoryMapped)
+{
+    std::string filePath = TestTools::getTestImagePath("czi","pJP31mCherry.czi");
+    std::vector<int> channelIndices = {0,1,2};
+    cv::Mat raster, mappedRaster;
+    {
+        slideio::CZIImageDriver driver;
+        cv::Ptr<slideio::Slide> slide = driver.openFile(filePath);
+        ASSERT_TRUE(slide!=nullptr);
+        auto scene = slide->getScene(0);
+        scene->readBlockChannels(scene->getRect(), channelIndices, raster);
+    }
+    {
+        MemoryMappingScope mapping;
+        slideio::CZIImageDriver driver;
+        cv::Ptr<slideio::Slide> slide = driver.openFile(filePath);
+        ASSERT_TRUE(slide!=nullptr);
+        auto scene = slide->getScene(0);
+        scene->readBlockChannels(scene->getRect(), channelIndices, mappedRaster);
+        // single channels are read from planes referenced in the mapping
+        for(const int channel : channelIndices)
+        {
+            cv::Mat channelRaster;
+            scene->readBlockChannels(scene->getRect(), {channel}, channelRaster);
+            cv::Mat expected;
+            cv::extractChannel(mappedRaster, expected, channel);
+            EXPECT_EQ(0., cv::norm(expected, channelRaster, cv::NORM_INF));
+        }
+    }
+    ASSERT_EQ(raster.size(), mappedRaster.size());
+    ASSERT_EQ(raster.type(), mappedRaster.type());
+    EXPECT_EQ(0., cv::norm(raster, mappedRaster, cv::NORM_INF));
+}
+
+TEST(Slideio_CZIImageDriver, subBlockTable)
+{
+    slideio::SubBlockHeader header{};
+    header.metadataSize = 0;
+    header.dataSize = 2 * 3 * 10 * 20;
+    header.direEntry.pixelType = slideio::Gray16;
+    header.direEntry.filePosition = 1000;
+    header.direEntry.compression = slideio::CZISubBlock::Uncompressed;
+    std::vector<slideio::DimensionEntryDV> dimensions(4);
+    const char* names[] = {"X", "Y", "C", "Z"};
+    const int starts[] = {100, 200, 1, 0};
+    const int sizes[] = {20, 10, 2, 3};
+    for(int dim = 0; dim < 4; ++dim)
+    {
+        std::memset(&dimensions[dim], 0, sizeof(slideio::DimensionEntryDV));
+        dimensions[dim].dimension[0] = names[dim][0];
+        dimensions[dim].start = starts[dim];
+        dimensions[dim].size = sizes[dim];
+        dimensions[dim].storedSize = sizes[dim];
+    }
+    header.direEntry.dimensionCount = 4;
+    slideio::CZISubBlockTable table;
+    const int blockIndex = table.addBlock(header, dimensions);
+    ASSERT_EQ(0, blockIndex);
+    ASSERT_EQ(1, table.size());
+    const slideio::CZISubBlock block = table.block(blockIndex);
+    EXPECT_EQ(cv::Rect(100, 200, 20, 10), block.rect());
+    EXPECT_EQ(1., block.zoom());
+    EXPECT_EQ(1, block.firstChannel());
+    EXPECT_EQ(2, block.lastChannel());
+    EXPECT_EQ(2, block.lastZSlice());
+    EXPECT_EQ(0, block.lastTFrame());
+    EXPECT_EQ(cv::slideio::DataType::DT_UInt16, block.dataType());
+    EXPECT_EQ(400, block.planeSize());
+    EXPECT_EQ(1000 + sizeof(slideio::SegmentHeader) + 256, block.dataPosition());
+    // channels are stored first, then z slices
+    EXPECT_EQ(0, block.computeDataOffset(1, 0, 0, 0, 0, 0, 0, 0, 0));
+    EXPECT_EQ(400, block.computeDataOffset(2, 0, 0, 0, 0, 0, 0, 0, 0));
+    EXPECT_EQ(2 * 400 * 2 + 400, block.computeDataOffset(2, 2, 0, 0, 0, 0, 0, 0, 0));
+    EXPECT_EQ(-1, block.computeDataOffset(0, 0, 0, 0, 0, 0, 0, 0, 0));
+    EXPECT_EQ(-1, block.computeDataOffset(1, 0, 1, 0, 0, 0, 0, 0, 0));
+    // codes out of the range of a byte are kept and serialized without truncation
+    header.direEntry.pixelType = 300;
+    header.direEntry.compression = 1000;
+    ASSERT_EQ(1, table.addBlock(header, dimensions));
+    std::stringstream stream(std::ios::in | std::ios::out | std::ios::binary);
+    table.write(stream);
+    slideio::CZISubBlockTable loadedTable;
+    ASSERT_TRUE(loadedTable.read(stream));
+    ASSERT_EQ(2, loadedTable.size());
+    EXPECT_EQ(300, loadedTable.block(1).cziPixelType());
+    EXPECT_EQ(1000, static_cast<int>(loadedTable.block(1).compression()));
+    EXPECT_EQ(slideio::Gray16, loadedTable.block(0).cziPixelType());
+}
+
+static int64_t fileSize(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    return file ? static_cast<int64_t>(file.tellg()) : -1;
+}
+
+// enables the index cache for a copy of a slide and removes the copy,
+// its sidecar index and the cache setting on exit
+class IndexCacheScope
+{
+public:
+    IndexCacheScope(const std::string& sourcePath) : m_slidePath(cv::tempfile(".czi"))
+    {
+        std::ifstream source(sourcePath, std::ios::binary);
+        std::ofstream target(m_slidePath, std::ios::binary);
+        target << source.rdbuf();
+        slideio::CZISlide::setIndexCache(true);
+    }
+    ~IndexCacheScope()
+    {
+        slideio::CZISlide::setIndexCache(false);
+        std::remove(getIndexPath().c_str());
+        std::remove(m_slidePath.c_str());
+    }
+    const std::string& getSlidePath() const { return m_slidePath; }
+    // sidecar next to the slide
+    std::string getIndexPath() const { return m_slidePath + ".slideio-idx"; }
+private:
+    std::string m_slidePath;
+};
+
+TEST(Slideio_CZIImageDriver, directoryIndexCache)
+{
+    IndexCacheScope scope(TestTools::getTestImagePath("czi","test3.czi"));
+    const std::string& filePath = scope.getSlidePath();
+    const std::string indexPath = scope.getIndexPath();
+    std::vector<cv::Mat> rasters[3];
+    std::vector<cv::Rect> rects[3];
+    auto readScenes = [&filePath](std::vector<cv::Mat>& sceneRasters, std::vector<cv::Rect>& sceneRects)
+    {
+        slideio::CZIImageDriver driver;
+        cv::Ptr<slideio::Slide> slide = driver.openFile(filePath);
+        ASSERT_TRUE(slide!=nullptr);
+        for(int sceneIndex=0; sceneIndex<slide->getNumbScenes(); ++sceneIndex)
+        {
+            auto scene = slide->getScene(sceneIndex);
+            cv::Mat raster;
+            scene->readBlock(scene->getRect(), raster);
+            sceneRasters.push_back(raster);
+            sceneRects.push_back(scene->getRect());
+        }
+    };
+    // the first open writes the index
+    readScenes(rasters[0], rects[0]);
+    const int64_t indexSize = fileSize(indexPath);
+    ASSERT_GT(indexSize, 0);
+    // the second open reads it: a valid index is not rewritten,
+    // so a byte appended after its end survives
+    {
+        std::ofstream index(indexPath, std::ios::binary | std::ios::app);
+        index.put(0);
+    }
+    readScenes(rasters[1], rects[1]);
+    EXPECT_EQ(indexSize + 1, fileSize(indexPath));
+    // a corrupted index is rebuilt from the file
+    {
+        std::ifstream source(indexPath, std::ios::binary);
+        std::vector<char> data(static_cast<size_t>(indexSize/2));
+        source.read(data.data(), data.size());
+        source.close();
+        std::ofstream index(indexPath, std::ios::binary | std::ios::trunc);
+        index.write(data.data(), data.size());
+    }
+    readScenes(rasters[2], rects[2]);
+    EXPECT_EQ(indexSize, fileSize(indexPath));
+    for(int pass=1; pass<3; ++pass)
+    {
+        ASSERT_EQ(rects[0].size(), rects[pass].size());
+        for(size_t sceneIndex=0; sceneIndex<rects[0].size(); ++sceneIndex)
+        {
+            EXPECT_EQ(rects[0][sceneIndex], rects[pass][sceneIndex]);
+            EXPECT_EQ(0., cv::norm(rasters[0][sceneIndex], rasters[pass][sceneIndex], cv::NORM_INF));
+        }
+    }
+}
+
 }
@@ -190,4 +190,25 @@ TEST(Slideio_GDALDriver, readBlockPngResampling)
     EXPECT_EQ(colorStddev[2], 0);
 }
 
-}
\ No newline at end of file
+TEST(Slideio_GDALDriver, readBlockIntoPng)
+{
+    slideio::GDALImageDriver driver;
+    std::string path = TestTools::getTestImagePath("gdal","img_1024x600_3x8bit_RGB_color_bars_CMYKWRGB.png");
+    std::shared_ptr<slideio::Slide> slide = driver.openFile(path);
+    ASSERT_TRUE(slide!=nullptr);
+    std::shared_ptr<slideio::Scene> scene = slide->getScene(0);
+    ASSERT_TRUE(scene!=nullptr);
+    const cv::Rect blockRect = {260,400,300,200};
+    const cv::Size blockSize = {150,100};
+    const std::vector<int> channelIndices;
+    cv::Mat expected;
+    scene->readResampledBlock(blockRect, blockSize, expected);
+    // bands are written to a strided view of a larger buffer
+    cv::Mat buffer(2*blockSize.height, 2*blockSize.width, CV_8UC3, cv::Scalar::all(0));
+    cv::Mat view = buffer(cv::Rect(cv::Point(blockSize.width/2, blockSize.height/2), blockSize));
+    scene->readBlockInto(blockRect, blockSize, channelIndices, view);
+    EXPECT_EQ(cv::norm(expected, view, cv::NORM_INF), 0.);
+    EXPECT_EQ(0., cv::norm(buffer.rowRange(0, blockSize.height/2), cv::NORM_INF));
+}
+
+}
@@ -3,7 +3,12 @@
 #include "opencv2/imgproc.hpp"
 #include "opencv2/slideio/tifftools.hpp"
 #include "opencv2/slideio/imagetools.hpp"
+#include "opencv2/slideio/pooledallocator.hpp"
 #include "testtools.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
 
 namespace opencv_test {
 
@@ -79,4 +84,183 @@ TEST(Slideio_ImageTools, readJxrImage)
     waitKey(0);
 }
 
-}
\ No newline at end of file
+TEST(Slideio_ImageTools, decodeJxrStream)
+{
+    std::string pathJxr = TestTools::getTestImagePath("jxr","seagull.wdp");
+    std::ifstream file(pathJxr, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ASSERT_FALSE(data.empty());
+    cv::Mat fileImage;
+    slideio::ImageTools::readJxrImage(pathJxr, fileImage);
+    // decoding into a preallocated buffer keeps the buffer
+    cv::Mat image(fileImage.size(), CV_8UC3);
+    const uchar* buffer = image.data;
+    slideio::ImageTools::decodeJxrStream(data, image);
+    ASSERT_EQ(fileImage.size(), image.size());
+    ASSERT_EQ(CV_8UC3, image.type());
+    EXPECT_EQ(buffer, image.data);
+    // channels are in the BGR order of the reference bitmap
+    const cv::Mat bmpImage = cv::imread(TestTools::getTestImagePath("jxr","seagull.bmp"), cv::IMREAD_COLOR);
+    ASSERT_EQ(bmpImage.size(), image.size());
+    cv::Mat swapped;
+    cv::cvtColor(image, swapped, cv::COLOR_BGR2RGB);
+    const double diff = cv::norm(bmpImage, image, cv::NORM_L1) / static_cast<double>(image.total());
+    const double swappedDiff = cv::norm(bmpImage, swapped, cv::NORM_L1) / static_cast<double>(image.total());
+    EXPECT_LT(2. * diff, swappedDiff);
+}
+
+TEST(Slideio_ImageTools, decodeJp2KStreamPartial)
+{
+    std::string filePath = TestTools::getTestImagePath("jp2K","relax.jp2");
+    std::ifstream file(filePath, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ASSERT_FALSE(data.empty());
+    cv::Mat fullImage;
+    slideio::ImageTools::decodeJp2KStream(data, fullImage);
+    // reduced resolution
+    cv::Mat reducedImage;
+    slideio::ImageTools::decodeJp2KStream(data, reducedImage, std::vector<int>(), false, 1);
+    EXPECT_EQ(150, reducedImage.rows);
+    EXPECT_EQ(200, reducedImage.cols);
+    EXPECT_EQ(3, reducedImage.channels());
+    // region and channel subset
+    const cv::Rect area(100, 50, 200, 100);
+    const std::vector<int> channels = {2};
+    cv::Mat areaImage;
+    slideio::ImageTools::decodeJp2KStream(data, areaImage, channels, false, 0, area);
+    ASSERT_EQ(area.size(), areaImage.size());
+    ASSERT_EQ(1, areaImage.channels());
+    cv::Mat expected;
+    cv::extractChannel(fullImage(area), expected, 2);
+    EXPECT_GE(1., cv::norm(expected, areaImage, cv::NORM_INF));
+}
+
+TEST(Slideio_ImageTools, decodeJp2KStreamFused)
+{
+    std::string filePath = TestTools::getTestImagePath("jp2K","relax.jp2");
+    std::ifstream file(filePath, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ASSERT_FALSE(data.empty());
+    const slideio::ImageTools::Jp2KDecoderOptions defaultOptions = slideio::ImageTools::getJp2KDecoderOptions();
+    const std::vector<int> channels = {2, 0};
+    const std::vector<int> singleChannel = {1};
+    // odd width leaves pixels for the scalar tail of vectorized rows
+    const cv::Rect area(3, 5, 131, 77);
+    cv::Mat image, imageYUV, imageChannels, imageSingle, imageArea;
+    slideio::ImageTools::decodeJp2KStream(data, image);
+    slideio::ImageTools::decodeJp2KStream(data, imageYUV, std::vector<int>(), true);
+    slideio::ImageTools::decodeJp2KStream(data, imageChannels, channels);
+    slideio::ImageTools::decodeJp2KStream(data, imageSingle, singleChannel);
+    slideio::ImageTools::decodeJp2KStream(data, imageArea, std::vector<int>(), false, 0, area);
+
+    slideio::ImageTools::Jp2KDecoderOptions options;
+    options.numThreads = 4;
+    options.fusedConversion = true;
+    slideio::ImageTools::setJp2KDecoderOptions(options);
+    cv::Mat fusedImage, fusedImageYUV, fusedImageChannels, fusedImageSingle, fusedImageArea;
+    slideio::ImageTools::decodeJp2KStream(data, fusedImage);
+    slideio::ImageTools::decodeJp2KStream(data, fusedImageYUV, std::vector<int>(), true);
+    slideio::ImageTools::decodeJp2KStream(data, fusedImageChannels, channels);
+    slideio::ImageTools::decodeJp2KStream(data, fusedImageSingle, singleChannel);
+    slideio::ImageTools::decodeJp2KStream(data, fusedImageArea, std::vector<int>(), false, 0, area);
+    slideio::ImageTools::setJp2KDecoderOptions(defaultOptions);
+
+    ASSERT_EQ(image.size(), fusedImage.size());
+    ASSERT_EQ(image.type(), fusedImage.type());
+    EXPECT_EQ(0., cv::norm(image, fusedImage, cv::NORM_INF));
+    ASSERT_EQ(imageYUV.type(), fusedImageYUV.type());
+    EXPECT_EQ(0., cv::norm(imageYUV, fusedImageYUV, cv::NORM_INF));
+    ASSERT_EQ(2, fusedImageChannels.channels());
+    EXPECT_EQ(0., cv::norm(imageChannels, fusedImageChannels, cv::NORM_INF));
+    ASSERT_EQ(CV_8UC1, fusedImageSingle.type());
+    EXPECT_EQ(0., cv::norm(imageSingle, fusedImageSingle, cv::NORM_INF));
+    ASSERT_EQ(area.size(), fusedImageArea.size());
+    EXPECT_EQ(0., cv::norm(imageArea, fusedImageArea, cv::NORM_INF));
+}
+
+TEST(Slideio_ImageTools, encodeJpegStreamBanded)
+{
+    cv::Mat image(1536, 2048, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(image, image, cv::Size(15, 15), 5.);
+    const int numThreads = cv::getNumThreads();
+    std::vector<uint8_t> serialStream, bandedStream;
+    cv::setNumThreads(1);
+    slideio::ImageTools::encodeJpegStream(image, serialStream, 90);
+    cv::setNumThreads(4);
+    slideio::ImageTools::encodeJpegStream(image, bandedStream, 90);
+    cv::setNumThreads(numThreads);
+    // bands are joined by restart markers
+    const uint8_t restartMarker[] = { 0xFF, 0xD0 };
+    EXPECT_EQ(serialStream.end(), std::search(serialStream.begin(), serialStream.end(),
+        restartMarker, restartMarker + 2));
+    EXPECT_NE(bandedStream.end(), std::search(bandedStream.begin(), bandedStream.end(),
+        restartMarker, restartMarker + 2));
+    cv::Mat serialImage, bandedImage;
+    slideio::ImageTools::decodeJpegStream(serialStream, serialImage);
+    slideio::ImageTools::decodeJpegStream(bandedStream, bandedImage);
+    ASSERT_EQ(image.size(), bandedImage.size());
+    EXPECT_EQ(0., cv::norm(serialImage, bandedImage, cv::NORM_INF));
+    EXPECT_LT(30., cv::PSNR(image, bandedImage));
+}
+
+TEST(Slideio_ImageTools, encodePngStream)
+{
+    cv::Mat image(300, 400, CV_16UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(65535));
+    std::vector<uint8_t> stream;
+    slideio::ImageTools::encodePngStream(image, stream);
+    ASSERT_LT(8u, stream.size());
+    const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    EXPECT_TRUE(std::equal(signature, signature + 8, stream.begin()));
+    std::string pngPath = cv::tempfile(".png");
+    {
+        std::ofstream file(pngPath, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(stream.data()), stream.size());
+    }
+    cv::Mat decodedImage;
+    slideio::ImageTools::readGDALImage(pngPath, decodedImage);
+    std::remove(pngPath.c_str());
+    ASSERT_EQ(image.size(), decodedImage.size());
+    ASSERT_EQ(image.type(), decodedImage.type());
+    EXPECT_EQ(0., cv::norm(image, decodedImage, cv::NORM_INF));
+}
+
+TEST(Slideio_ImageTools, pooledMatAllocator)
+{
+    slideio::PooledMatAllocator& pool = slideio::PooledMatAllocator::instance();
+    ASSERT_TRUE(slideio::PooledMatAllocator::isEnabled());
+    pool.resetStatistics();
+    const uchar* firstData = nullptr;
+    {
+        cv::Mat raster;
+        raster.allocator = slideio::PooledMatAllocator::getAllocator();
+        raster.create(256, 256, CV_8UC3);
+        firstData = raster.data;
+    }
+    // released buffer of the same size class is reused by the thread
+    cv::Mat raster;
+    raster.allocator = slideio::PooledMatAllocator::getAllocator();
+    raster.create(250, 260, CV_8UC3);
+    EXPECT_EQ(firstData, raster.data);
+    raster.setTo(cv::Scalar(1, 2, 3));
+    EXPECT_EQ(cv::Vec3b(1, 2, 3), raster.at<cv::Vec3b>(249, 259));
+    const slideio::PooledMatAllocator::Statistics statistics = pool.getStatistics();
+    EXPECT_EQ(2u, statistics.allocations);
+    EXPECT_EQ(1u, statistics.reuses);
+    EXPECT_DOUBLE_EQ(0.5, statistics.reuseRate());
+    // released buffers beyond the capacity of the process are freed
+    const size_t orgCapacity = pool.getCapacity();
+    pool.setCapacity(0);
+    raster.release();
+    const slideio::PooledMatAllocator::Statistics capped = pool.getStatistics();
+    EXPECT_EQ(1u, capped.discards);
+    EXPECT_EQ(statistics.cachedMemory, capped.cachedMemory);
+    pool.setCapacity(orgCapacity);
+    // disabled pool leaves the default allocator
+    slideio::PooledMatAllocator::setEnabled(false);
+    EXPECT_EQ(nullptr, slideio::PooledMatAllocator::getAllocator());
+    slideio::PooledMatAllocator::setEnabled(true);
+}
+
+}
@@ -2,9 +2,11 @@
 #include "opencv2/slideio/svsimagedriver.hpp"
 #include "opencv2/slideio/svstiledscene.hpp"
 #include "opencv2/slideio/imagetools.hpp"
+#include "opencv2/slideio/tilecache.hpp"
 #include "opencv2/core.hpp"
 #include "opencv2/imgproc.hpp"
 #include "testtools.hpp"
+#include "testtiler.hpp"
 #include <stdint.h>
 #include <algorithm>
 #include <functional>
@@ -192,6 +194,108 @@ TEST(Slideio_SVSImageDriver, findZoomDirectory)
     EXPECT_EQ(scene.findZoomDirectory(0.1).dirIndex, 3);
 }
 
+TEST(Slideio_SVSImageDriver, levelInfo)
+{
+    std::vector<slideio::TiffDirectory> dirs;
+    dirs.resize(3);
+    int scale = 1;
+    for(int index = 0; index < static_cast<int>(dirs.size()); ++index)
+    {
+        dirs[index].width = 38528 / scale;
+        dirs[index].height = 77056 / scale;
+        dirs[index].tileWidth = 256;
+        dirs[index].tileHeight = 240;
+        dirs[index].dirIndex = index;
+        scale *= 4;
+    }
+    slideio::SVSTiledScene scene("path", "name", dirs, nullptr);
+    ASSERT_EQ(3, scene.getNumLevels());
+    const slideio::LevelInfo info = scene.getLevelInfo(2);
+    EXPECT_EQ(2, info.level);
+    EXPECT_EQ(cv::Size(38528 / 16, 77056 / 16), info.size);
+    EXPECT_DOUBLE_EQ(16., info.downsample);
+    EXPECT_EQ(cv::Size(256, 240), info.tileSize);
+    EXPECT_THROW(scene.getLevelInfo(3), std::runtime_error);
+}
+
+TEST(Slideio_SVSImageDriver, readLevelBlock)
+{
+    slideio::SVSImageDriver driver;
+    std::string path = TestTools::getTestImagePath("svs", "CMU-1-Small-Region.svs");
+    std::shared_ptr<slideio::Slide> slide = driver.openFile(path);
+    ASSERT_TRUE(slide != nullptr);
+    std::shared_ptr<slideio::Scene> scene = slide->getScene(0);
+    ASSERT_TRUE(scene != nullptr);
+    ASSERT_LE(1, scene->getNumLevels());
+    const std::vector<int> channelIndices;
+    // native pixels of the base level
+    const cv::Rect blockRect(1000, 1200, 300, 200);
+    cv::Mat levelRaster, blockRaster;
+    scene->readLevelBlock(0, blockRect, channelIndices, levelRaster);
+    scene->readBlock(blockRect, blockRaster);
+    ASSERT_EQ(blockRect.size(), levelRaster.size());
+    EXPECT_EQ(cv::norm(blockRaster, levelRaster, cv::NORM_INF), 0.);
+    // the last level is read without resampling
+    const int lastLevel = scene->getNumLevels() - 1;
+    const slideio::LevelInfo info = scene->getLevelInfo(lastLevel);
+    const cv::Rect levelRect(info.size.width / 4, info.size.height / 4, info.size.width / 2, info.size.height / 2);
+    scene->readLevelBlock(lastLevel, levelRect, channelIndices, levelRaster);
+    EXPECT_EQ(levelRect.size(), levelRaster.size());
+    EXPECT_THROW(scene->readLevelBlock(lastLevel + 1, levelRect, channelIndices, levelRaster), std::runtime_error);
+}
+
+TEST(Slideio_SVSImageDriver, readEncodedTile)
+{
+    slideio::SVSImageDriver driver;
+    std::string path = TestTools::getTestImagePath("svs", "CMU-1-Small-Region.svs");
+    std::shared_ptr<slideio::Slide> slide = driver.openFile(path);
+    ASSERT_TRUE(slide != nullptr);
+    std::shared_ptr<slideio::Scene> scene = slide->getScene(0);
+    ASSERT_TRUE(scene != nullptr);
+    ASSERT_LT(1, scene->getLevelTileCount(0));
+    slideio::EncodedTile tile;
+    ASSERT_TRUE(scene->readEncodedTile(0, 0, tile));
+    EXPECT_EQ(slideio::Codec::Jpeg, tile.codec);
+    ASSERT_LT(4u, tile.data.size());
+    // standalone stream: starts with SOI and is decoded without the tables of the directory
+    EXPECT_EQ(0xFF, tile.data[0]);
+    EXPECT_EQ(0xD8, tile.data[1]);
+    cv::Mat tileRaster;
+    slideio::ImageTools::decodeJpegStream(tile.data, tileRaster);
+    EXPECT_EQ(tile.size, tileRaster.size());
+    EXPECT_EQ(tile.numChannels, tileRaster.channels());
+    const cv::Rect tileRect = scene->getLevelTileRect(0, 0);
+    cv::Mat levelRaster;
+    scene->readLevelBlock(0, tileRect, std::vector<int>(), levelRaster);
+    EXPECT_EQ(cv::norm(levelRaster, tileRaster, cv::NORM_INF), 0.);
+    // the stream is decodable by a generic decoder that knows nothing about tiff
+    cv::Mat decodedRaster = cv::imdecode(tile.data, cv::IMREAD_COLOR);
+    ASSERT_EQ(levelRaster.size(), decodedRaster.size());
+    cv::cvtColor(decodedRaster, decodedRaster, cv::COLOR_BGR2RGB);
+    // decoders may differ in idct rounding
+    EXPECT_LT(cv::norm(levelRaster, decodedRaster, cv::NORM_L1)/static_cast<double>(levelRaster.total()*3), 1.);
+}
+
+TEST(Slideio_SVSImageDriver, getTilesInRect)
+{
+    slideio::SVSImageDriver driver;
+    std::string path = TestTools::getTestImagePath("svs", "JP2K-33003-1.svs");
+    std::shared_ptr<slideio::Slide> slide = driver.openFile(path);
+    ASSERT_TRUE(slide != nullptr);
+    std::shared_ptr<slideio::SVSTiledScene> scene =
+        std::dynamic_pointer_cast<slideio::SVSTiledScene>(slide->getScene(0));
+    ASSERT_TRUE(scene != nullptr);
+    // the grid of the base level and of a reduced level with partial tiles at the borders
+    for(const double zoom : { 1., 0.25 })
+    {
+        const slideio::TiffDirectory& dir = scene->findZoomDirectory(zoom);
+        slideio::SVSTiledScene::TilerData tilerData;
+        tilerData.dir = &dir;
+        tilerData.scaleDenom = 1;
+        expectTilesInRectMatchScan(*scene, &tilerData);
+    }
+}
+
 TEST(Slideio_SVSImageDriver, readBlock_WholeImage)
 {
     slideio::SVSImageDriver driver;
@@ -296,6 +400,227 @@ TEST(Slideio_SVSImageDriver, readBlock_PartScale)
     //    waitKey(0);
     //}
 }
+TEST(Slideio_SVSImageDriver, visitPatches)
+{
+    slideio::SVSImageDriver driver;
+    std::string path = TestTools::getTestImagePath("svs", "CMU-1-Small-Region.svs");
+    std::shared_ptr<slideio::Slide> slide = driver.openFile(path);
+    ASSERT_TRUE(slide != nullptr);
+    std::shared_ptr<slideio::Scene> scene = slide->getScene(0);
+    ASSERT_TRUE(scene != nullptr);
+    const cv::Rect sceneRect = scene->getRect();
+    const cv::Size patchSize(300, 300);
+    const cv::Size stride(250, 250);
+    const std::vector<int> channelIndices;
+    int patchCount = 0;
+    scene->visitPatches(patchSize, stride, 1., channelIndices,
+        [&](const cv::Rect& patchRect, const cv::Mat& patch)
+    {
+        EXPECT_EQ(patchSize, patch.size());
+        if(patchCount % 10 == 0)
+        {
+            cv::Mat blockRaster;
+            scene->readBlock(patchRect + sceneRect.tl(), blockRaster);
+            EXPECT_EQ(cv::norm(blockRaster, patch, cv::NORM_INF), 0.);
+        }
+        ++patchCount;
+        return true;
+    });
+    const int patchesX = (sceneRect.width - patchSize.width) / stride.width + 1;
+    const int patchesY = (sceneRect.height - patchSize.height) / stride.height + 1;
+    EXPECT_EQ(patchesX * patchesY, patchCount);
+    // patches at half resolution are cut from the level resampled at once: no seams or shifts
+    // between bands. The zoom selects the base level or the level of downsample 2.
+    int level = 0;
+    while(level + 1 < scene->getNumLevels() && scene->getLevelInfo(level + 1).downsample <= 2.)
+    {
+        ++level;
+    }
+    const slideio::LevelInfo levelInfo = scene->getLevelInfo(level);
+    cv::Mat levelRaster, zoomedRaster;
+    scene->readLevelBlock(level, cv::Rect(cv::Point(0, 0), levelInfo.size), channelIndices, levelRaster);
+    if(levelInfo.downsample < 1.5)
+    {
+        const cv::Rect evenRect(0, 0, levelRaster.cols & ~1, levelRaster.rows & ~1);
+        cv::resize(levelRaster(evenRect), zoomedRaster, cv::Size(evenRect.width/2, evenRect.height/2), 0, 0, cv::INTER_AREA);
+    }
+    else
+    {
+        zoomedRaster = levelRaster;
+    }
+    const cv::Rect zoomedBounds(cv::Point(0, 0), zoomedRaster.size());
+    const cv::Size halfPatchSize(128, 96);
+    const cv::Size halfStride(100, 90);
+    int comparedCount = 0;
+    scene->visitPatches(halfPatchSize, halfStride, 0.5, channelIndices,
+        [&](const cv::Rect& patchRect, const cv::Mat& patch)
+    {
+        EXPECT_EQ(halfPatchSize, patch.size());
+        if((patchRect & zoomedBounds) == patchRect)
+        {
+            EXPECT_EQ(0., cv::norm(zoomedRaster(patchRect), patch, cv::NORM_INF));
+            ++comparedCount;
+        }
+        return true;
+    });
+    EXPECT_LT(0, comparedCount);
+    // the visitor stops the iteration
+    patchCount = 0;
+    scene->visitPatches(patchSize, stride, 0.5, channelIndices,
+        [&](const cv::Rect&, const cv::Mat&)
+    {
+        return ++patchCount < 3;
+    });
+    EXPECT_EQ(3, patchCount);
+}
+
+TEST(Slideio_SVSImageDriver, readBlockAsync)
+{
+    slideio::SVSImageDriver driver;
+    std::string path = TestTools::getTestImagePath("svs", "CMU-1-Small-Region.svs");
+    std::shared_ptr<slideio::Slide> slide = driver.openFile(path);
+    ASSERT_TRUE(slide != nullptr);
+    std::shared_ptr<slideio::Scene> scene = slide->getScene(0);
+    ASSERT_TRUE(scene != nullptr);
+    const std::vector<int> channelIndices;
+    const std::vector<cv::Rect> blockRects = {
+        { 0, 0, 500, 400 }, { 1000, 1200, 300, 300 }, { 1500, 2000, 700, 900 }, { 100, 2500, 256, 256 } };
+    const cv::Size blockSize(200, 200);
+    std::vector<std::future<cv::Mat>> futures;
+    for(const cv::Rect& blockRect : blockRects)
+    {
+        futures.push_back(slideio::Scene::readBlockAsync(scene, blockRect, blockSize, channelIndices));
+    }
+    for(size_t block = 0; block < blockRects.size(); ++block)
+    {
+        cv::Mat expected;
+        scene->readResampledBlock(blockRects[block], blockSize, expected);
+        const cv::Mat raster = futures[block].get();
+        ASSERT_EQ(expected.size(), raster.size());
+        EXPECT_EQ(cv::norm(expected, raster, cv::NORM_INF), 0.);
+    }
+    // cancelled read is not performed
+    cv::Ptr<slideio::ReadCancellation> cancellation = cv::makePtr<slideio::ReadCancellation>();
+    cancellation->cancel();
+    std::future<cv::Mat> cancelled = slideio::Scene::readBlockAsync(scene, blockRects[0], blockSize, channelIndices, cancellation);
+    EXPECT_THROW(cancelled.get(), std::runtime_error);
+    // pending reads keep the scene alive
+    cv::Mat expected;
+    scene->readResampledBlock(blockRects[1], blockSize, expected);
+    std::future<cv::Mat> pending = slideio::Scene::readBlockAsync(scene, blockRects[1], blockSize, channelIndices);
+    scene.reset();
+    slide.reset();
+    const cv::Mat raster = pending.get();
+    EXPECT_EQ(cv::norm(expected, raster, cv::NORM_INF), 0.);
+}
+
+TEST(Slideio_SVSImageDriver, readBlockInto)
+{
+    slideio::SVSImageDriver driver;
+    std::string path = TestTools::getTestImagePath("svs", "CMU-1-Small-Region.svs");
+    std::shared_ptr<slideio::Slide> slide = driver.openFile(path);
+    ASSERT_TRUE(slide != nullptr);
+    const cv::Size blockSize(200, 150);
+    // tiled scene and thumbnail read to slots of a batch buffer
+    for(int sceneIndex : { 0, 1 })
+    {
+        std::shared_ptr<slideio::Scene> scene = slide->getScene(sceneIndex);
+        ASSERT_TRUE(scene != nullptr);
+        const cv::Rect sceneRect = scene->getRect();
+        const cv::Rect blockRect(sceneRect.width/5, sceneRect.height/4, sceneRect.width/3, sceneRect.height/3);
+        const std::vector<int> channelIndices = { 2, 0 };
+        cv::Mat batch(blockSize.height, 3*blockSize.width, CV_8UC2, cv::Scalar(7, 7));
+        cv::Mat slot = batch.colRange(blockSize.width, 2*blockSize.width);
+        const uchar* slotData = slot.data;
+        scene->readBlockInto(blockRect, blockSize, channelIndices, slot);
+        EXPECT_EQ(slotData, slot.data);
+        cv::Mat expected;
+        scene->readResampledBlockChannels(blockRect, blockSize, channelIndices, expected);
+        EXPECT_EQ(cv::norm(expected, batch.colRange(blockSize.width, 2*blockSize.width), cv::NORM_INF), 0.);
+        // neighbour slots are not touched
+        EXPECT_EQ(cv::Scalar(7, 7), cv::mean(batch.colRange(0, blockSize.width)));
+        EXPECT_EQ(cv::Scalar(7, 7), cv::mean(batch.colRange(2*blockSize.width, 3*blockSize.width)));
+        // buffers of another size or type are rejected
+        cv::Mat wrongType(blockSize, CV_8UC3);
+        EXPECT_THROW(scene->readBlockInto(blockRect, blockSize, channelIndices, wrongType), std::runtime_error);
+        cv::Mat wrongSize(blockSize.height + 1, blockSize.width, CV_8UC2);
+        EXPECT_THROW(scene->readBlockInto(blockRect, blockSize, channelIndices, wrongSize), std::runtime_error);
+    }
+    {
+        // channels of a thumbnail block without resampling are written to the view directly
+        std::shared_ptr<slideio::Scene> scene = slide->getScene(1);
+        ASSERT_TRUE(scene != nullptr);
+        const cv::Rect sceneRect = scene->getRect();
+        const cv::Rect blockRect(sceneRect.width/4, sceneRect.height/4, sceneRect.width/2, sceneRect.height/2);
+        const std::vector<int> channelIndices = { 1, 2 };
+        cv::Mat batch(blockRect.height + 2, blockRect.width + 6, CV_8UC2, cv::Scalar(7, 7));
+        cv::Mat view = batch(cv::Rect(cv::Point(3, 1), blockRect.size()));
+        const uchar* viewData = view.data;
+        scene->readBlockInto(blockRect, cv::Size(), channelIndices, view);
+        EXPECT_EQ(viewData, view.data);
+        cv::Mat expected;
+        scene->readBlockChannels(blockRect, channelIndices, expected);
+        EXPECT_EQ(cv::norm(expected, view, cv::NORM_INF), 0.);
+        EXPECT_EQ(cv::Scalar(7, 7), cv::mean(batch.row(0)));
+        EXPECT_EQ(cv::Scalar(7, 7), cv::mean(batch.colRange(0, 3)));
+    }
+    {
+        // a block without tiles clears the previous content of the view
+        std::shared_ptr<slideio::Scene> scene = slide->getScene(0);
+        const cv::Rect sceneRect = scene->getRect();
+        const cv::Rect blockRect(sceneRect.width + 1000, sceneRect.height + 1000, 400, 300);
+        const std::vector<int> channelIndices = { 2, 0 };
+        cv::Mat batch(blockSize.height, 2*blockSize.width, CV_8UC2, cv::Scalar(7, 7));
+        cv::Mat slot = batch.colRange(0, blockSize.width);
+        scene->readBlockInto(blockRect, blockSize, channelIndices, slot);
+        EXPECT_EQ(0., cv::norm(slot, cv::NORM_INF));
+        EXPECT_EQ(cv::Scalar(7, 7), cv::mean(batch.colRange(blockSize.width, 2*blockSize.width)));
+    }
+}
+
+TEST(Slideio_SVSImageDriver, readComposedBlockChannels)
+{
+    slideio::SVSImageDriver driver;
+    std::string path = TestTools::getTestImagePath("svs", "CMU-1-Small-Region.svs");
+    std::shared_ptr<slideio::Slide> slide = driver.openFile(path);
+    ASSERT_TRUE(slide != nullptr);
+    std::shared_ptr<slideio::Scene> scene = slide->getScene(0);
+    ASSERT_TRUE(scene != nullptr);
+    // the zoom is served by the base directory
+    const cv::Rect blockRect(700, 900, 400, 300);
+    const cv::Size blockSize(300, 225);
+    const std::vector<int> channelIndices;
+    cv::Mat nativeRaster, expected, singlePass, perTile, defaultRaster;
+    scene->readBlock(blockRect, nativeRaster);
+    cv::resize(nativeRaster, expected, blockSize, 0, 0, cv::INTER_AREA);
+    scene->readComposedBlockChannels(blockRect, blockSize, channelIndices, slideio::ComposeMode::SinglePass, singlePass);
+    EXPECT_EQ(0., cv::norm(expected, singlePass, cv::NORM_INF));
+    // the mode applies to the call only
+    scene->readComposedBlockChannels(blockRect, blockSize, channelIndices, slideio::ComposeMode::PerTile, perTile);
+    scene->readResampledBlock(blockRect, blockSize, defaultRaster);
+    EXPECT_EQ(0., cv::norm(perTile, defaultRaster, cv::NORM_INF));
+}
+
+TEST(Slideio_SVSImageDriver, tileCacheScope)
+{
+    slideio::TileCache& cache = slideio::TileCache::instance();
+    cache.clear();
+    std::string path = TestTools::getTestImagePath("svs", "CMU-1-Small-Region.svs");
+    {
+        slideio::SVSImageDriver driver;
+        std::shared_ptr<slideio::Slide> slide = driver.openFile(path);
+        ASSERT_TRUE(slide != nullptr);
+        std::shared_ptr<slideio::Scene> scene = slide->getScene(0);
+        ASSERT_TRUE(scene != nullptr);
+        cv::Mat raster;
+        scene->readBlock(cv::Rect(0, 0, 500, 500), raster);
+        EXPECT_LT(0u, cache.getStatistics().tileCount);
+    }
+    // tiles of a closed slide are released
+    EXPECT_EQ(0u, cache.getStatistics().tileCount);
+    EXPECT_EQ(0u, cache.getStatistics().memoryUsage);
+}
+
 //TEST(SVSImageDriver, composeRect2)
 //{
 //    slideio::SVSImageDriver driver;
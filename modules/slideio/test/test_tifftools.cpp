@@ -2,7 +2,9 @@
 #include "opencv2/slideio/tifftools.hpp"
 #include "testtools.hpp"
 #include "opencv2/slideio/imagetools.hpp"
+#include "opencv2/slideio/tiffhandlepool.hpp"
 #include "opencv2/imgproc.hpp"
+#include <tiffio.h>
 
 namespace opencv_test {
 
@@ -37,6 +39,39 @@ TEST(Slideio_TiffTools, scanTiffFile)
     EXPECT_EQ((uint32_t)7,dir5.compression);
 }
 
+TEST(Slideio_TiffTools, scanTiffFileLinear)
+{
+    std::string filePath = TestTools::getTestImagePath("svs","JP2K-33003-1.svs");
+    TIFF* tiff = slideio::TiffTools::openTiffFile(filePath);
+    ASSERT_TRUE(tiff!=nullptr);
+    std::vector<slideio::TiffDirectory> dirs;
+    slideio::TiffTools::scanFile(tiff, dirs);
+    ASSERT_EQ(6, (int)dirs.size());
+    for(int dirIndex=0; dirIndex<(int)dirs.size(); ++dirIndex)
+    {
+        slideio::TiffDirectory dir;
+        slideio::TiffTools::scanTiffDir(tiff, dirIndex, 0, dir);
+        const slideio::TiffDirectory& scanned = dirs[dirIndex];
+        EXPECT_EQ(dirIndex, scanned.dirIndex);
+        EXPECT_EQ(dir.ifdOffset, scanned.ifdOffset);
+        EXPECT_GT(scanned.ifdOffset, 0);
+        EXPECT_EQ(dir.width, scanned.width);
+        EXPECT_EQ(dir.height, scanned.height);
+        EXPECT_EQ(dir.compression, scanned.compression);
+        EXPECT_EQ(dir.description, scanned.description);
+        EXPECT_EQ(dir.tileOffsets, scanned.tileOffsets);
+    }
+    // directories are switched by their offsets in any order
+    slideio::TiffTools::setCurrentDirectory(tiff, dirs[1]);
+    uint32_t width(0);
+    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
+    EXPECT_EQ(dirs[1].width, (int)width);
+    slideio::TiffTools::setCurrentDirectory(tiff, dirs[5]);
+    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
+    EXPECT_EQ(dirs[5].width, (int)width);
+    slideio::TiffTools::closeTiffFile(tiff);
+}
+
 TEST(Slideio_TiffTools, readStripedDir)
 {
     std::string filePathTiff = TestTools::getTestImagePath("svs","CMU-1-Small-Region.svs");
@@ -118,4 +153,189 @@ TEST(Slideio_TiffTools, readTile_J2K)
     ASSERT_LT(0.99, minScore);
 }
 
-}
\ No newline at end of file
+TEST(Slideio_TiffTools, handlePool)
+{
+    const std::string filePath =
+        TestTools::getTestImagePath("svs","CMU-1-Small-Region.svs");
+    slideio::TiffHandlePool pool(filePath);
+    TIFF* firstHandle(nullptr);
+    {
+        slideio::TiffHandlePool::Lease lease1 = pool.lease();
+        slideio::TiffHandlePool::Lease lease2 = pool.lease();
+        ASSERT_TRUE(lease1.handle()!=nullptr);
+        ASSERT_TRUE(lease2.handle()!=nullptr);
+        EXPECT_NE(lease1.handle(), lease2.handle());
+        firstHandle = lease1.handle();
+    }
+    // released handles are reused
+    slideio::TiffHandlePool::Lease lease3 = pool.lease();
+    slideio::TiffHandlePool::Lease lease4 = pool.lease();
+    EXPECT_TRUE(lease3.handle()==firstHandle || lease4.handle()==firstHandle);
+}
+
+TEST(Slideio_TiffTools, handlePoolIdleLimit)
+{
+    const std::string filePath =
+        TestTools::getTestImagePath("svs","CMU-1-Small-Region.svs");
+    slideio::TiffHandlePool pool(filePath, nullptr, 2);
+    {
+        // a burst of concurrent reads opens more handles than are kept
+        std::vector<slideio::TiffHandlePool::Lease> leases;
+        for(int lease=0; lease<5; lease++)
+        {
+            leases.push_back(pool.lease());
+            ASSERT_TRUE(leases.back().handle()!=nullptr);
+        }
+        EXPECT_EQ(0, pool.getIdleHandleCount());
+    }
+    EXPECT_EQ(2, pool.getIdleHandleCount());
+    {
+        slideio::TiffHandlePool::Lease lease = pool.lease();
+        EXPECT_EQ(1, pool.getIdleHandleCount());
+    }
+    EXPECT_EQ(2, pool.getIdleHandleCount());
+}
+
+// writes a striped 8bit directory filled with the value
+static void writeFilledDirectory(TIFF* tiff, int size, uint8_t value, bool withSubDirectory)
+{
+    TIFFSetField(tiff, TIFFTAG_IMAGEWIDTH, size);
+    TIFFSetField(tiff, TIFFTAG_IMAGELENGTH, size);
+    TIFFSetField(tiff, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tiff, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tiff, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+    TIFFSetField(tiff, TIFFTAG_ROWSPERSTRIP, size);
+    if(withSubDirectory)
+    {
+        // offsets are written by libtiff with the next directory
+        uint64 subOffsets[1] = {0};
+        TIFFSetField(tiff, TIFFTAG_SUBIFD, 1, subOffsets);
+    }
+    std::vector<uint8_t> row(size, value);
+    for(int y=0; y<size; y++)
+    {
+        TIFFWriteScanline(tiff, row.data(), y, 0);
+    }
+    TIFFWriteDirectory(tiff);
+}
+
+TEST(Slideio_TiffTools, setCurrentSubDirectory)
+{
+    const std::string filePath = cv::tempfile(".tif");
+    TIFF* tiff = TIFFOpen(filePath.c_str(), "w");
+    ASSERT_TRUE(tiff!=nullptr);
+    writeFilledDirectory(tiff, 32, 10, true);
+    // sub-directory of the first directory
+    writeFilledDirectory(tiff, 16, 20, false);
+    writeFilledDirectory(tiff, 24, 30, false);
+    TIFFClose(tiff);
+
+    std::vector<slideio::TiffDirectory> dirs;
+    slideio::TiffTools::scanFile(filePath, dirs);
+    ASSERT_EQ(2, (int)dirs.size());
+    ASSERT_EQ(1, (int)dirs[0].subdirectories.size());
+    slideio::TiffDirectory main0 = dirs[0];
+    slideio::TiffDirectory main1 = dirs[1];
+    slideio::TiffDirectory sub0 = dirs[0].subdirectories[0];
+    main0.dataType = main1.dataType = sub0.dataType = slideio::DataType::DT_Byte;
+    EXPECT_EQ(16, sub0.width);
+    EXPECT_NE(sub0.ifdOffset, main0.ifdOffset);
+
+    // switching between the main chain and the sub-directory in any order
+    const std::vector<std::pair<const slideio::TiffDirectory*, double>> sequence = {
+        {&sub0, 20.}, {&main1, 30.}, {&sub0, 20.}, {&main0, 10.}, {&sub0, 20.}, {&main1, 30.}, {&main0, 10.}
+    };
+    {
+        slideio::TiffHandlePool pool(filePath);
+        slideio::TiffHandlePool::Lease handle = pool.lease();
+        for(const auto& step : sequence)
+        {
+            const slideio::TiffDirectory& dir = *step.first;
+            slideio::TiffTools::setCurrentDirectory(handle, dir);
+            EXPECT_EQ(dir.ifdOffset, (int64)TIFFCurrentDirOffset(handle));
+            cv::Mat raster;
+            slideio::TiffTools::readStripedDir(handle, dir, raster);
+            ASSERT_EQ(dir.width, raster.cols);
+            EXPECT_EQ(step.second, cv::mean(raster)[0]);
+        }
+    }
+    {
+        // idle handles positioned on the requested directory are leased first
+        slideio::TiffHandlePool pool(filePath);
+        TIFF* subHandle(nullptr);
+        TIFF* mainHandle(nullptr);
+        {
+            slideio::TiffHandlePool::Lease lease1 = pool.lease();
+            slideio::TiffHandlePool::Lease lease2 = pool.lease();
+            slideio::TiffTools::setCurrentDirectory(lease1, sub0);
+            slideio::TiffTools::setCurrentDirectory(lease2, main1);
+            subHandle = lease1.handle();
+            mainHandle = lease2.handle();
+        }
+        slideio::TiffHandlePool::Lease subLease = pool.lease(sub0.ifdOffset);
+        EXPECT_EQ(subHandle, subLease.handle());
+        slideio::TiffHandlePool::Lease mainLease = pool.lease(main1.ifdOffset);
+        EXPECT_EQ(mainHandle, mainLease.handle());
+    }
+    std::remove(filePath.c_str());
+}
+
+TEST(Slideio_TiffTools, readTileDirect)
+{
+    const std::string filePath =
+        TestTools::getTestImagePath("svs","CMU-1-Small-Region.svs");
+    TIFF* tiff = slideio::TiffTools::openTiffFile(filePath);
+    ASSERT_TRUE(tiff!=nullptr);
+    slideio::TiffDirectory dir;
+    slideio::TiffTools::scanTiffDir(tiff, 0, 0, dir);
+    dir.dataType = slideio::DataType::DT_Byte;
+    ASSERT_TRUE(slideio::TiffTools::canReadTileDirectly(dir));
+    int tile_sx = (dir.width-1)/dir.tileWidth + 1;
+    int tile = 5*tile_sx + 5;
+    std::vector<int> channelIndices = {2, 0};
+    cv::Mat libtiffRaster;
+    slideio::TiffTools::readTile(tiff, dir, tile, channelIndices, libtiffRaster);
+    slideio::TiffTools::closeTiffFile(tiff);
+    // read the same tile by its offset
+    slideio::RandomAccessFile file(filePath);
+    cv::Mat directRaster;
+    slideio::TiffTools::readTile(file, dir, tile, channelIndices, directRaster);
+    ASSERT_EQ(libtiffRaster.size(), directRaster.size());
+    ASSERT_EQ(libtiffRaster.type(), directRaster.type());
+    ASSERT_EQ(2, directRaster.channels());
+    EXPECT_EQ(0, cv::norm(libtiffRaster, directRaster, cv::NORM_INF));
+}
+
+TEST(Slideio_TiffTools, readTileScaled)
+{
+    const std::string filePath =
+        TestTools::getTestImagePath("svs","CMU-1-Small-Region.svs");
+    TIFF* tiff = slideio::TiffTools::openTiffFile(filePath);
+    ASSERT_TRUE(tiff!=nullptr);
+    slideio::TiffDirectory dir;
+    slideio::TiffTools::scanTiffDir(tiff, 0, 0, dir);
+    slideio::TiffTools::closeTiffFile(tiff);
+    dir.dataType = slideio::DataType::DT_Byte;
+    ASSERT_TRUE(slideio::TiffTools::canDecodeTileScaled(dir));
+    int tile_sx = (dir.width-1)/dir.tileWidth + 1;
+    int tile = 5*tile_sx + 5;
+    std::vector<int> channelIndices;
+    slideio::RandomAccessFile file(filePath);
+    cv::Mat fullRaster, scaledRaster;
+    slideio::TiffTools::readTile(file, dir, tile, channelIndices, fullRaster);
+    slideio::TiffTools::readTile(file, dir, tile, channelIndices, scaledRaster, 4);
+    ASSERT_EQ(fullRaster.cols/4, scaledRaster.cols);
+    ASSERT_EQ(fullRaster.rows/4, scaledRaster.rows);
+    // compare with averaged full resolution tile
+    cv::Mat resizedRaster;
+    cv::resize(fullRaster, resizedRaster, scaledRaster.size(), 0, 0, cv::INTER_AREA);
+    cv::Mat score;
+    cv::matchTemplate(scaledRaster, resizedRaster, score, cv::TM_CCOEFF_NORMED);
+    double minScore(0), maxScore(0);
+    cv::minMaxLoc(score, &minScore, &maxScore);
+    EXPECT_LT(0.99, minScore);
+}
+
+}
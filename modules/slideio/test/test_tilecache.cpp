@@ -0,0 +1,65 @@
+#include "test_precomp.hpp"
+#include "opencv2/slideio/tilecache.hpp"
+
+namespace opencv_test {
+
+TEST(Slideio_TileCache, lruEviction)
+{
+    slideio::TileCache& cache = slideio::TileCache::instance();
+    const size_t orgCapacity = cache.getCapacity();
+    cache.clear();
+    cache.resetStatistics();
+    // room for two 100x100 byte tiles
+    cache.setCapacity(20000);
+    const std::vector<int> channels = {0};
+    const std::string key1 = slideio::TileCache::makeKey("scope", 1, channels);
+    const std::string key2 = slideio::TileCache::makeKey("scope", 2, channels);
+    const std::string key3 = slideio::TileCache::makeKey("scope", 3, channels);
+    cache.put(key1, cv::Mat(100, 100, CV_8UC1, cv::Scalar(1)));
+    cache.put(key2, cv::Mat(100, 100, CV_8UC1, cv::Scalar(2)));
+    cv::Mat tile;
+    // touch the first tile: the second one becomes least recently used
+    ASSERT_TRUE(cache.get(key1, tile));
+    EXPECT_EQ(1, tile.at<uint8_t>(0, 0));
+    cache.put(key3, cv::Mat(100, 100, CV_8UC1, cv::Scalar(3)));
+    EXPECT_TRUE(cache.get(key1, tile));
+    EXPECT_FALSE(cache.get(key2, tile));
+    EXPECT_TRUE(cache.get(key3, tile));
+    EXPECT_EQ(3, tile.at<uint8_t>(0, 0));
+    const slideio::TileCache::Statistics stats = cache.getStatistics();
+    EXPECT_EQ(3u, stats.hits);
+    EXPECT_EQ(1u, stats.misses);
+    EXPECT_EQ(1u, stats.evictions);
+    EXPECT_EQ(2u, stats.tileCount);
+    EXPECT_EQ(20000u, stats.memoryUsage);
+    // keys differ by channel set
+    EXPECT_NE(key1, slideio::TileCache::makeKey("scope", 1, std::vector<int>()));
+    cache.clear();
+    cache.setCapacity(orgCapacity);
+}
+
+TEST(Slideio_TileCache, removeScope)
+{
+    slideio::TileCache& cache = slideio::TileCache::instance();
+    cache.clear();
+    const std::string scope1 = slideio::TileCache::makeScope("file");
+    const std::string scope2 = slideio::TileCache::makeScope("file");
+    // each open of a file gets its own scope
+    EXPECT_NE(scope1, scope2);
+    const std::vector<int> channels = {0};
+    const std::string key1 = slideio::TileCache::makeKey(scope1 + "|0", 1, channels);
+    const std::string key2 = slideio::TileCache::makeKey(scope2 + "|0", 1, channels);
+    cache.put(key1, cv::Mat(10, 10, CV_8UC1, cv::Scalar(1)));
+    cache.put(key2, cv::Mat(10, 10, CV_8UC1, cv::Scalar(2)));
+    cache.removeScope(scope1);
+    cv::Mat tile;
+    EXPECT_FALSE(cache.get(key1, tile));
+    ASSERT_TRUE(cache.get(key2, tile));
+    EXPECT_EQ(2, tile.at<uint8_t>(0, 0));
+    const slideio::TileCache::Statistics stats = cache.getStatistics();
+    EXPECT_EQ(1u, stats.tileCount);
+    EXPECT_EQ(100u, stats.memoryUsage);
+    cache.clear();
+}
+
+}
@@ -37,4 +37,177 @@ TEST(Slideio_TileComposer, composeRect)
     //cv::imwrite(R"(d:\Temp\a.bmp)", image);
 
 }
-}
\ No newline at end of file
+
+TEST(Slideio_TileComposer, getTilesInRect)
+{
+    const int tileWidth(100), tileHeight(200), tilesX(6), tilesY(3);
+    cv::Scalar white(255, 255, 0), black(0, 255, 255);
+    TestTiler testTiler(tileWidth, tileHeight, tilesX, tilesY, black, white);
+    std::vector<int> tileIndices;
+    // rectangle inside of a single tile
+    testTiler.getTilesInRect(cv::Rect(110, 210, 50, 50), tileIndices, nullptr);
+    ASSERT_EQ(tileIndices.size(), 1u);
+    EXPECT_EQ(tileIndices[0], 7);
+    // rectangle crossing tile borders
+    testTiler.getTilesInRect(cv::Rect(150, 150, 100, 100), tileIndices, nullptr);
+    const std::vector<int> expected = {1, 2, 7, 8};
+    EXPECT_EQ(tileIndices, expected);
+    // rectangle outside of the tiles
+    testTiler.getTilesInRect(cv::Rect(1000, 1000, 10, 10), tileIndices, nullptr);
+    EXPECT_TRUE(tileIndices.empty());
+}
+
+TEST(Slideio_TileComposer, composeRectConcurrent)
+{
+    const int tileWidth(100), tileHeight(200), tilesX(6), tilesY(3);
+    cv::Scalar white(255, 255, 0), black(0, 255, 255);
+    TestTiler testTiler(tileWidth, tileHeight, tilesX, tilesY, black, white);
+    const cv::Rect imageRect = { 30, 70, tileWidth * 4 + 17, tileHeight * 2 + 11 };
+    const cv::Size blockSize = { imageRect.width / 3, imageRect.height / 3 };
+    const std::vector<int> channelIndices;
+    cv::Mat sequentialImage, concurrentImage;
+    slideio::TileComposer::composeRect(&testTiler, channelIndices, imageRect, blockSize, sequentialImage, nullptr);
+    testTiler.m_concurrentReads = true;
+    slideio::TileComposer::composeRect(&testTiler, channelIndices, imageRect, blockSize, concurrentImage, nullptr);
+    ASSERT_EQ(sequentialImage.size(), concurrentImage.size());
+    ASSERT_EQ(sequentialImage.type(), concurrentImage.type());
+    EXPECT_EQ(cv::norm(sequentialImage, concurrentImage, cv::NORM_INF), 0.);
+}
+
+TEST(Slideio_TileComposer, composeRectDisjointTiles)
+{
+    const int tileWidth(100), tileHeight(200), tilesX(6), tilesY(3);
+    cv::Scalar white(255, 255, 0), black(0, 255, 255);
+    TestTiler testTiler(tileWidth, tileHeight, tilesX, tilesY, black, white);
+    testTiler.m_concurrentReads = true;
+    const std::vector<int> channelIndices;
+    // blocks partially covered by tiles and blocks crossing tile borders
+    const std::vector<cv::Rect> blockRects = {
+        { 30, 70, tileWidth * 4 + 17, tileHeight * 2 + 11 }, { 550, 500, 200, 200 }, { 95, 190, 10, 20 } };
+    for(const cv::Rect& blockRect : blockRects)
+    {
+        const cv::Size blockSize = { blockRect.width / 2 + 1, blockRect.height / 3 + 1 };
+        cv::Mat checkedImage, image;
+        testTiler.m_disjointTiles = false;
+        slideio::TileComposer::composeRect(&testTiler, channelIndices, blockRect, blockSize, checkedImage, nullptr);
+        // overlaps of tiles declared disjoint are not checked
+        testTiler.m_disjointTiles = true;
+        slideio::TileComposer::composeRect(&testTiler, channelIndices, blockRect, blockSize, image, nullptr);
+        ASSERT_EQ(checkedImage.size(), image.size());
+        ASSERT_EQ(checkedImage.type(), image.type());
+        EXPECT_EQ(cv::norm(checkedImage, image, cv::NORM_INF), 0.);
+    }
+}
+
+TEST(Slideio_TileComposer, composeRectPartialTiles)
+{
+    const int tileWidth(100), tileHeight(200), tilesX(6), tilesY(3);
+    cv::Scalar white(255, 255, 0), black(0, 255, 255);
+    TestTiler testTiler(tileWidth, tileHeight, tilesX, tilesY, black, white);
+    const std::vector<int> channelIndices;
+    // block at native resolution crossing tile borders: pixels are copied
+    const cv::Rect imageRect = { 95, 190, 10, 20 };
+    cv::Mat image;
+    slideio::TileComposer::composeRect(&testTiler, channelIndices, imageRect, imageRect.size(), image, nullptr);
+    ASSERT_EQ(imageRect.size(), image.size());
+    cv::Mat expected(imageRect.size(), image.type());
+    for(int tileIndex : {0, 1, 6, 7})
+    {
+        cv::Rect tileRect;
+        testTiler.getTileRect(tileIndex, tileRect, nullptr);
+        cv::Mat tileRaster;
+        testTiler.readTile(tileIndex, channelIndices, tileRaster, nullptr);
+        const cv::Rect intersection = tileRect & imageRect;
+        tileRaster(intersection - tileRect.tl()).copyTo(expected(intersection - imageRect.tl()));
+    }
+    EXPECT_EQ(cv::norm(image, expected, cv::NORM_INF), 0.);
+    // downscaled block: every output pixel keeps the color of the tile containing its center
+    const cv::Rect largeRect = { 50, 100, 400, 400 };
+    slideio::TileComposer::composeRect(&testTiler, channelIndices, largeRect, cv::Size(40, 40), image, nullptr);
+    ASSERT_EQ(cv::Size(40, 40), image.size());
+    EXPECT_EQ(cv::Vec4b(255, 255, 0, 0), image.at<cv::Vec4b>(0, 0));
+    EXPECT_EQ(cv::Vec4b(0, 255, 255, 0), image.at<cv::Vec4b>(0, 6));
+    EXPECT_EQ(cv::Vec4b(0, 255, 255, 0), image.at<cv::Vec4b>(11, 0));
+}
+
+TEST(Slideio_TileComposer, composeRectSinglePass)
+{
+    const int tileWidth(100), tileHeight(200), tilesX(6), tilesY(3);
+    cv::Scalar white(255, 255, 0), black(0, 255, 255);
+    TestTiler testTiler(tileWidth, tileHeight, tilesX, tilesY, black, white);
+    testTiler.m_concurrentReads = true;
+    const std::vector<int> channelIndices;
+    const cv::Rect imageRect = { 30, 70, tileWidth * 4 + 17, tileHeight * 2 + 11 };
+    const cv::Size blockSize = { imageRect.width / 3, imageRect.height / 3 };
+    cv::Mat nativeImage, expectedImage, image;
+    slideio::TileComposer::composeRect(&testTiler, channelIndices, imageRect, imageRect.size(), nativeImage, nullptr);
+    cv::resize(nativeImage, expectedImage, blockSize, 0, 0, cv::INTER_AREA);
+    slideio::TileComposer::composeRect(&testTiler, channelIndices, imageRect, blockSize, image, nullptr,
+        slideio::ComposeMode::SinglePass);
+    ASSERT_EQ(expectedImage.size(), image.size());
+    ASSERT_EQ(expectedImage.type(), image.type());
+    EXPECT_EQ(cv::norm(expectedImage, image, cv::NORM_INF), 0.);
+}
+
+TEST(Slideio_TileComposer, composeRects)
+{
+    const int tileWidth(100), tileHeight(200), tilesX(6), tilesY(3);
+    cv::Scalar white(255, 255, 0), black(0, 255, 255);
+    TestTiler testTiler(tileWidth, tileHeight, tilesX, tilesY, black, white);
+    testTiler.m_concurrentReads = true;
+    const std::vector<int> channelIndices;
+    // overlapping rectangles sharing tiles 0, 1, 6 and 7
+    const std::vector<cv::Rect> blockRects = {
+        { 50, 100, 100, 200 }, { 80, 150, 60, 120 }, { 95, 190, 10, 20 }, { 20, 30, 150, 300 } };
+    const std::vector<cv::Size> blockSizes = { { 50, 100 }, { 60, 120 }, { 10, 20 }, { 37, 41 } };
+    std::vector<cv::Mat> images;
+    slideio::TileComposer::composeRects(&testTiler, channelIndices, blockRects, blockSizes, images, nullptr);
+    EXPECT_EQ(4, testTiler.m_readCount.load());
+    ASSERT_EQ(blockRects.size(), images.size());
+    for(size_t block = 0; block < blockRects.size(); ++block)
+    {
+        cv::Mat expected;
+        slideio::TileComposer::composeRect(&testTiler, channelIndices, blockRects[block], blockSizes[block],
+            expected, nullptr);
+        ASSERT_EQ(expected.size(), images[block].size());
+        ASSERT_EQ(expected.type(), images[block].type());
+        EXPECT_EQ(cv::norm(expected, images[block], cv::NORM_INF), 0.);
+    }
+}
+
+TEST(Slideio_TileComposer, composeRectsInChunks)
+{
+    const int tileWidth(100), tileHeight(200), tilesX(6), tilesY(3);
+    cv::Scalar white(255, 255, 0), black(0, 255, 255);
+    TestTiler testTiler(tileWidth, tileHeight, tilesX, tilesY, black, white);
+    testTiler.m_concurrentReads = true;
+    const std::vector<int> channelIndices;
+    // blocks in reverse spatial order, neighbours share tiles
+    std::vector<cv::Rect> blockRects;
+    for(int y = 2*tileHeight + 50; y >= 0; y -= tileHeight/2)
+    {
+        for(int x = 5*tileWidth; x >= 0; x -= 70)
+        {
+            blockRects.push_back(cv::Rect(x + 10, y + 20, 90, 80));
+        }
+    }
+    const std::vector<cv::Size> blockSizes(blockRects.size(), cv::Size(45, 40));
+    // one block per chunk: tiles shared by the chunks are read once
+    const int orgNumThreads = cv::getNumThreads();
+    cv::setNumThreads(1);
+    std::vector<cv::Mat> images;
+    slideio::TileComposer::composeRects(&testTiler, channelIndices, blockRects, blockSizes, images, nullptr);
+    cv::setNumThreads(orgNumThreads);
+    EXPECT_EQ(tilesX * tilesY, testTiler.m_readCount.load());
+    ASSERT_EQ(blockRects.size(), images.size());
+    for(size_t block = 0; block < blockRects.size(); ++block)
+    {
+        cv::Mat expected;
+        slideio::TileComposer::composeRect(&testTiler, channelIndices, blockRects[block], blockSizes[block],
+            expected, nullptr);
+        ASSERT_EQ(expected.size(), images[block].size());
+        EXPECT_EQ(cv::norm(expected, images[block], cv::NORM_INF), 0.);
+    }
+}
+
+}
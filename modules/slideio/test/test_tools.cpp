@@ -3,6 +3,8 @@
 // of this distribution and at http://opencv.org/license.html.
 #include "test_precomp.hpp"
 #include "opencv2/slideio/tools.hpp"
+#include "opencv2/slideio/workerpool.hpp"
+#include <future>
 
 namespace opencv_test {
 
@@ -49,4 +51,25 @@ TEST(Slideio_Tools, findZoomLevel)
     EXPECT_EQ(slideio::Tools::findZoomLevel(0.1, numLevels, zoomFunct), 3);
 }
 
+TEST(Slideio_WorkerPool, setNumThreadsFromTask)
+{
+    slideio::WorkerPool& pool = slideio::WorkerPool::instance();
+    std::promise<bool> rejected;
+    std::future<bool> result = rejected.get_future();
+    pool.submit([&pool, &rejected]()
+    {
+        // a thread of the pool cannot join itself
+        try
+        {
+            pool.setNumThreads(2);
+            rejected.set_value(false);
+        }
+        catch(const std::runtime_error&)
+        {
+            rejected.set_value(true);
+        }
+    });
+    EXPECT_TRUE(result.get());
+}
+
 }
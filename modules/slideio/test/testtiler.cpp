@@ -1,5 +1,6 @@
 #include "test_precomp.hpp"
 #include "testtiler.hpp"
+#include <algorithm>
 
 namespace opencv_test {
 
@@ -23,6 +24,7 @@ bool TestTiler::getTileRect(int tileIndex, cv::Rect& tileRect, void* userData)
 bool TestTiler::readTile(int tileIndex, const std::vector<int>& channelIndices, cv::OutputArray tileRaster,
 	void* userData)
 {
+	++m_readCount;
 	cv::Size tileSize = { m_tileWidth, m_tileHeight };
 	tileRaster.create(tileSize, CV_MAKETYPE(CV_8U, m_whiteColor.channels));
 	int tileY = tileIndex / m_tilesX;
@@ -38,4 +40,53 @@ bool TestTiler::readTile(int tileIndex, const std::vector<int>& channelIndices,
 	tileMat.setTo(color);
 	return true;
 }
+static std::vector<int> sortedTiles(std::vector<int> tileIndices)
+{
+	std::sort(tileIndices.begin(), tileIndices.end());
+	return tileIndices;
+}
+
+void expectTilesInRectMatchScan(slideio::Tiler& tiler, void* userData)
+{
+	const int tileCount = tiler.getTileCount(userData);
+	ASSERT_LT(0, tileCount);
+	cv::Rect bounds;
+	std::vector<cv::Rect> tileRects(tileCount);
+	for(int tileIndex = 0; tileIndex < tileCount; ++tileIndex)
+	{
+		ASSERT_TRUE(tiler.getTileRect(tileIndex, tileRects[tileIndex], userData));
+		bounds = tileIndex==0 ? tileRects[tileIndex] : (bounds | tileRects[tileIndex]);
+	}
+	std::vector<cv::Rect> rects = {
+		bounds,
+		cv::Rect(bounds.x - 10, bounds.y - 10, bounds.width + 20, bounds.height + 20),
+		cv::Rect(bounds.x - 10, bounds.y + bounds.height/3, 20, bounds.height/3),
+		cv::Rect(bounds.br().x - 10, bounds.br().y - 10, 20, 20),
+		cv::Rect(bounds.br().x, bounds.y, 10, bounds.height),
+		cv::Rect(bounds.x, bounds.y - 10, bounds.width, 10),
+		cv::Rect(bounds.x + 1, bounds.y + 1, 0, 0)
+	};
+	for(const int tileIndex : { 0, tileCount/2, tileCount - 1 })
+	{
+		const cv::Rect& tileRect = tileRects[tileIndex];
+		const cv::Point br = tileRect.br();
+		rects.push_back(tileRect);
+		rects.push_back(tileRect + cv::Point(tileRect.width/2, tileRect.height/2));
+		rects.push_back(cv::Rect(tileRect.tl(), cv::Size(1, 1)));
+		rects.push_back(cv::Rect(br.x - 1, br.y - 1, 1, 1));
+		rects.push_back(cv::Rect(br.x, br.y, 1, 1));
+		rects.push_back(cv::Rect(br.x - 1, tileRect.y, 2, tileRect.height));
+		rects.push_back(cv::Rect(tileRect.x, br.y - 1, tileRect.width, 2));
+		rects.push_back(cv::Rect(br.x - 3, br.y - 3, 6, 6));
+	}
+	for(const cv::Rect& rect : rects)
+	{
+		SCOPED_TRACE(cv::format("rect (%d,%d,%d,%d)", rect.x, rect.y, rect.width, rect.height));
+		std::vector<int> indexed, scanned;
+		tiler.getTilesInRect(rect, indexed, userData);
+		tiler.slideio::Tiler::getTilesInRect(rect, scanned, userData);
+		EXPECT_EQ(sortedTiles(scanned), sortedTiles(indexed));
+	}
+}
+
 }
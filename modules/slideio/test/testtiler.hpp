@@ -1,5 +1,6 @@
 #pragma once
 #include "opencv2/slideio/tilecomposer.hpp"
+#include <atomic>
 
 namespace opencv_test
 {
@@ -17,6 +18,8 @@ namespace opencv_test
 		bool getTileRect(int tileIndex, cv::Rect& tileRect, void* userData) override;
 		bool readTile(int tileIndex, const std::vector<int>& channelIndices, cv::OutputArray tileRaster,
 			void* userData) override;
+		bool supportsConcurrentReads(void* userData) override { return m_concurrentReads; }
+		bool hasDisjointTiles(void* userData) override { return m_disjointTiles; }
 	public:
 		int m_tileWidth;
 		int m_tileHeight;
@@ -24,5 +27,11 @@ namespace opencv_test
 		int m_tilesY;
 		cv::Scalar m_blackColor;
 		cv::Scalar m_whiteColor;
+		bool m_concurrentReads = false;
+		bool m_disjointTiles = false;
+		std::atomic<int> m_readCount{0};
 	};
+	// compares tiles returned by getTilesInRect of the tiler with a scan of all
+	// its tiles for rectangles at the borders of tiles and of the tiled area
+	void expectTilesInRectMatchScan(slideio::Tiler& tiler, void* userData);
 }